@@ -14,543 +14,4229 @@
 // A compound_str is a compound in std::string form, e.g., "CaSO4", etc.
 // An entity is a chemical entity, including atom, ion and others, e.g., Ca, H, SO4, etc.
 // An entity_str is an chemical entity (**with its coefficient**) in std::string form, e.g., "Ca", "H2", "SO4", etc.
-// A compound composition is a std::map that maps the elements in the compound with their coefficients, e.g., "Ca"->1, "H"->2, "SO4"->1, etc.
+// A compound composition is a sorted array that pairs the elements (by id, see CBU_Elements) in the compound with their coefficients, e.g., (1 "H", 2), (8 "O", 4), (16 "S", 1), (20 "Ca", 1), etc.
 // Use . to substitute · (in complex compounds e.g., CuSO4·5H2O)
 
 
 #ifndef CBU_BALANCER_H
 #define CBU_BALANCER_H
 
+#ifndef CBU_QUIET
 #include <iostream>
+#endif
 #include <vector>
 #include <string>
-#include <map>
 #include <deque>
-#include <set>
-#define HAS_EXCEPTIONS
+#include <array>
+#include <string_view>
+#include <algorithm>
+#include <numeric>
+#include <cstdint>
+#include <climits>
+#include <cstdlib>
+#include <limits>
+#include <cmath>
+#include <stdexcept>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <memory>
+#include <shared_mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <functional>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__)) && !defined(CBU_NO_SIMD)
+#define CBU_X86_SIMD // the recursion kernel has SSE2 and AVX2 versions, chosen at runtime
+#include <immintrin.h>
+#endif
+#if (defined(__unix__) || defined(__APPLE__)) && !defined(CBU_NO_MMAP)
+#define CBU_MMAP // a CBU_Result_cache can live in a memory-mapped file
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 #define DEFAULT_MAX_COEF 20
+#define MAX_PARENTHESES_DEPTH 16 // the deepest nesting of parentheses in a compound
+#define DEFAULT_CACHE_CAPACITY 4096 // the number of compounds a CBU_Composition_cache holds by default
+#define RESULT_CACHE_MAGIC "CBURES2" // the first 8 bytes of a CBU_Result_cache file (with the terminating '\0')
+#define RESULT_CACHE_MIN_MAPPING (1 << 20) // a CBU_Result_cache file is mapped at least this many bytes at a time (the mapping grows twofold)
+#define CONSTEXPR_MAX_COMPOUNDS 16 // the compounds CBU_Constexpr::balance holds by default
+#define CONSTEXPR_MAX_ELEMENTS 16 // the elements CBU_Constexpr::balance holds by default
+#define SMALL_MAX_ELEMENTS 16 // a main matrix with at most this many rows and SMALL_MAX_COMPOUNDS columns is eliminated in std::array storage on the stack
+#define SMALL_MAX_COMPOUNDS 32
+
+// The strategies CBU_Balancer can use to solve the main matrix
+enum class CBU_Solver {
+    RECURSION, // enumerates every coefficient in [1, max_coef] (default)
+    PRUNED_RECURSION, // enumerates like RECURSION, but cuts the subtrees that can no longer balance (same results, much faster)
+    PARALLEL_RECURSION, // PRUNED_RECURSION on several threads (same results)
+    NULLSPACE, // computes the integer nullspace of the main matrix directly, no max_coef ceiling for uniquely balanced equations
+    HILBERT_BASIS, // lists the generating reactions (the minimal non-negative solutions), no max_coef ceiling at all
+    MODULAR_NULLSPACE // NULLSPACE computed modulo word-sized primes (one per thread) and rebuilt with the Chinese remainder theorem, for large systems
+};
+#define DEFAULT_SOLVER CBU_Solver::RECURSION
+#define DEFAULT_THREAD_COUNT 0 // 0 means all hardware threads
+#define KERNEL_LANES 8 // the recursion kernel pads each column to a multiple of this many int32 lanes (one AVX2 register)
+#define PARALLEL_TASKS_PER_THREAD 8 // the parallel recursion splits the search into at least this many tasks per thread (for load balancing)
+#ifdef __SIZEOF_INT128__
+#define MODULAR_MAX_PRIMES 4 // the modular nullspace combines at most this many 31-bit primes (their product is kept in 128 bits)
+#else
+#define MODULAR_MAX_PRIMES 2 // (their product is kept in 64 bits)
+#endif
+#define MODULAR_PARALLEL_MIN_NS 50000 // the modular nullspace reduces the matrix modulo the next primes at once (one per thread) only if the first prime took at least this long (about the cost of starting the threads)
+#define SPARSE_MIN_COMPOUNDS 32 // CBU_Solver::NULLSPACE keeps an equation with at least this many compounds as a sparse matrix (see CBU_Sparse_matrix)
+#define WORKSPACE_MAX_SPARES 4096 // the dropped items (results, presolved blocks, merged columns, compound strings, basis vectors) each pool of the workspace keeps for the next equations, the others are freed
+#define SPECIAL_ELEMENTS_MAX 4096 // the most special elements (symbols outside the periodic table) a program interns, a compound with one more is CBU_Error::TOO_MANY_SPECIAL_ELEMENTS
+#define SPECIAL_ELEMENT_MAX_LENGTH 16 // the longest symbol of a special element (a longer one is CBU_Error::TOO_MANY_SPECIAL_ELEMENTS too)
+#define HILBERT_MAX_CANDIDATES 10000000 // the Hilbert basis solver gives up (CBU_Error::BASIS_TOO_LARGE) when it would try more sets of zeros (for the extreme rays) plus lattice points than this
+
+// The error codes of CBU_Balancer (see CBU_Balancer::error_name)
+enum class CBU_Error {
+    NONE,
+    INVALID_CHAR, // a character that cannot be in a compound
+    INVALID_CHAR_OR_CHAR_POSITION, // a lowercase letter or a digit that does not follow an element or a group, e.g., "c26"
+    UNMATCHED_PARENTHESES,
+    PARENTHESES_TOO_DEEP, // more than MAX_PARENTHESES_DEPTH nested parentheses
+    INVALID_COMPOUND, // e.g., "Ca()" or "CuSO4.5"
+    COEFFICIENT_OVERFLOW,
+    BASIS_TOO_LARGE, // the Hilbert basis solver would try more than HILBERT_MAX_CANDIDATES sets of zeros and lattice points
+    INVALID_EQUATION, // no "->", or more than one
+    INCOMPLETE_EQUATION, // a blank side
+    EMPTY_COMPOUND_LIST,
+    INCOMPLETE_REACTANT, // an empty compound, e.g., "C++O2->CO2"
+    ELEMENTS_MISMATCH_BETWEEN_REACTANTS_AND_PRODUCTS,
+    FAILED_TO_BALANCE,
+    TOO_MANY_SPECIAL_ELEMENTS, // a special element beyond the SPECIAL_ELEMENTS_MAX ones interned so far, or longer than SPECIAL_ELEMENT_MAX_LENGTH
+    NO_RESULT // nothing has been balanced
+};
+
+// The kinds of diagnostics a balancer reports
+enum class CBU_Severity { LOG, WARNING, ERROR };
+
+// A diagnostics sink receives every diagnostic a balancer reports (nothing is written anywhere else).
+// It may be called from several threads at the same time (by balance_batch, or by solve on a shared balancer).
+using CBU_Sink = std::function<void(CBU_Severity severity, std::string_view message)>;
+
+#ifndef CBU_QUIET
+// This method writes a diagnostic to the standard streams: logs to std::clog, warnings to std::cout and errors to std::cerr.
+inline void CBU_stream_sink(CBU_Severity severity, std::string_view message) {
+    std::ostream& stream = (severity == CBU_Severity::LOG) ? std::clog : (severity == CBU_Severity::WARNING) ? std::cout : std::cerr;
+    stream << message << std::endl;
+}
+#define DEFAULT_SINK CBU_stream_sink
+#else // a quiet build does no stream I/O unless a sink is given
+#define DEFAULT_SINK nullptr
+#endif
+
+// The periodic table and the element ids used by CBU_Balancer.
+// The id of an element is its atomic number (1 to 118), found through a perfect hash of its symbol that is built at compile time.
+// Any other symbol (a special element, e.g., "Uuo") is given the next free id (from 119) the first time it is seen, and keeps it for the lifetime of the program,
+// so at most SPECIAL_ELEMENTS_MAX special elements are interned, each found through a hash map.
+class CBU_Elements {
+private:
+    static constexpr std::array<std::string_view, 119> _symbols = {
+        "", "H", "He", "Li", "Be", "B", "C", "N", "O", "F", "Ne", "Na", "Mg", "Al", "Si", "P", "S", "Cl", "Ar", "K", "Ca", "Sc", "Ti", "V", "Cr", "Mn",
+        "Fe", "Co", "Ni", "Cu", "Zn", "Ga", "Ge", "As", "Se", "Br", "Kr", "Rb", "Sr", "Y", "Zr", "Nb", "Mo", "Tc", "Ru", "Rh", "Pd", "Ag", "Cd", "In",
+        "Sn", "Sb", "Te", "I", "Xe", "Cs", "Ba", "La", "Ce", "Pr", "Nd", "Pm", "Sm", "Eu", "Gd", "Tb", "Dy", "Ho", "Er", "Tm", "Yb", "Lu", "Hf", "Ta",
+        "W", "Re", "Os", "Ir", "Pt", "Au", "Hg", "Tl", "Pb", "Bi", "Po", "At", "Rn", "Fr", "Ra", "Ac", "Th", "Pa", "U", "Np", "Pu", "Am", "Cm", "Bk",
+        "Cf", "Es", "Fm", "Md", "No", "Lr", "Rf", "Db", "Sg", "Bh", "Hs", "Mt", "Ds", "Rg", "Cn", "Nh", "Fl", "Mc", "Lv", "Ts", "Og"
+    };
+    static constexpr size_t HASH_TABLE_SIZE = 26 * 27; // a capital letter, then no letter or a lowercase letter
+    static constexpr size_t _hash(std::string_view symbol);
+    static constexpr std::array<uint8_t, HASH_TABLE_SIZE> _build_hash_table();
+    static const std::array<uint8_t, HASH_TABLE_SIZE> _hash_table; // slot -> atomic number (0 if empty)
+
+    // The special elements, their id is KNOWN_COUNT + 1 + their index
+    struct Special_elements {
+        std::shared_mutex lock; // shared to look up, unique to intern
+        std::deque<std::string> symbols; // a deque never moves its strings
+        std::unordered_map<std::string_view, unsigned> ids; // symbol (a view of symbols) -> id
+    };
+    static Special_elements& _special() { static Special_elements special; return special; }
+public:
+    static constexpr unsigned KNOWN_COUNT = 118;
+
+    static constexpr unsigned known_id(std::string_view symbol);
+    static constexpr bool is_known(unsigned id) { return id >= 1 && id <= KNOWN_COUNT; }
+    static unsigned id(std::string_view symbol);
+    static std::string_view symbol(unsigned id);
+};
+
+// This method maps a one-letter or two-letter symbol to a distinct slot, or HASH_TABLE_SIZE if the symbol cannot be an element of the periodic table.
+constexpr size_t CBU_Elements::_hash(std::string_view symbol) {
+    if (symbol.empty() || symbol.size() > 2 || symbol[0] < 'A' || symbol[0] > 'Z') { return HASH_TABLE_SIZE; }
+    if (symbol.size() == 1) { return static_cast<size_t>(symbol[0] - 'A') * 27; }
+    if (symbol[1] < 'a' || symbol[1] > 'z') { return HASH_TABLE_SIZE; }
+    return static_cast<size_t>(symbol[0] - 'A') * 27 + static_cast<size_t>(symbol[1] - 'a') + 1;
+}
+
+constexpr std::array<uint8_t, CBU_Elements::HASH_TABLE_SIZE> CBU_Elements::_build_hash_table() {
+    std::array<uint8_t, HASH_TABLE_SIZE> table{};
+    for (size_t atomic_number = 1; atomic_number < _symbols.size(); atomic_number++) {
+        table[_hash(_symbols[atomic_number])] = static_cast<uint8_t>(atomic_number);
+    }
+    return table;
+}
+
+inline constexpr std::array<uint8_t, CBU_Elements::HASH_TABLE_SIZE> CBU_Elements::_hash_table = CBU_Elements::_build_hash_table();
+
+// This method returns the atomic number of a symbol, or 0 if it is not in the periodic table.
+constexpr unsigned CBU_Elements::known_id(std::string_view symbol) {
+    const size_t slot = CBU_Elements::_hash(symbol);
+    return (slot == HASH_TABLE_SIZE) ? 0 : CBU_Elements::_hash_table[slot];
+}
+
+// This method returns the id of any symbol (interning it if it is a special element), or 0 if it is a special element that cannot be interned (see SPECIAL_ELEMENTS_MAX).
+inline unsigned CBU_Elements::id(std::string_view symbol) {
+    const unsigned known = CBU_Elements::known_id(symbol);
+    if (known != 0) { return known; }
+
+    Special_elements& special = CBU_Elements::_special();
+    {
+        std::shared_lock<std::shared_mutex> lock(special.lock);
+        const auto found = special.ids.find(symbol);
+        if (found != special.ids.end()) { return found->second; }
+    }
+    if (symbol.size() > SPECIAL_ELEMENT_MAX_LENGTH) { return 0; }
+    std::unique_lock<std::shared_mutex> lock(special.lock);
+    const auto found = special.ids.find(symbol); // another thread may have interned it meanwhile
+    if (found != special.ids.end()) { return found->second; }
+    if (special.symbols.size() >= SPECIAL_ELEMENTS_MAX) { return 0; }
+    special.symbols.emplace_back(symbol);
+    const unsigned id = KNOWN_COUNT + static_cast<unsigned>(special.symbols.size());
+    special.ids.emplace(special.symbols.back(), id);
+    return id;
+}
+
+// This method returns the symbol of an id.
+inline std::string_view CBU_Elements::symbol(unsigned id) {
+    if (id <= KNOWN_COUNT) { return _symbols[id]; }
+    Special_elements& special = CBU_Elements::_special();
+    std::shared_lock<std::shared_mutex> lock(special.lock);
+    return special.symbols.at(id - KNOWN_COUNT - 1);
+}
+
+// A compound composition: (element id, count) pairs sorted by element id, e.g., H2O is {(1, 2), (8, 1)}
+using CBU_Composition = std::vector<std::pair<unsigned, unsigned>>;
+
+// A dense integer matrix stored in one row-major buffer. matrix[row][column] is an entry.
+class CBU_Matrix {
+private:
+    size_t _rows;
+    size_t _columns;
+    std::vector<int32_t> _data;
+public:
+    CBU_Matrix() : _rows(0), _columns(0), _data() { }
+    CBU_Matrix(size_t rows, size_t columns) : _rows(rows), _columns(columns), _data(rows * columns, 0) { }
+    [[nodiscard]] size_t rows() const { return this->_rows; }
+    [[nodiscard]] size_t columns() const { return this->_columns; }
+    [[nodiscard]] bool empty() const { return this->_data.empty(); }
+    int32_t* operator[](size_t row) { return this->_data.data() + row * this->_columns; }
+    const int32_t* operator[](size_t row) const { return this->_data.data() + row * this->_columns; }
+    [[nodiscard]] const std::vector<int32_t>& data() const { return this->_data; }
+    void clear() { this->_rows = 0; this->_columns = 0; this->_data.clear(); }
+    void assign(size_t rows, size_t columns) { this->_rows = rows; this->_columns = columns; this->_data.assign(rows * columns, 0); } // a zero matrix in the same buffer (no allocation if it fits)
+    [[nodiscard]] std::vector<std::vector<int>> to_vectors() const; // the nested-vector view of get_main_matrix
+};
+
+inline std::vector<std::vector<int>> CBU_Matrix::to_vectors() const {
+    std::vector<std::vector<int>> vectors(this->_rows);
+    for (size_t i = 0; i < this->_rows; i++) {
+        vectors[i].assign((*this)[i], (*this)[i] + this->_columns);
+    }
+    return vectors;
+}
+
+// A sparse integer matrix in compressed sparse column (CSC) form: the non-zero entries of column j are at [column_start(j), column_start(j + 1)), by ascending row.
+// A compound contains a handful of elements, so the main matrix of a large equation is mostly zeros, and its size is the number of non-zero entries.
+class CBU_Sparse_matrix {
+private:
+    size_t _rows;
+    std::vector<size_t> _column_starts; // columns + 1 offsets
+    std::vector<uint32_t> _row_indices;
+    std::vector<int32_t> _values;
+public:
+    CBU_Sparse_matrix() : _rows(0), _column_starts(), _row_indices(), _values() { }
+    [[nodiscard]] size_t rows() const { return this->_rows; }
+    [[nodiscard]] size_t columns() const { return this->_column_starts.empty() ? 0 : this->_column_starts.size() - 1; }
+    [[nodiscard]] size_t nonzeros() const { return this->_values.size(); }
+    [[nodiscard]] bool empty() const { return this->_column_starts.empty(); }
+    [[nodiscard]] size_t column_start(size_t column) const { return this->_column_starts[column]; }
+    [[nodiscard]] uint32_t row_index(size_t k) const { return this->_row_indices[k]; }
+    [[nodiscard]] int32_t value(size_t k) const { return this->_values[k]; }
+    void clear() { this->_rows = 0; this->_column_starts.clear(); this->_row_indices.clear(); this->_values.clear(); }
+    void begin(size_t rows) { this->clear(); this->_rows = rows; this->_column_starts.push_back(0); } // starts a matrix whose columns are appended one by one
+    void append(uint32_t row, int32_t value) { this->_row_indices.push_back(row); this->_values.push_back(value); } // appends an entry to the current column (ascending rows)
+    void end_column() { this->_column_starts.push_back(this->_values.size()); }
+    [[nodiscard]] CBU_Matrix to_dense() const;
+};
+
+inline CBU_Matrix CBU_Sparse_matrix::to_dense() const {
+    CBU_Matrix dense(this->_rows, this->columns());
+    for (size_t j = 0; j < this->columns(); j++) {
+        for (size_t k = this->_column_starts[j]; k < this->_column_starts[j + 1]; k++) { dense[this->_row_indices[k]][j] = this->_values[k]; }
+    }
+    return dense;
+}
+
+// A bounded cache from compound string to composition, shared by any number of balancers and threads.
+// Lookups only take a shared lock. When the cache is full, an insertion evicts an entry with the CLOCK algorithm:
+// every lookup marks its entry as referenced, and the clock hand clears the marks until it finds an entry that has not been used since its last pass.
+class CBU_Composition_cache {
+private:
+    struct Slot {
+        std::string compound_str; // empty if the slot is free
+        CBU_Composition composition;
+        std::atomic<bool> referenced{false};
+    };
+
+    size_t _capacity;
+    std::unique_ptr<Slot[]> _slots;
+    std::unordered_map<std::string, size_t> _index; // compound string -> slot
+    size_t _hand; // the clock hand
+    mutable std::shared_mutex _lock;
+    std::atomic<uint64_t> _hits;
+    std::atomic<uint64_t> _misses;
+    std::atomic<uint64_t> _evictions;
+public:
+    explicit CBU_Composition_cache(size_t capacity = DEFAULT_CACHE_CAPACITY)
+        : _capacity(capacity), _slots(new Slot[capacity]), _index(), _hand(0), _lock(), _hits(0), _misses(0), _evictions(0) { _index.reserve(capacity); }
+    CBU_Composition_cache(const CBU_Composition_cache&) = delete;
+    CBU_Composition_cache& operator=(const CBU_Composition_cache&) = delete;
+
+    bool find(const std::string& compound_str, CBU_Composition& composition);
+    void insert(const std::string& compound_str, const CBU_Composition& composition);
+    void clear();
+    [[nodiscard]] size_t capacity() const { return this->_capacity; }
+    [[nodiscard]] size_t size() const { std::shared_lock<std::shared_mutex> lock(this->_lock); return this->_index.size(); }
+    [[nodiscard]] uint64_t hits() const { return this->_hits.load(std::memory_order_relaxed); }
+    [[nodiscard]] uint64_t misses() const { return this->_misses.load(std::memory_order_relaxed); }
+    [[nodiscard]] uint64_t evictions() const { return this->_evictions.load(std::memory_order_relaxed); }
+};
+
+// This method copies the cached composition of a compound into composition, returns false (a miss) if it is not cached.
+inline bool CBU_Composition_cache::find(const std::string& compound_str, CBU_Composition& composition) {
+    std::shared_lock<std::shared_mutex> lock(this->_lock);
+    auto it = this->_index.find(compound_str);
+    if (it == this->_index.end()) {
+        this->_misses.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    Slot& slot = this->_slots[it->second];
+    slot.referenced.store(true, std::memory_order_relaxed);
+    composition = slot.composition;
+    this->_hits.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+// This method caches the composition of a compound (nothing happens if it is already cached, or if the capacity is 0).
+inline void CBU_Composition_cache::insert(const std::string& compound_str, const CBU_Composition& composition) {
+    if (this->_capacity == 0) { return; }
+    std::unique_lock<std::shared_mutex> lock(this->_lock);
+    if (this->_index.count(compound_str)) { return; } // another thread got here first
+
+    while (true) { // the clock goes round at most twice (the first round clears every mark)
+        Slot& slot = this->_slots[this->_hand];
+        if (slot.compound_str.empty() || !slot.referenced.exchange(false, std::memory_order_relaxed)) { break; }
+        this->_hand = (this->_hand + 1) % this->_capacity;
+    }
+
+    Slot& slot = this->_slots[this->_hand];
+    if (!slot.compound_str.empty()) {
+        this->_index.erase(slot.compound_str);
+        this->_evictions.fetch_add(1, std::memory_order_relaxed);
+    }
+    slot.compound_str = compound_str;
+    slot.composition = composition;
+    slot.referenced.store(false, std::memory_order_relaxed);
+    this->_index.emplace(compound_str, this->_hand);
+    this->_hand = (this->_hand + 1) % this->_capacity;
+}
+
+// This method removes every entry (the counters are kept).
+inline void CBU_Composition_cache::clear() {
+    std::unique_lock<std::shared_mutex> lock(this->_lock);
+    for (size_t i = 0; i < this->_capacity; i++) {
+        this->_slots[i].compound_str.clear();
+        this->_slots[i].composition.clear();
+        this->_slots[i].referenced.store(false, std::memory_order_relaxed);
+    }
+    this->_index.clear();
+    this->_hand = 0;
+}
+
+// A store of balancing results keyed by an equation (its compounds sorted, unless its results depend on their order) and the settings that change its results (see CBU_Balancer::_result_cache_key), shared by any number of balancers, threads and processes.
+// It is an append-only log of records, kept in memory or in a file. A file is memory-mapped and its records are read in place: opening it (or refresh) only indexes them by the hash of their keys,
+// so any process can open a file that others are writing, read-only or not. A writable cache appends each new record with one write under an exclusive lock on the file,
+// after indexing the records other processes appended meanwhile. Only the results of the solvers are kept (see is_cacheable), and a record is indexed only if it is whole and its checksum and error are right:
+// the records from a torn or corrupt one on are never indexed, and the next append truncates them.
+// A record is a Record_header, its key (padded to 4 bytes) and the coefficients of its results (results * columns uint32, in the order of the compounds of the key).
+class CBU_Result_cache {
+private:
+    struct Record_header {
+        uint32_t key_size;
+        uint32_t results;
+        uint32_t columns;
+        int32_t error; // a CBU_Error
+        uint32_t checksum; // FNV-1a of the other fields and the rest of the record
+    };
+
+    std::string _memory; // the records of a cache without a file (after RESULT_CACHE_MAGIC, like a file)
+    const char* _data; // the records: the mapping of the file, or _memory
+    size_t _size; // the bytes of _data indexed so far (whole records)
+    std::unordered_multimap<size_t, size_t> _index; // hash of a key -> offset of its record in _data
+    bool _open; // whether the records are in the file
+    bool _read_only;
+#ifdef CBU_MMAP
+    int _file;
+    size_t _mapped; // the length of the mapping (it may go past the end of the file)
+#endif
+    mutable std::shared_mutex _lock;
+    std::atomic<uint64_t> _hits;
+    std::atomic<uint64_t> _misses;
+    std::atomic<uint64_t> _appends;
+
+    static size_t _key_bytes(const Record_header& header) { return (static_cast<size_t>(header.key_size) + 3) & ~static_cast<size_t>(3); }
+    static size_t _record_size(const Record_header& header, size_t available);
+    static uint32_t _checksum(const char* record, size_t size);
+    size_t _find_record(std::string_view key) const;
+    void _index_records(size_t end);
+#ifdef CBU_MMAP
+    bool _map(size_t length);
+    void _catch_up();
+#endif
+public:
+    CBU_Result_cache() : _memory(RESULT_CACHE_MAGIC, 8), _data(_memory.data()), _size(8), _index(), _open(false), _read_only(false),
+#ifdef CBU_MMAP
+        _file(-1), _mapped(0),
+#endif
+        _lock(), _hits(0), _misses(0), _appends(0) { }
+    explicit CBU_Result_cache(const std::string& path, bool read_only = false);
+    ~CBU_Result_cache();
+    CBU_Result_cache(const CBU_Result_cache&) = delete;
+    CBU_Result_cache& operator=(const CBU_Result_cache&) = delete;
+
+    [[nodiscard]] static bool is_cacheable(CBU_Error error) { return error == CBU_Error::NONE || error == CBU_Error::FAILED_TO_BALANCE; } // not the errors of a limit (e.g., COEFFICIENT_OVERFLOW), which another build may not reach
+    bool find(std::string_view key, size_t columns, CBU_Error& error, std::vector<std::vector<unsigned>>& results, bool count_miss = true);
+    void insert(std::string_view key, CBU_Error error, const std::vector<std::vector<unsigned>>& results, size_t columns);
+    void refresh();
+    [[nodiscard]] bool is_open() const { return this->_open; }
+    [[nodiscard]] bool is_read_only() const { return this->_read_only; }
+    [[nodiscard]] size_t size() const { std::shared_lock<std::shared_mutex> lock(this->_lock); return this->_index.size(); }
+    [[nodiscard]] uint64_t hits() const { return this->_hits.load(std::memory_order_relaxed); }
+    [[nodiscard]] uint64_t misses() const { return this->_misses.load(std::memory_order_relaxed); }
+    [[nodiscard]] uint64_t appends() const { return this->_appends.load(std::memory_order_relaxed); }
+};
+
+// This constructor opens (or creates) a result cache file and indexes its records. If the file cannot be used (it is not a result cache, or CBU_MMAP is not defined),
+// the cache keeps its records in memory and is_open is false. A read-only cache never appends (it still sees the records of other processes after refresh).
+inline CBU_Result_cache::CBU_Result_cache(const std::string& path, bool read_only) : CBU_Result_cache() {
+    this->_read_only = read_only;
+#ifdef CBU_MMAP
+    this->_file = ::open(path.c_str(), read_only ? (O_RDONLY | O_CLOEXEC) : (O_RDWR | O_CREAT | O_CLOEXEC), 0644);
+    if (this->_file < 0) { return; }
+    if (!read_only) { ::flock(this->_file, LOCK_EX); }
+    struct stat status{};
+    char magic[8];
+    bool valid = ::fstat(this->_file, &status) == 0;
+    if (valid && status.st_size == 0 && !read_only) { // a new file
+        valid = ::pwrite(this->_file, RESULT_CACHE_MAGIC, 8, 0) == 8;
+        status.st_size = 8;
+    }
+    valid = valid && status.st_size >= 8 && ::pread(this->_file, magic, 8, 0) == 8 && std::memcmp(magic, RESULT_CACHE_MAGIC, 8) == 0;
+    const size_t file_size = valid ? static_cast<size_t>(status.st_size) : 0;
+    if (valid && this->_map(file_size)) {
+        this->_index_records(file_size);
+        this->_open = true; // a record torn by a crash is not indexed, and the next append truncates it
+    }
+    if (!read_only) { ::flock(this->_file, LOCK_UN); }
+    if (!this->_open) {
+        ::close(this->_file);
+        this->_file = -1;
+    }
+#else
+    (void)path;
+#endif
+}
+
+inline CBU_Result_cache::~CBU_Result_cache() {
+#ifdef CBU_MMAP
+    if (this->_mapped) { ::munmap(const_cast<char*>(this->_data), this->_mapped); }
+    if (this->_file >= 0) { ::close(this->_file); }
+#endif
+}
+
+// This method gives the size of a record, or SIZE_MAX if it does not fit in the available bytes (e.g., it is still being written)
+inline size_t CBU_Result_cache::_record_size(const Record_header& header, size_t available) {
+    const size_t head = sizeof(Record_header) + CBU_Result_cache::_key_bytes(header);
+    if (head > available) { return SIZE_MAX; }
+    const size_t values = (available - head) / sizeof(uint32_t);
+    if (header.columns != 0 && header.results > values / header.columns) { return SIZE_MAX; }
+    return head + sizeof(uint32_t) * static_cast<size_t>(header.results) * header.columns;
+}
+
+// This method gives the FNV-1a hash of a whole record, but for its checksum field
+inline uint32_t CBU_Result_cache::_checksum(const char* record, size_t size) {
+    uint32_t hash_value = 0x811c9dc5u;
+    for (size_t i = 0; i < size; i++) {
+        if (i == offsetof(Record_header, checksum)) { i += sizeof(uint32_t) - 1; continue; }
+        hash_value = (hash_value ^ static_cast<unsigned char>(record[i])) * 0x01000193u;
+    }
+    return hash_value;
+}
+
+// This method gives the offset of the record of a key, or SIZE_MAX if there is none
+inline size_t CBU_Result_cache::_find_record(std::string_view key) const {
+    auto range = this->_index.equal_range(std::hash<std::string_view>()(key));
+    for (auto it = range.first; it != range.second; ++it) {
+        Record_header header{};
+        std::memcpy(&header, this->_data + it->second, sizeof(Record_header));
+        if (std::string_view(this->_data + it->second + sizeof(Record_header), header.key_size) == key) { return it->second; }
+    }
+    return SIZE_MAX;
+}
+
+// This method indexes the whole records of _data from _size up to end. It stops at a torn or corrupt record: its checksum is wrong, or its error is not one that is cached (a byte of the file is not trusted as a CBU_Error),
+// or does not match its results (only a success has results).
+inline void CBU_Result_cache::_index_records(size_t end) {
+    size_t offset = this->_size;
+    while (offset < end) {
+        Record_header header{};
+        if (end - offset < sizeof(Record_header)) { break; }
+        std::memcpy(&header, this->_data + offset, sizeof(Record_header));
+        const size_t size = CBU_Result_cache::_record_size(header, end - offset);
+        if (size == SIZE_MAX || header.checksum != CBU_Result_cache::_checksum(this->_data + offset, size)) { break; }
+        if (header.error < 0 || header.error >= static_cast<int32_t>(CBU_Error::NO_RESULT)) { break; }
+        const CBU_Error error = static_cast<CBU_Error>(header.error);
+        if (!CBU_Result_cache::is_cacheable(error) || (error == CBU_Error::NONE) != (header.results > 0)) { break; }
+        this->_index.emplace(std::hash<std::string_view>()(std::string_view(this->_data + offset + sizeof(Record_header), header.key_size)), offset);
+        offset += size;
+    }
+    this->_size = offset;
+}
+
+#ifdef CBU_MMAP
+// This method maps at least length bytes of the file (the offsets in _index stay valid)
+inline bool CBU_Result_cache::_map(size_t length) {
+    if (length <= this->_mapped) { return true; }
+    const size_t mapped = std::max<size_t>(RESULT_CACHE_MIN_MAPPING, 2 * length);
+    void* data = ::mmap(nullptr, mapped, PROT_READ, MAP_SHARED, this->_file, 0);
+    if (data == MAP_FAILED) { return false; }
+    if (this->_mapped) { ::munmap(const_cast<char*>(this->_data), this->_mapped); }
+    this->_data = static_cast<const char*>(data);
+    this->_mapped = mapped;
+    return true;
+}
+
+// This method indexes the records appended to the file since it was last read (under the unique lock)
+inline void CBU_Result_cache::_catch_up() {
+    struct stat status{};
+    if (::fstat(this->_file, &status) != 0 || static_cast<size_t>(status.st_size) <= this->_size) { return; }
+    if (this->_map(static_cast<size_t>(status.st_size))) { this->_index_records(static_cast<size_t>(status.st_size)); }
+}
+#endif
+
+// This method copies the cached results of a key into error and results (in the order of the compounds of the key), returns false (a miss) if it is not cached.
+// A lookup that falls back to another key on a miss passes count_miss = false, so that one equation counts one miss at most.
+inline bool CBU_Result_cache::find(std::string_view key, size_t columns, CBU_Error& error, std::vector<std::vector<unsigned>>& results, bool count_miss) {
+    std::shared_lock<std::shared_mutex> lock(this->_lock);
+    const size_t offset = this->_find_record(key);
+    Record_header header{};
+    if (offset != SIZE_MAX) { std::memcpy(&header, this->_data + offset, sizeof(Record_header)); }
+    if (offset == SIZE_MAX || header.columns != columns) {
+        if (count_miss) { this->_misses.fetch_add(1, std::memory_order_relaxed); }
+        return false;
+    }
+    error = static_cast<CBU_Error>(header.error);
+    const char* values = this->_data + offset + sizeof(Record_header) + CBU_Result_cache::_key_bytes(header);
+    results.assign(header.results, std::vector<unsigned>(columns));
+    for (auto& result : results) {
+        for (auto& coefficient : result) {
+            uint32_t value;
+            std::memcpy(&value, values, sizeof(uint32_t));
+            coefficient = value;
+            values += sizeof(uint32_t);
+        }
+    }
+    this->_hits.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+// This method appends the results of a key (nothing happens if it is already cached, by this or another process, if the cache is read-only, or if the error is not cached, see is_cacheable)
+inline void CBU_Result_cache::insert(std::string_view key, CBU_Error error, const std::vector<std::vector<unsigned>>& results, size_t columns) {
+    if (this->_read_only || !CBU_Result_cache::is_cacheable(error) || (error == CBU_Error::NONE) != !results.empty()) { return; }
+    Record_header header{static_cast<uint32_t>(key.size()), static_cast<uint32_t>(results.size()), static_cast<uint32_t>(columns), static_cast<int32_t>(error), 0};
+    std::string record(sizeof(Record_header) + CBU_Result_cache::_key_bytes(header), '\0');
+    std::memcpy(&record[0], &header, sizeof(Record_header));
+    std::memcpy(&record[sizeof(Record_header)], key.data(), key.size());
+    for (const auto& result : results) {
+        for (size_t j = 0; j < columns; j++) {
+            const uint32_t value = result[j];
+            record.append(reinterpret_cast<const char*>(&value), sizeof(uint32_t));
+        }
+    }
+    header.checksum = CBU_Result_cache::_checksum(record.data(), record.size());
+    std::memcpy(&record[0], &header, sizeof(Record_header));
+
+    std::unique_lock<std::shared_mutex> lock(this->_lock);
+#ifdef CBU_MMAP
+    if (this->_file >= 0) {
+        ::flock(this->_file, LOCK_EX);
+        this->_catch_up();
+        if (this->_find_record(key) == SIZE_MAX // another process got here first
+            && ::ftruncate(this->_file, static_cast<off_t>(this->_size)) == 0 // drops a torn or corrupt tail, which would follow the record otherwise
+            && ::pwrite(this->_file, record.data(), record.size(), static_cast<off_t>(this->_size)) == static_cast<ssize_t>(record.size()) && this->_map(this->_size + record.size())) {
+            this->_index_records(this->_size + record.size());
+            this->_appends.fetch_add(1, std::memory_order_relaxed);
+        }
+        ::flock(this->_file, LOCK_UN);
+        return;
+    }
+#endif
+    if (this->_find_record(key) != SIZE_MAX) { return; } // another thread got here first
+    this->_memory += record;
+    this->_data = this->_memory.data();
+    this->_index_records(this->_memory.size());
+    this->_appends.fetch_add(1, std::memory_order_relaxed);
+}
+
+// This method indexes the records other processes appended to the file since it was opened (or last refreshed)
+inline void CBU_Result_cache::refresh() {
+#ifdef CBU_MMAP
+    std::unique_lock<std::shared_mutex> lock(this->_lock);
+    if (this->_file >= 0) { this->_catch_up(); }
+#endif
+}
+
+// The settings of CBU_Balancer (see CBU_Balancer::solve)
+struct CBU_Options {
+    bool multiple_results = true; // will multiple results be allowed?
+    unsigned max_coef = DEFAULT_MAX_COEF; // the maximum coefficient number allowed in the chemical equation
+    bool log_status = true; // Will there be loggs (only available when multiple_results is on)
+    CBU_Solver solver = DEFAULT_SOLVER; // the strategy used to solve the main matrix
+    unsigned thread_count = DEFAULT_THREAD_COUNT; // the number of threads used by the parallel recursion, the modular nullspace and balance_batch (0 means all hardware threads)
+    std::shared_ptr<CBU_Composition_cache> cache = nullptr; // the compositions cache (nullptr means no cache), shared by every copy of the options
+    std::shared_ptr<CBU_Result_cache> result_cache = nullptr; // the results cache (nullptr means no cache), shared by every copy of the options
+    CBU_Sink sink = DEFAULT_SINK; // where the diagnostics go (nullptr means nowhere)
+};
+
+// The limits of a lazy search (see CBU_Generator). A search stops at whichever limit comes first, and can go on under new limits.
+struct CBU_Limits {
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max(); // the search stops at this time (by default never)
+    uint64_t node_budget = 0; // the search stops after this many more search nodes (0 means no budget)
+    const std::atomic<bool>* cancel = nullptr; // the search stops once *cancel is true (nullptr means never), e.g., set by another thread; it must outlive the search
+};
+
+// The state of a lazy search (see CBU_Generator::get_status)
+enum class CBU_Search_status {
+    RUNNING, // there may be more solutions
+    COMPLETE, // every solution has been yielded (or the equation has an error)
+    DEADLINE, // cut off by CBU_Limits::deadline
+    NODE_BUDGET, // cut off by CBU_Limits::node_budget
+    CANCELLED // cut off by CBU_Limits::cancel
+};
+#define GENERATOR_CHECK_INTERVAL 1024 // a lazy search reads the clock and the cancel flag once per this many steps (a power of 2)
+
+// The stages of balancing an equation (see CBU_Stats)
+enum class CBU_Stage { PARSE, BUILD, PRESOLVE, SOLVE, FILTER };
+
+#ifndef CBU_NO_STATS
+#define CBU_STATS(...) __VA_ARGS__
+#else // a build without instrumentation: nothing is counted or timed, and every CBU_Stats stays zero
+#define CBU_STATS(...)
+#endif
+#define STATS_STAGE_COUNT 5
+#define STATS_HISTOGRAM_BUCKETS 8 // 7 bounds growing tenfold, and +Inf
+
+// The instrumentation of CBU_Balancer, cumulative over the equations it balanced (see CBU_Balancer::get_stats)
+struct CBU_Stats {
+    uint64_t equations = 0; // equations balanced (or tried)
+    uint64_t failures = 0; // equations with an error
+    uint64_t nodes = 0; // nodes of the search trees, i.e., the coefficients tried by the recursion (and the weight combinations tried by the nullspace solver)
+    uint64_t leaves = 0; // complete coefficient vectors checked against the main matrix
+    uint64_t prunes = 0; // coefficients cut by the pruned recursion
+    uint64_t solutions_found = 0; // results found by the solvers
+    uint64_t solutions_filtered = 0; // results dropped by _filter_linear_independent_results
+    size_t peak_rows = 0; // the largest main matrix (elements)
+    size_t peak_columns = 0; // the largest main matrix (compounds)
+    std::array<uint64_t, STATS_STAGE_COUNT> stage_ns{}; // the wall time of each stage (by CBU_Stage)
+    uint64_t equations_ns = 0; // the wall time of every equation
+    std::array<uint64_t, STATS_HISTOGRAM_BUCKETS> seconds_histogram{}; // equations by wall time: up to 10us, 100us, ..., 10s, and more
+    std::array<uint64_t, STATS_HISTOGRAM_BUCKETS> nodes_histogram{}; // equations by nodes: up to 10, 100, ..., 1e7, and more
+
+    void merge(const CBU_Stats& other);
+    [[nodiscard]] std::string to_prometheus() const;
+
+    // These methods are used by CBU_Balancer to record the stats
+    static uint64_t now_ns() { return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count(); }
+    void add_equation(CBU_Error error, uint64_t ns, uint64_t equation_nodes);
+private:
+    static size_t _bucket(uint64_t value, uint64_t first_bound);
+};
+
+inline void CBU_Stats::add_equation(CBU_Error error, uint64_t ns, uint64_t equation_nodes) {
+    this->equations++;
+    if (error != CBU_Error::NONE) { this->failures++; }
+    this->equations_ns += ns;
+    this->seconds_histogram[CBU_Stats::_bucket(ns, 10000)]++;
+    this->nodes_histogram[CBU_Stats::_bucket(equation_nodes, 10)]++;
+}
+
+// This method gives the histogram bucket of value, where the bounds are first_bound, 10 * first_bound, ...
+inline size_t CBU_Stats::_bucket(uint64_t value, uint64_t first_bound) {
+    size_t bucket = 0;
+    for (uint64_t bound = first_bound; bucket < STATS_HISTOGRAM_BUCKETS - 1 && value > bound; bound *= 10) { bucket++; }
+    return bucket;
+}
+
+// This method adds the stats of another balancer (e.g., the CBU_Result::stats of balance_batch)
+inline void CBU_Stats::merge(const CBU_Stats& other) {
+    this->equations += other.equations;
+    this->failures += other.failures;
+    this->nodes += other.nodes;
+    this->leaves += other.leaves;
+    this->prunes += other.prunes;
+    this->solutions_found += other.solutions_found;
+    this->solutions_filtered += other.solutions_filtered;
+    this->peak_rows = std::max(this->peak_rows, other.peak_rows);
+    this->peak_columns = std::max(this->peak_columns, other.peak_columns);
+    this->equations_ns += other.equations_ns;
+    for (size_t i = 0; i < STATS_STAGE_COUNT; i++) { this->stage_ns[i] += other.stage_ns[i]; }
+    for (size_t i = 0; i < STATS_HISTOGRAM_BUCKETS; i++) {
+        this->seconds_histogram[i] += other.seconds_histogram[i];
+        this->nodes_histogram[i] += other.nodes_histogram[i];
+    }
+}
+
+// This method writes the stats in the Prometheus text format (the histograms are cumulative, as Prometheus expects)
+inline std::string CBU_Stats::to_prometheus() const {
+    static const char* const stage_names[STATS_STAGE_COUNT] = {"parse", "build", "presolve", "solve", "filter"};
+    static const char* const seconds_bounds[STATS_HISTOGRAM_BUCKETS] = {"1e-05", "0.0001", "0.001", "0.01", "0.1", "1", "10", "+Inf"};
+    static const char* const nodes_bounds[STATS_HISTOGRAM_BUCKETS] = {"10", "100", "1000", "10000", "100000", "1e+06", "1e+07", "+Inf"};
+    std::string text;
+    char line[128];
+    auto metric = [&text, &line](const char* name, const char* type, const char* help, uint64_t value) {
+        std::snprintf(line, sizeof(line), "%llu", static_cast<unsigned long long>(value));
+        text += std::string("# HELP ") + name + " " + help + "\n# TYPE " + name + " " + type + "\n" + name + " " + line + "\n";
+    };
+    auto histogram = [&text, &line](const char* name, const char* help, const char* const* bounds, const std::array<uint64_t, STATS_HISTOGRAM_BUCKETS>& counts, const char* sum) {
+        text += std::string("# HELP ") + name + " " + help + "\n# TYPE " + name + " histogram\n";
+        uint64_t cumulative = 0;
+        for (size_t i = 0; i < STATS_HISTOGRAM_BUCKETS; i++) {
+            cumulative += counts[i];
+            std::snprintf(line, sizeof(line), "_bucket{le=\"%s\"} %llu\n", bounds[i], static_cast<unsigned long long>(cumulative));
+            text += name + std::string(line);
+        }
+        text += name + std::string("_sum ") + sum + "\n" + name + "_count " + std::to_string(cumulative) + "\n";
+    };
+
+    metric("cbu_equations_total", "counter", "Equations balanced.", this->equations);
+    metric("cbu_failures_total", "counter", "Equations with an error.", this->failures);
+    metric("cbu_search_nodes_total", "counter", "Coefficients tried by the solvers.", this->nodes);
+    metric("cbu_search_leaves_total", "counter", "Complete coefficient vectors checked.", this->leaves);
+    metric("cbu_search_prunes_total", "counter", "Coefficients cut by the pruned recursion.", this->prunes);
+    metric("cbu_solutions_found_total", "counter", "Results found by the solvers.", this->solutions_found);
+    metric("cbu_solutions_filtered_total", "counter", "Results dropped as linearly dependent.", this->solutions_filtered);
+    metric("cbu_matrix_peak_rows", "gauge", "Rows (elements) of the largest main matrix.", this->peak_rows);
+    metric("cbu_matrix_peak_columns", "gauge", "Columns (compounds) of the largest main matrix.", this->peak_columns);
+
+    text += "# HELP cbu_stage_seconds_total Wall time of each balancing stage.\n# TYPE cbu_stage_seconds_total counter\n";
+    for (size_t i = 0; i < STATS_STAGE_COUNT; i++) {
+        std::snprintf(line, sizeof(line), "cbu_stage_seconds_total{stage=\"%s\"} %.9f\n", stage_names[i], static_cast<double>(this->stage_ns[i]) / 1e9);
+        text += line;
+    }
+
+    char sum[32];
+    std::snprintf(sum, sizeof(sum), "%.9f", static_cast<double>(this->equations_ns) / 1e9);
+    histogram("cbu_equation_seconds", "Wall time of each equation.", seconds_bounds, this->seconds_histogram, sum);
+    histogram("cbu_equation_nodes", "Search nodes of each equation.", nodes_bounds, this->nodes_histogram, std::to_string(this->nodes).c_str());
+    return text;
+}
+
+// The balancing data of one equation (see CBU_Balancer::solve and CBU_Balancer::balance_batch)
+struct CBU_Result {
+    std::vector<std::string> reactants;
+    std::vector<std::string> products;
+    std::vector<std::string> elements; // the rows of main_matrix
+    CBU_Matrix main_matrix; // row = each element, column = each compound
+    std::vector<std::vector<unsigned>> coefficients; // each result, in the order of reactants then products
+    CBU_Error error = CBU_Error::NONE; // why the equation is not balanced, e.g., CBU_Error::FAILED_TO_BALANCE
+    CBU_Stats stats; // the instrumentation of this equation
+};
+
+class CBU_Generator;
+class CBU_Session;
 
 class CBU_Balancer {
+    friend class CBU_Benchmark; // times each balancing stage (benchmark/CBU_Benchmark.cpp)
+    friend class CBU_Generator; // runs the stages of an equation and searches it lazily
+    friend class CBU_Session; // keeps an equation between edits and balances it from its reduced main matrix
+    friend class CBU_Constexpr; // uses the overflow checks in constant expressions
 private:
     // Class settings
-    bool _multiple_results; // will multiple results be allowed?
-    unsigned _max_coef; // the maximum coefficient number allowed in the chemical equation
-    bool _log_status; // Will there be loggs (only available when multiple_results is on)
+    CBU_Options _options;
+
+    // The state shared by every floor of the pruned recursion
+    struct Pruning_bounds {
+        std::vector<size_t> order; // order[floor] is the compound (column) fixed at that floor
+        std::vector<std::vector<long long>> min_remaining; // min_remaining[floor][element]: the least the compounds from that floor on can still add
+        std::vector<std::vector<long long>> max_remaining; // max_remaining[floor][element]: the most the compounds from that floor on can still add
+    };
+
+    // The counters of one (pruned) search, added to the stats when it ends
+    struct Search_counters {
+        uint64_t nodes = 0;
+        uint64_t leaves = 0;
+        uint64_t prunes = 0;
+    };
+
+    // The main matrix as searched by the recursion kernel: column-major, each column padded with zeros to a multiple of KERNEL_LANES (one lane per element)
+    struct Kernel_columns {
+        size_t stride = 0; // the padded length of a column
+        std::vector<int32_t> columns; // column j begins at j * stride
+        std::vector<int32_t> rewinds; // (max_coef - 1) times each column, which takes a coefficient from its max_coef back to 1
+        std::vector<unsigned> max_coefs; // the largest coefficient of each column
+    };
+
+    // The vector operations of the recursion kernel on stride int32 lanes (stride is a multiple of KERNEL_LANES)
+    struct Scalar_kernel {
+        static void add(int32_t* residual, const int32_t* column, size_t stride) { for (size_t i = 0; i < stride; i++) { residual[i] += column[i]; } }
+        static void sub(int32_t* residual, const int32_t* column, size_t stride) { for (size_t i = 0; i < stride; i++) { residual[i] -= column[i]; } }
+        static bool is_zero(const int32_t* residual, size_t stride) {
+            int32_t any = 0;
+            for (size_t i = 0; i < stride; i++) { any |= residual[i]; }
+            return any == 0;
+        }
+    };
+#ifdef CBU_X86_SIMD
+    struct SSE2_kernel {
+        __attribute__((target("sse2"))) static void add(int32_t* residual, const int32_t* column, size_t stride) {
+            for (size_t i = 0; i < stride; i += 4) {
+                __m128i sum = _mm_add_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(residual + i)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(column + i)));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(residual + i), sum);
+            }
+        }
+        __attribute__((target("sse2"))) static void sub(int32_t* residual, const int32_t* column, size_t stride) {
+            for (size_t i = 0; i < stride; i += 4) {
+                __m128i difference = _mm_sub_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(residual + i)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(column + i)));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(residual + i), difference);
+            }
+        }
+        __attribute__((target("sse2"))) static bool is_zero(const int32_t* residual, size_t stride) {
+            __m128i any = _mm_setzero_si128();
+            for (size_t i = 0; i < stride; i += 4) { any = _mm_or_si128(any, _mm_loadu_si128(reinterpret_cast<const __m128i*>(residual + i))); }
+            return _mm_movemask_epi8(_mm_cmpeq_epi32(any, _mm_setzero_si128())) == 0xFFFF;
+        }
+    };
+    struct AVX2_kernel {
+        __attribute__((target("avx2"))) static void add(int32_t* residual, const int32_t* column, size_t stride) {
+            for (size_t i = 0; i < stride; i += 8) {
+                __m256i sum = _mm256_add_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(residual + i)), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(column + i)));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(residual + i), sum);
+            }
+        }
+        __attribute__((target("avx2"))) static void sub(int32_t* residual, const int32_t* column, size_t stride) {
+            for (size_t i = 0; i < stride; i += 8) {
+                __m256i difference = _mm256_sub_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(residual + i)), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(column + i)));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(residual + i), difference);
+            }
+        }
+        __attribute__((target("avx2"))) static bool is_zero(const int32_t* residual, size_t stride) {
+            __m256i any = _mm256_setzero_si256();
+            for (size_t i = 0; i < stride; i += 8) { any = _mm256_or_si256(any, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(residual + i))); }
+            return _mm256_testz_si256(any, any) != 0;
+        }
+    };
+#endif
+
+    // The reduced row echelon form of a matrix modulo a prime (see _modular_row_echelon)
+    struct Modular_echelon {
+        uint64_t prime = 0;
+        std::vector<size_t> pivot_columns;
+        std::vector<size_t> free_columns;
+        std::vector<uint64_t> free_entries; // the entry of row i at free column k is at [i * free_columns.size() + k]
+    };
+#ifdef __SIZEOF_INT128__
+    using Modular_int = __int128; // holds the product of MODULAR_MAX_PRIMES primes
+#else
+    using Modular_int = long long;
+#endif
+
+    // A block of the presolved main matrix: its independent element rows and its compounds, identical compounds merged into one column
+    struct Presolve_block {
+        CBU_Matrix matrix; // row = each independent element of the block, column = each group of identical compounds
+        std::vector<std::vector<size_t>> compounds; // compounds[k] are the columns of the main matrix merged into column k (ascending)
+    };
+
+    // A reaction of a reaction set, by the species of its shared species table (see balance_set)
+    struct Set_reaction {
+        std::vector<size_t> species; // the species of each compound, reactants then products
+        size_t reactants_count = 0;
+        std::vector<unsigned> elements; // the rows of its main matrix (sorted by symbol)
+        CBU_Error error = CBU_Error::NONE;
+    };
+
+    // The storage the balancing stages work in, kept from one equation to the next: each stage clears what it uses and refills it within the capacity left by the earlier equations,
+    // so an equation no larger than those balanced before allocates nothing once the spare results have settled (with the solvers that search or eliminate on one thread, see README item 5).
+    // Nothing shrinks, but each pool of dropped items keeps at most WORKSPACE_MAX_SPARES of them. A copy of a balancer starts with an empty workspace.
+    struct Workspace {
+        std::vector<CBU_Composition> reactants_composition;
+        std::vector<CBU_Composition> products_composition;
+        std::vector<CBU_Composition> spare_reactants_composition; // the compositions dropped by an equation with fewer reactants, whose storage the next reactants take
+        std::vector<CBU_Composition> spare_products_composition; // (one pool per side, so a composition goes back to its place, with the capacity it grew there)
+        std::vector<unsigned> elements; // the rows of the main matrix (by id)
+        std::vector<unsigned> product_elements; // the elements of the products, checked against those of the reactants
+        Kernel_columns kernel;
+        Pruning_bounds bounds;
+        std::vector<unsigned> coefficients; // the coefficients being searched, or the result being stored
+        std::vector<int32_t> lanes; // the residual of the recursion kernel
+        std::vector<long long> residual; // the residual of the pruned recursion
+        std::vector<size_t> kept_slots; // the hash set of _filter_linear_independent_results (open addressing)
+        std::vector<std::vector<unsigned>> spare_results; // the results dropped by clear_data, whose storage the next results take (see _push_result)
+        std::vector<std::vector<std::vector<unsigned>>> blocks_results; // the balanced vectors of each presolved block (the first _presolve_blocks.size() are in use)
+        std::vector<Presolve_block> spare_blocks; // the presolved blocks dropped by an equation with fewer of them
+        std::vector<std::vector<size_t>> spare_columns; // the merged columns dropped from the presolved blocks
+
+        Workspace() = default;
+        Workspace(const Workspace&) { }
+        Workspace& operator=(const Workspace&) { return *this; }
+    };
 
     // Useful members
     std::pair<std::vector<std::string>, std::vector<std::string>> _reactants_and_products;
     ////
     //// These two following vectors should be used together
     std::vector<std::string> _elements; // Elements (in the recent equation)
-    std::vector<std::vector<int>> _main_matrix; // Main matrix (reactants and products matrix, row = each element, column = each compound)
+    CBU_Matrix _main_matrix; // Main matrix (reactants and products matrix, row = each element, column = each compound)
+    CBU_Sparse_matrix _sparse_matrix; // the main matrix of a large equation for CBU_Solver::NULLSPACE (_main_matrix is then empty, see _build_main_matrix)
     ////
     std::vector<std::vector<unsigned>> _results_coefs;
+    std::vector<Presolve_block> _presolve_blocks; // the blocks solved one by one (empty if presolving does not reduce the main matrix)
+    std::vector<unsigned> _max_coefs; // the largest coefficient of each column of the matrix being solved (empty means max_coef for every column)
+    CBU_Error _error; // the error code of the recent equation (CBU_Error::NONE if balanced)
+    CBU_Stats _stats; // the instrumentation (cumulative until reset_stats)
+    uint64_t _equation_begin_ns = 0; // when the recent equation began
+    uint64_t _stage_begin_ns = 0; // when the current stage began
+    uint64_t _equation_nodes_begin = 0; // _stats.nodes when the recent equation began
+    Workspace _workspace;
+
+    // Private methods
+    static bool _is_valid_char(const char& c);
+    static CBU_Error _parse_compound(std::string_view compound_str, std::vector<std::pair<std::string_view, unsigned>>& entities);
+    CBU_Error _get_compound_composition(const std::string& compound_str, CBU_Composition& composition) const;
+    void _warn_special_elements(const CBU_Composition& composition) const;
+    static void get_elements_from_compounds_composition(const std::vector<CBU_Composition>& compounds_composition, std::vector<unsigned>& elements);
+    CBU_Error _parse_compounds(const std::vector<std::string>& reactants, const std::vector<std::string>& products,
+                               std::vector<CBU_Composition>& reactants_composition, std::vector<CBU_Composition>& products_composition, std::vector<unsigned>& elements);
+    CBU_Error _collect_elements(const std::vector<CBU_Composition>& reactants_composition, const std::vector<CBU_Composition>& products_composition, std::vector<unsigned>& elements);
+    CBU_Error _match_elements(std::vector<unsigned>& elements, const std::vector<unsigned>& product_elements);
+    void _parse_reaction_set(const std::vector<std::string>& equations, std::vector<CBU_Result>& results, std::vector<CBU_Composition>& compositions, std::vector<Set_reaction>& reactions);
+    static void _reaction_compositions(const std::vector<CBU_Composition>& compositions, const Set_reaction& reaction,
+                                       std::vector<CBU_Composition>& reactants_composition, std::vector<CBU_Composition>& products_composition);
+    static void _build_matrix(const std::vector<CBU_Composition>& reactants_composition, const std::vector<CBU_Composition>& products_composition, const std::vector<unsigned>& elements, CBU_Matrix& matrix);
+    static void _build_sparse_matrix(const std::vector<CBU_Composition>& reactants_composition, const std::vector<CBU_Composition>& products_composition, const std::vector<unsigned>& elements, CBU_Sparse_matrix& matrix);
+    void _build_main_matrix(const std::vector<CBU_Composition>& reactants_composition, const std::vector<CBU_Composition>& products_composition, const std::vector<unsigned>& elements);
+    void _build_coupled_matrix(const std::vector<CBU_Composition>& compositions, const std::vector<Set_reaction>& reactions);
+    static void _independent_rows(const CBU_Matrix& matrix, std::vector<size_t>& rows);
+    void _presolve();
+    CBU_Error _solve_matrix();
+    void _search_matrix(const CBU_Matrix& matrix, bool log_status);
+    void _solve_presolve_blocks();
+    void _expand_block_results(const Presolve_block& block, const std::vector<std::vector<unsigned>>& results, size_t compounds_count, std::vector<std::vector<unsigned>>& expanded);
+    unsigned _column_max_coef(size_t column) const { return this->_max_coefs.empty() ? this->_options.max_coef : this->_max_coefs[column]; }
+    bool _build_kernel_columns(const CBU_Matrix& matrix, Kernel_columns& kernel) const;
+    void _solving_matrix_using_recursion(const CBU_Matrix& matrix, bool log_status);
+    template <typename Kernel> void _recursion_kernel(const Kernel_columns& kernel, bool log_status, Search_counters& counters);
+#ifdef CBU_X86_SIMD
+    __attribute__((target("sse2"), flatten)) void _recursion_kernel_sse2(const Kernel_columns& kernel, bool log_status, Search_counters& counters) { this->_recursion_kernel<SSE2_kernel>(kernel, log_status, counters); }
+    __attribute__((target("avx2"), flatten)) void _recursion_kernel_avx2(const Kernel_columns& kernel, bool log_status, Search_counters& counters) { this->_recursion_kernel<AVX2_kernel>(kernel, log_status, counters); }
+#endif
+    void _build_pruning_bounds(const CBU_Matrix& matrix, bool constrained_first, Pruning_bounds& bounds) const;
+    static bool _pruning_check(const CBU_Matrix& matrix, const Pruning_bounds& bounds, const std::vector<long long>& residual, size_t floor, unsigned coefficient, bool& exhausted);
+    void _solving_matrix_using_pruned_recursion(const CBU_Matrix& matrix, bool log_status);
+    bool _pruned_recursion(const CBU_Matrix& matrix, const Pruning_bounds& bounds, std::vector<unsigned>& coefficients_temporary, std::vector<long long>& residual, size_t floor,
+                           std::vector<std::vector<unsigned>>& results, const std::atomic<size_t>* found_task, size_t task_index, Search_counters& counters);
+    void _push_result(std::vector<std::vector<unsigned>>& results, const std::vector<unsigned>& coefficients);
+    static void _push_spare_result(std::vector<std::vector<unsigned>>& results, const std::vector<unsigned>& coefficients, std::vector<std::vector<unsigned>>& spare_results);
+    template <typename Item> static void _resize_keeping(std::vector<Item>& items, size_t count, std::vector<Item>& spare_items);
+    template <typename Item> static void _keep_spare(std::vector<Item>& spare_items, Item& item);
+    void _add_search_counters(const Search_counters& counters);
+    void _solving_matrix_using_parallel_recursion(const CBU_Matrix& matrix, bool log_status);
+    CBU_Error _solving_matrix_using_nullspace();
+    CBU_Error _solving_matrix_using_hilbert_basis();
+    CBU_Error _solving_matrix_using_modular_nullspace();
+
+    //// Math tools
+    static bool _is_primitive(const std::vector<unsigned>& coefficients);
+    static void _make_primitive(std::vector<unsigned>& coefficients);
+    template <typename Int> static constexpr bool _checked_mul(Int a, Int b, Int& result);
+    template <typename Int> static constexpr bool _checked_add(Int a, Int b, Int& result);
+    template <typename Int> static constexpr bool _checked_sub(Int a, Int b, Int& result);
+    template <typename Int> static constexpr Int _gcd(Int a, Int b);
+    template <typename Int> static bool _integer_nullspace(const CBU_Matrix& matrix, std::vector<std::vector<Int>>& basis);
+    template <typename Int, typename Rows> static bool _integer_nullspace_in(const CBU_Matrix& matrix, Rows& reduced, std::vector<std::vector<Int>>& basis);
+    template <typename Int> static bool _sparse_integer_nullspace(const CBU_Sparse_matrix& matrix, std::vector<std::vector<Int>>& basis);
+    template <typename Int> static bool _canonical_nullspace_basis(std::vector<std::vector<Int>>& basis);
+    template <typename Int> CBU_Error _collect_nullspace_results(const std::vector<std::vector<Int>>& basis);
+    static void _modular_row_echelon(const CBU_Matrix& matrix, uint64_t prime, Modular_echelon& echelon);
+    static uint64_t _modular_inverse(uint64_t a, uint64_t prime);
+    static bool _rational_reconstruction(Modular_int residue, Modular_int modulus, Modular_int& numerator, Modular_int& denominator);
+    static bool _reconstruct_nullspace(const CBU_Matrix& matrix, const Modular_echelon& echelon, const std::vector<Modular_int>& residues, Modular_int modulus, std::vector<std::vector<long long>>& basis);
+    static bool _integer_kernel_lattice(const CBU_Matrix& matrix, std::vector<std::vector<long long>>& basis, std::vector<size_t>& pivots);
+    static bool _unimodular_echelon(std::vector<std::vector<long long>>& rows, size_t first, size_t last, std::vector<size_t>& pivots);
+    void _filter_linear_independent_results();
+
+    //// String tools
+    static CBU_Error _separate_half_equation(std::string_view half_equation, std::vector<std::string>& compounds_str);
+    static std::vector<std::string>& _spare_compounds_str() { thread_local std::vector<std::string> spare_compounds_str; return spare_compounds_str; } // the compound strings dropped by a shorter half equation or by clear_data (the parsing is static, so the pool is per thread)
+    static constexpr bool _find_arrow(std::string_view equation, size_t& begin, size_t& end);
+    static CBU_Error _get_compounds_str(const std::string& equation, std::pair<std::vector<std::string>,std::vector<std::string>>& compounds_str);
+    CBU_Error _balance_with_given_compounds_str(const std::vector<std::string>& reactants, const std::vector<std::string>& products);
+    CBU_Error _balance_stages(const std::vector<std::string>& reactants, const std::vector<std::string>& products);
+    CBU_Error _balance_compositions(const std::vector<CBU_Composition>& reactants_composition, const std::vector<CBU_Composition>& products_composition, const std::vector<unsigned>& elements);
+    void _build_stage(const std::vector<CBU_Composition>& reactants_composition, const std::vector<CBU_Composition>& products_composition, const std::vector<unsigned>& elements);
+    CBU_Error _balance_main_matrix();
+    std::string _result_cache_key(const std::vector<std::string>& reactants, const std::vector<std::string>& products, bool sorted, std::vector<size_t>& order) const;
+    bool _has_order_independent_results() const;
+    CBU_Error _balance_through_result_cache(const std::vector<std::string>& reactants, const std::vector<std::string>& products,
+                                            const std::vector<CBU_Composition>& reactants_composition, const std::vector<CBU_Composition>& products_composition, const std::vector<unsigned>& elements);
+    void _balance_coupled_set(const std::vector<CBU_Composition>& compositions, const std::vector<Set_reaction>& reactions, std::vector<CBU_Result>& results);
+    void _begin_equation();
+    void _clear_equation();
+    void _end_stage(CBU_Stage stage);
+    void _end_equation(CBU_Error error);
+    static std::string _format_results(const std::vector<std::string>& reactants, const std::vector<std::string>& products, const std::vector<std::vector<unsigned>>& results_coefs);
+    CBU_Result _take_result();
+
+    //// Diagnostics
+    void _report(CBU_Severity severity, std::string_view message) const { if (this->_options.sink) { this->_options.sink(severity, message); } }
+    CBU_Error _fail(CBU_Error error, std::string_view context);
+public:
+    // Constructors, getters and setters
+    CBU_Balancer() : _options(), _reactants_and_products(),_elements(),_main_matrix(), _sparse_matrix(), _results_coefs(), _presolve_blocks(), _max_coefs(), _error(CBU_Error::NONE), _stats(), _equation_begin_ns(0), _stage_begin_ns(0), _equation_nodes_begin(0), _workspace() { };
+    explicit CBU_Balancer(const CBU_Options& options) : _options(options), _reactants_and_products(),_elements(),_main_matrix(), _sparse_matrix(), _results_coefs(), _presolve_blocks(), _max_coefs(), _error(CBU_Error::NONE), _stats(), _equation_begin_ns(0), _stage_begin_ns(0), _equation_nodes_begin(0), _workspace() { };
+    void set_multiple_results(bool option) { this->_options.multiple_results = option; }
+    void set_max_coef(unsigned max_coef) { this->_options.max_coef = max_coef;  }
+    void set_log_status(bool option) { this->_options.log_status = option; };
+    void set_solver(CBU_Solver solver) { this->_options.solver = solver; }
+    void set_thread_count(unsigned thread_count) { this->_options.thread_count = thread_count; }
+    void set_cache(std::shared_ptr<CBU_Composition_cache> cache) { this->_options.cache = std::move(cache); }
+    void set_result_cache(std::shared_ptr<CBU_Result_cache> result_cache) { this->_options.result_cache = std::move(result_cache); }
+    void set_sink(CBU_Sink sink) { this->_options.sink = std::move(sink); }
+    void set_options(const CBU_Options& options) { this->_options = options; }
+    [[nodiscard]] const CBU_Options& get_options() const { return this->_options; }
+    // Public interfaces
+    void balance_with_given_compounds(const std::vector<std::string>& reactants, const std::vector<std::string>& products) { // alias
+        this->_begin_equation();
+        this->_clear_equation();
+        _balance_with_given_compounds_str(reactants, products);
+    }
+    void balance(const std::string& equation);
+    [[nodiscard]] std::vector<CBU_Result> balance_batch(const std::vector<std::string>& equations) const;
+    [[nodiscard]] std::vector<CBU_Result> balance_set(const std::vector<std::string>& equations, bool couple_intermediates = false) const;
+    // Reentrant interfaces (no stored data involved)
+    [[nodiscard]] static CBU_Result solve(const std::string& equation, const CBU_Options& options);
+    [[nodiscard]] static CBU_Result solve_with_given_compounds(const std::vector<std::string>& reactants, const std::vector<std::string>& products, const CBU_Options& options);
+    [[nodiscard]] CBU_Result solve(const std::string& equation) const { return CBU_Balancer::solve(equation, this->_options); }
+    [[nodiscard]] CBU_Result solve_with_given_compounds(const std::vector<std::string>& reactants, const std::vector<std::string>& products) const {
+        return CBU_Balancer::solve_with_given_compounds(reactants, products, this->_options);
+    }
+    // Lazy interfaces (the solutions one by one, see CBU_Generator)
+    [[nodiscard]] static CBU_Generator generate(const std::string& equation, const CBU_Options& options, const CBU_Limits& limits = CBU_Limits());
+    [[nodiscard]] CBU_Generator generate(const std::string& equation, const CBU_Limits& limits = CBU_Limits()) const;
+    // Incremental interfaces (an equation edited one compound at a time, see CBU_Session)
+    [[nodiscard]] static CBU_Session session(const CBU_Options& options);
+    [[nodiscard]] static CBU_Session session(const std::string& equation, const CBU_Options& options);
+    [[nodiscard]] CBU_Session session() const;
+    [[nodiscard]] CBU_Session session(const std::string& equation) const;
+    // Common getters
+    [[nodiscard]] const std::pair<std::vector<std::string>, std::vector<std::string>>& get_reactants_and_products() const { return this->_reactants_and_products; }
+    std::pair<std::vector<std::string>, std::vector<std::vector<int>>> get_main_matrix() const;
+    // Views of the balancing data (valid until the next balance or clear_data, nothing is copied)
+    [[nodiscard]] const std::vector<std::string>& get_elements() const { return this->_elements; }
+    [[nodiscard]] const CBU_Matrix& get_matrix() const { return this->_main_matrix; } // empty for an equation kept as a sparse matrix (see get_sparse_matrix)
+    [[nodiscard]] const CBU_Sparse_matrix& get_sparse_matrix() const { return this->_sparse_matrix; }
+    [[nodiscard]] const std::vector<std::vector<unsigned>>& get_coefficients() const { return this->_results_coefs; }
+    [[nodiscard]] std::string get_result() const;
+    [[nodiscard]] static std::string get_result(const CBU_Result& result);
+    [[nodiscard]] CBU_Error get_error() const { return this->_error; }
+    [[nodiscard]] const CBU_Stats& get_stats() const { return this->_stats; }
+    void reset_stats() { this->_stats = CBU_Stats(); }
+    [[nodiscard]] static std::string_view error_name(CBU_Error error);
+    [[nodiscard]] static std::string_view solver_name(CBU_Solver solver);
+    static bool solver_from_name(std::string_view name, CBU_Solver& solver);
+    void clear_data();
+    static std::string version();
+};
+
+// A lazy search over the coefficients of one equation, which yields each primitive solution as soon as it is found (see CBU_Balancer::generate).
+// The solutions come in the order of CBU_Solver::RECURSION, and all of them are exactly what balance finds with multiple results (the solver and multiple_results settings are not used).
+// The search is the pruned recursion on an explicit stack (one coefficient per compound), so it can stop at any step and resume later, e.g., after a deadline, under new limits (set_limits).
+class CBU_Generator {
+    friend class CBU_Balancer;
+private:
+    CBU_Balancer _balancer; // parses the equation, and holds its main matrix, error and stats
+    CBU_Balancer::Pruning_bounds _bounds; // in the given order of the compounds
+    std::vector<unsigned> _coefficients; // the coefficients fixed above _floor, and the last one tried on _floor (0 if none)
+    std::vector<long long> _residual; // the sum of the compounds fixed above _floor (per element)
+    size_t _floor = 0; // the compound being tried
+    CBU_Search_status _status = CBU_Search_status::RUNNING;
+    CBU_Limits _limits;
+    uint64_t _nodes = 0; // the search nodes so far (counted even without stats, for the node budget)
+    uint64_t _node_limit = UINT64_MAX; // the search stops when _nodes reaches it
+    uint64_t _solutions = 0; // the solutions yielded so far
+
+    CBU_Generator(const std::string& equation, const CBU_Options& options, const CBU_Limits& limits);
+    bool _limit_reached();
+    void _finish();
+public:
+    bool next(std::vector<unsigned>& coefficients);
+    void set_limits(const CBU_Limits& limits);
+    [[nodiscard]] CBU_Search_status get_status() const { return this->_status; }
+    [[nodiscard]] CBU_Error get_error() const { return this->_balancer.get_error(); }
+    [[nodiscard]] const CBU_Stats& get_stats() const { return this->_balancer.get_stats(); }
+    [[nodiscard]] const std::pair<std::vector<std::string>, std::vector<std::string>>& get_reactants_and_products() const { return this->_balancer._reactants_and_products; }
+    [[nodiscard]] std::string format(const std::vector<unsigned>& coefficients) const {
+        return CBU_Balancer::_format_results(this->_balancer._reactants_and_products.first, this->_balancer._reactants_and_products.second, {coefficients});
+    }
+};
+
+// An equation that is edited one compound at a time, e.g., in a reaction editor, and rebalanced after each edit without starting over (see CBU_Balancer::session).
+// The session keeps the composition of each compound, so an edit parses only the compound it adds. With CBU_Solver::NULLSPACE, it also keeps the main matrix in reduced row echelon form,
+// together with the row operations that lead there, and adding or removing a compound (or the row of a new element) is a rank-one update of that form in O(elements * (elements + compounds))
+// instead of a new elimination. balance then reads the nullspace basis straight from it, and the results are exactly those of balance on the same equation.
+// The other solvers solve the main matrix built from the kept compositions.
+class CBU_Session {
+    friend class CBU_Balancer;
+private:
+    CBU_Balancer _balancer; // holds the compounds (in the order of the equation), and the main matrix, results, error and stats of the recent balance
+    std::vector<CBU_Composition> _compositions; // the composition of each compound, by column of the reduced form (the order they were added in)
+    std::vector<size_t> _reactant_columns; // the column of each reactant in the reduced form
+    std::vector<size_t> _product_columns; // the column of each product in the reduced form
+    std::unordered_map<unsigned, size_t> _element_rows; // the row of each element (an element keeps its row when no compound has it any more)
+    std::vector<std::vector<long long>> _reduced; // the reduced row echelon form, row i = _transform[i] * the main matrix (rows by _element_rows, columns by _compositions)
+    std::vector<std::vector<long long>> _transform; // the row operations, i.e., each reduced row as a combination of the element rows
+    std::vector<size_t> _pivots; // the pivot column of each reduced row (SIZE_MAX for a zero row)
+    std::vector<unsigned> _elements; // the elements of the recent balance, ordered as the rows of its main matrix
+    bool _factored = false; // the reduced form is up to date (CBU_Solver::NULLSPACE only, it is rebuilt by the next balance after an overflow)
+
+    explicit CBU_Session(const CBU_Options& options);
+    CBU_Session(const std::string& equation, const CBU_Options& options);
+    CBU_Error _add_compound(const std::string& compound, bool product);
+    bool _remove_compound(size_t index, bool product);
+    void _add_element_row(unsigned element);
+    bool _add_column(const CBU_Composition& composition, int32_t sign);
+    bool _remove_column(size_t column);
+    bool _eliminate(size_t pivot_row, size_t column);
+    bool _refactor();
+    bool _nullspace_basis(std::vector<std::vector<long long>>& basis) const;
+    CBU_Error _collect_elements();
+    void _split_compositions(std::vector<CBU_Composition>& reactants_composition, std::vector<CBU_Composition>& products_composition) const;
+    void _build_main_matrix();
+    void _edited();
+public:
+    CBU_Error add_reactant(const std::string& compound) { return this->_add_compound(compound, false); }
+    CBU_Error add_product(const std::string& compound) { return this->_add_compound(compound, true); }
+    bool remove_reactant(size_t index) { return this->_remove_compound(index, false); }
+    bool remove_product(size_t index) { return this->_remove_compound(index, true); }
+    CBU_Error balance();
+    [[nodiscard]] CBU_Error get_error() const { return this->_balancer.get_error(); }
+    [[nodiscard]] const CBU_Stats& get_stats() const { return this->_balancer.get_stats(); }
+    [[nodiscard]] const std::pair<std::vector<std::string>, std::vector<std::string>>& get_reactants_and_products() const { return this->_balancer._reactants_and_products; }
+    [[nodiscard]] std::pair<std::vector<std::string>, std::vector<std::vector<int>>> get_main_matrix() const;
+    // Views of the balancing data, like those of CBU_Balancer (valid until the next edit or balance, nothing is copied)
+    [[nodiscard]] const std::vector<std::string>& get_elements() const { return this->_balancer._elements; }
+    [[nodiscard]] const CBU_Matrix& get_matrix() { this->_build_main_matrix(); return this->_balancer._main_matrix; } // empty for an equation kept as a sparse matrix (see get_sparse_matrix)
+    [[nodiscard]] const CBU_Sparse_matrix& get_sparse_matrix() { this->_build_main_matrix(); return this->_balancer._sparse_matrix; }
+    [[nodiscard]] const std::vector<std::vector<unsigned>>& get_coefficients() const { return this->_balancer._results_coefs; }
+    [[nodiscard]] std::string get_result() const { return this->_balancer.get_result(); }
+};
+
+// The result of CBU_Constexpr::balance, for an equation with at most Compounds compounds
+template <size_t Compounds>
+struct CBU_Static_result {
+    std::array<unsigned, Compounds> coefficients{}; // the coefficient of each compound (the reactants first, in the order of the equation) if error is CBU_Error::NONE
+    size_t compounds = 0;
+    size_t reactants = 0; // the products follow the reactants
+    size_t reactions = 0; // the number of independent balanced reactions (the nullity of the main matrix), an equation has a result only if it is 1
+    CBU_Error error = CBU_Error::NO_RESULT; // also CBU_Error::NO_RESULT if the equation has more compounds or elements than the capacity
+};
+
+// A balancer that runs in constant expressions, so an equation written in the source is balanced at compile time, e.g.,
+// static_assert(CBU_Constexpr::balance("Zn+HCl->ZnCl2+H2").coefficients[1] == 2);
+// It parses like CBU_Balancer, with the same errors, and solves like CBU_Solver::NULLSPACE, on std::array matrices of a fixed capacity (Compounds columns and Elements rows),
+// so nothing is allocated and it can run at run time as well. An underdetermined equation has no single result and is not balanced:
+// its error is CBU_Error::FAILED_TO_BALANCE, and reactions tells it apart from an equation that cannot be balanced at all.
+// With C++20, CBU_balanced takes the equation as a template argument, sizes the matrix from it, and turns every error into a compile error.
+class CBU_Constexpr {
+private:
+    template <size_t Compounds, size_t Elements>
+    struct Static_matrix {
+        std::array<std::array<long long, Compounds>, Elements> entries{}; // the main matrix, the products negated
+        std::array<std::string_view, Elements> symbols{}; // the element of each row (a view into the equation, which may have spaces in it)
+        std::array<unsigned char, Elements> sides{}; // the sides each element is on (1 for the reactants, 2 for the products)
+        size_t rows = 0;
+    };
+
+    static constexpr bool _is_space(char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r'; }
+    static constexpr bool _is_upper(char c) { return c >= 'A' && c <= 'Z'; }
+    static constexpr bool _is_lower(char c) { return c >= 'a' && c <= 'z'; }
+    static constexpr bool _is_digit(char c) { return c >= '0' && c <= '9'; }
+    static constexpr bool _is_blank(std::string_view str);
+    static constexpr bool _same_symbol(std::string_view a, std::string_view b);
+    template <size_t Compounds, size_t Elements>
+    static constexpr CBU_Error _parse_compound(std::string_view compound, size_t column, bool product, Static_matrix<Compounds, Elements>& matrix);
+    template <typename Int, size_t Compounds, size_t Elements>
+    static constexpr bool _solve(const Static_matrix<Compounds, Elements>& matrix, CBU_Static_result<Compounds>& result);
+public:
+    template <size_t Compounds = CONSTEXPR_MAX_COMPOUNDS, size_t Elements = CONSTEXPR_MAX_ELEMENTS>
+    static constexpr CBU_Static_result<Compounds> balance(std::string_view equation);
+    static constexpr size_t compounds_bound(std::string_view equation); // the most compounds an equation can have (one more than its '+')
+    static constexpr size_t elements_bound(std::string_view equation); // the most elements an equation can have (its uppercase letters)
+};
+
+// This method checks if a character (const char &c) is valid in a chemical compound
+inline bool CBU_Balancer::_is_valid_char(const char& c) {
+    const auto uc = static_cast<unsigned char>(c);
+    return std::isupper(uc) || std::islower(uc) || std::isdigit(uc) || (c == '(') || (c == ')') || (c == '.');
+}
+
+// This method parses a compound string in one pass (left to right) and appends each element occurrence with its count to entities, e.g., "Ca(OH)2" gives ("Ca", 1), ("O", 2), ("H", 2).
+// An element may occur several times (the caller sums them up), and the element names are views into compound_str, so nothing is allocated once entities has grown.
+// A parenthesised group multiplies the entities appended since its '(' (the beginnings of the open groups are kept on an explicit stack).
+// A hydrate part, e.g., "5H2O" in "CuSO4.5H2O", multiplies the entities appended since its '.' by its leading number.
+inline CBU_Error CBU_Balancer::_parse_compound(std::string_view compound_str, std::vector<std::pair<std::string_view, unsigned>>& entities) {
+    std::array<size_t, MAX_PARENTHESES_DEPTH> group_begins{};
+    size_t depth = 0;
+    size_t part_begin = entities.size();
+    unsigned part_multiplier = 1;
+    size_t i = 0;
+    const size_t n = compound_str.size();
+
+    auto is_digit = [&compound_str](size_t index) { return std::isdigit(static_cast<unsigned char>(compound_str[index])) != 0; };
+    auto read_number = [&](unsigned& value) { // the number at i (1 if there is none), false if it exceeds INT32_MAX (a matrix entry)
+        value = 1;
+        if (i == n || !is_digit(i)) { return true; }
+        value = 0;
+        for (; i < n && is_digit(i); i++) {
+            unsigned digit = compound_str[i] - '0';
+            if (value > (INT32_MAX - digit) / 10) { return false; }
+            value = value * 10 + digit;
+        }
+        return true;
+    };
+    auto multiply = [&entities](size_t begin, unsigned multiplier) { // false if a count exceeds INT32_MAX
+        for (size_t j = begin; j < entities.size(); j++) {
+            if (!CBU_Balancer::_checked_mul(entities[j].second, multiplier, entities[j].second) || entities[j].second > INT32_MAX) { return false; }
+        }
+        return true;
+    };
+
+    if (n == 0) { return CBU_Error::INVALID_COMPOUND; }
+    while (i < n) {
+        const char c = compound_str[i];
+        if (!_is_valid_char(c)) { return CBU_Error::INVALID_CHAR; }
+
+        if (std::isupper(static_cast<unsigned char>(c))) { // an element, e.g., "Ca" or "O2"
+            const size_t begin = i++;
+            while (i < n && std::islower(static_cast<unsigned char>(compound_str[i]))) { i++; }
+            std::string_view element = compound_str.substr(begin, i - begin);
+            unsigned count;
+            if (!read_number(count)) { return CBU_Error::COEFFICIENT_OVERFLOW; }
+            entities.emplace_back(element, count);
+        } else if (c == '(') {
+            if (depth == MAX_PARENTHESES_DEPTH) { return CBU_Error::PARENTHESES_TOO_DEEP; }
+            group_begins[depth++] = entities.size();
+            i++;
+        } else if (c == ')') {
+            if (depth == 0) { return CBU_Error::UNMATCHED_PARENTHESES; }
+            const size_t begin = group_begins[--depth];
+            if (begin == entities.size()) { return CBU_Error::INVALID_COMPOUND; } // "()"
+            i++;
+            unsigned multiplier;
+            if (!read_number(multiplier) || !multiply(begin, multiplier)) { return CBU_Error::COEFFICIENT_OVERFLOW; }
+        } else if (c == '.') { // a hydrate part begins
+            if (depth != 0) { return CBU_Error::UNMATCHED_PARENTHESES; }
+            if (part_begin == entities.size()) { return CBU_Error::INVALID_COMPOUND; } // empty part, e.g., ".5H2O"
+            if (!multiply(part_begin, part_multiplier)) { return CBU_Error::COEFFICIENT_OVERFLOW; }
+            i++;
+            part_begin = entities.size();
+            if (!read_number(part_multiplier)) { return CBU_Error::COEFFICIENT_OVERFLOW; }
+            if (i == n) { return CBU_Error::INVALID_COMPOUND; } // e.g., "CuSO4.5"
+        } else { // a lowercase letter or a digit that does not follow an element or a group, e.g., "c26"
+            return CBU_Error::INVALID_CHAR_OR_CHAR_POSITION;
+        }
+    }
+
+    if (depth != 0) { return CBU_Error::UNMATCHED_PARENTHESES; }
+    return multiply(part_begin, part_multiplier) ? CBU_Error::NONE : CBU_Error::COEFFICIENT_OVERFLOW;
+}
+
+// This method takes a compound string as input and outputs its composition, i.e., the count of each element (by id) in the compound.
+// A valid compound is looked up in (or added to) the cache if there is one.
+inline CBU_Error CBU_Balancer::_get_compound_composition(const std::string& compound_str, CBU_Composition& composition) const {
+    composition.clear(); // elements and their counts in [current] compound
+    CBU_Composition_cache* cache = this->_options.cache.get();
+    if (cache != nullptr && cache->find(compound_str, composition)) {
+        this->_warn_special_elements(composition);
+        return CBU_Error::NONE;
+    }
+
+    thread_local std::vector<std::pair<std::string_view, unsigned>> entities; // reused by every compound parsed on this thread
+    entities.clear();
+    CBU_Error error = CBU_Balancer::_parse_compound(compound_str, entities);
+    if (error != CBU_Error::NONE) { return error; }
+
+    composition.reserve(entities.size());
+    for (const auto& entity : entities) {
+        const unsigned id = CBU_Elements::id(entity.first);
+        if (id == 0) {
+            composition.clear();
+            return CBU_Error::TOO_MANY_SPECIAL_ELEMENTS;
+        }
+        composition.emplace_back(id, entity.second);
+    }
+
+    std::sort(composition.begin(), composition.end());
+    size_t merged = 0; // sums up the counts of an element that occurs several times (each count is at most INT32_MAX, so the sum fits in unsigned)
+    for (size_t i = 0; i < composition.size(); i++) {
+        if (merged > 0 && composition[merged - 1].first == composition[i].first) {
+            composition[merged - 1].second += composition[i].second;
+            if (composition[merged - 1].second > INT32_MAX) {
+                composition.clear();
+                return CBU_Error::COEFFICIENT_OVERFLOW;
+            }
+        }
+        else { composition[merged++] = composition[i]; }
+    }
+    composition.resize(merged);
+
+    this->_warn_special_elements(composition);
+    if (cache != nullptr) { cache->insert(compound_str, composition); }
+    return CBU_Error::NONE;
+}
+
+// This method reports a warning for each element of a composition that is not in the periodic table.
+inline void CBU_Balancer::_warn_special_elements(const CBU_Composition& composition) const {
+    if (!this->_options.sink) { return; }
+    for (const auto& element : composition) {
+        if (!CBU_Elements::is_known(element.first)) {
+            this->_report(CBU_Severity::WARNING, "WARNING: special element \"" + std::string(CBU_Elements::symbol(element.first)) + "\", the equation may not exist.");
+        }
+    }
+}
+
+// This method takes a compound composition vector as input and outputs the elements list (ids, sorted by id) in these compounds
+inline void CBU_Balancer::get_elements_from_compounds_composition(const std::vector<CBU_Composition>& compounds_composition, std::vector<unsigned>& elements) {
+    elements.clear();
+    for (const auto& compound_composition : compounds_composition) {
+        for (const auto& element : compound_composition) {
+            elements.push_back(element.first);
+        }
+    }
+    std::sort(elements.begin(), elements.end());
+    elements.erase(std::unique(elements.begin(), elements.end()), elements.end());
+}
+
+// This method takes compounds composition (the reactants and the products) and elements list as input and outputs the main matrix, where [the row is each element] and [the column is each compound].
+// The reactants come first with their counts, and the products follow with their counts negated. Every element of the compositions must be in elements.
+// The matrix is built in the buffer of the previous one.
+inline void CBU_Balancer::_build_matrix(const std::vector<CBU_Composition>& reactants_composition, const std::vector<CBU_Composition>& products_composition, const std::vector<unsigned>& elements,
+                                        CBU_Matrix& matrix) {
+    matrix.assign(elements.size(), reactants_composition.size() + products_composition.size());
+    auto fill_column = [&matrix, &elements](const CBU_Composition& composition, size_t column, int32_t sign) {
+        for (const auto& element : composition) { // an equation has a handful of elements, so a linear search finds the row
+            size_t row = 0;
+            while (elements[row] != element.first) { row++; }
+            matrix[row][column] = sign * static_cast<int32_t>(element.second);
+        }
+    };
+    for (size_t j = 0; j < reactants_composition.size(); j++) { fill_column(reactants_composition[j], j, 1); }
+    for (size_t j = 0; j < products_composition.size(); j++) { fill_column(products_composition[j], reactants_composition.size() + j, -1); }
+}
+
+// This method builds the main matrix straight into a CBU_Sparse_matrix (same entries as _build_matrix), so its size is the number of element counts in the compositions.
+inline void CBU_Balancer::_build_sparse_matrix(const std::vector<CBU_Composition>& reactants_composition, const std::vector<CBU_Composition>& products_composition, const std::vector<unsigned>& elements,
+                                               CBU_Sparse_matrix& matrix) {
+    thread_local std::vector<uint32_t> row_of; // the row of each element, by element id (at most KNOWN_COUNT + SPECIAL_ELEMENTS_MAX + 1 entries), only the entries of elements are read
+    thread_local std::vector<std::pair<uint32_t, int32_t>> column; // the entries of one column, sorted by row
+    const unsigned max_id = elements.empty() ? 0 : *std::max_element(elements.begin(), elements.end());
+    if (row_of.size() <= max_id) { row_of.resize(max_id + 1); }
+    for (size_t row = 0; row < elements.size(); row++) { row_of[elements[row]] = static_cast<uint32_t>(row); }
+
+    matrix.begin(elements.size());
+    auto add_column = [&matrix](const CBU_Composition& composition, int32_t sign) {
+        column.clear();
+        for (const auto& element : composition) { column.emplace_back(row_of[element.first], sign * static_cast<int32_t>(element.second)); }
+        std::sort(column.begin(), column.end());
+        for (const auto& entry : column) { matrix.append(entry.first, entry.second); }
+        matrix.end_column();
+    };
+    for (const auto& composition : reactants_composition) { add_column(composition, 1); }
+    for (const auto& composition : products_composition) { add_column(composition, -1); }
+}
+
+// This method builds the main matrix of the equation: a CBU_Sparse_matrix if CBU_Solver::NULLSPACE solves an equation with at least SPARSE_MIN_COMPOUNDS compounds, or else a dense CBU_Matrix
+// (the enumerating solvers and the presolve read every entry anyway). get_main_matrix and CBU_Result give the dense view in both cases.
+inline void CBU_Balancer::_build_main_matrix(const std::vector<CBU_Composition>& reactants_composition, const std::vector<CBU_Composition>& products_composition, const std::vector<unsigned>& elements) {
+    if (this->_options.solver == CBU_Solver::NULLSPACE && reactants_composition.size() + products_composition.size() >= SPARSE_MIN_COMPOUNDS) {
+        CBU_Balancer::_build_sparse_matrix(reactants_composition, products_composition, elements, this->_sparse_matrix);
+        this->_main_matrix.clear();
+    } else {
+        CBU_Balancer::_build_matrix(reactants_composition, products_composition, elements, this->_main_matrix);
+        this->_sparse_matrix.clear();
+    }
+}
+
+// This method builds the block-structured main matrix of a coupled reaction set: reaction r takes the rows of its elements and the columns of its compounds (block r of the diagonal, as _build_matrix),
+// and each further occurrence of an intermediate species (a product of one reaction and a reactant of another) adds a row that makes its coefficient equal to the one of its first occurrence.
+// As in _build_main_matrix, CBU_Solver::NULLSPACE keeps a set with at least SPARSE_MIN_COMPOUNDS compounds as a sparse matrix.
+inline void CBU_Balancer::_build_coupled_matrix(const std::vector<CBU_Composition>& compositions, const std::vector<Set_reaction>& reactions) {
+    constexpr size_t none = SIZE_MAX, several = SIZE_MAX - 1;
+    std::vector<std::array<size_t, 2>> side_reactions(compositions.size(), {none, none}); // the reaction where a species is a reactant [0] and a product [1] (several if more than one)
+    size_t columns = 0;
+    for (size_t r = 0; r < reactions.size(); r++) {
+        for (size_t k = 0; k < reactions[r].species.size(); k++) {
+            size_t& seen = side_reactions[reactions[r].species[k]][k < reactions[r].reactants_count ? 0 : 1];
+            seen = (seen == none || seen == r) ? r : several;
+        }
+        columns += reactions[r].species.size();
+    }
+    auto is_intermediate = [&side_reactions](size_t species) {
+        const auto& sides = side_reactions[species];
+        return sides[0] != none && sides[1] != none && (sides[0] != sides[1] || sides[0] == several);
+    };
+
+    // The entries of each column, sorted by row: the block of its reaction, then the coupling rows
+    std::vector<std::vector<std::pair<uint32_t, int32_t>>> entries(columns);
+    std::vector<size_t> first_column(compositions.size(), none);
+    std::vector<std::pair<size_t, size_t>> couplings; // the first occurrence and a further one of an intermediate species
+    size_t rows = 0, column = 0;
+    for (const auto& reaction : reactions) {
+        for (size_t k = 0; k < reaction.species.size(); k++, column++) {
+            const int32_t sign = (k < reaction.reactants_count) ? 1 : -1;
+            for (const auto& element : compositions[reaction.species[k]]) {
+                const size_t row = std::find(reaction.elements.begin(), reaction.elements.end(), element.first) - reaction.elements.begin();
+                entries[column].emplace_back(static_cast<uint32_t>(rows + row), sign * static_cast<int32_t>(element.second));
+            }
+            std::sort(entries[column].begin(), entries[column].end());
+            if (!is_intermediate(reaction.species[k])) { continue; }
+            if (first_column[reaction.species[k]] == none) { first_column[reaction.species[k]] = column; }
+            else { couplings.emplace_back(first_column[reaction.species[k]], column); }
+        }
+        rows += reaction.elements.size();
+    }
+    for (const auto& coupling : couplings) {
+        entries[coupling.first].emplace_back(static_cast<uint32_t>(rows), 1);
+        entries[coupling.second].emplace_back(static_cast<uint32_t>(rows), -1);
+        rows++;
+    }
+
+    if (this->_options.solver == CBU_Solver::NULLSPACE && columns >= SPARSE_MIN_COMPOUNDS) {
+        this->_sparse_matrix.begin(rows);
+        for (const auto& column_entries : entries) {
+            for (const auto& entry : column_entries) { this->_sparse_matrix.append(entry.first, entry.second); }
+            this->_sparse_matrix.end_column();
+        }
+        this->_main_matrix.clear();
+    } else {
+        this->_main_matrix = CBU_Matrix(rows, columns);
+        for (size_t j = 0; j < columns; j++) {
+            for (const auto& entry : entries[j]) { this->_main_matrix[entry.first][j] = entry.second; }
+        }
+        this->_sparse_matrix.clear();
+    }
+}
+
+// This method lists the rows of a matrix that are linearly independent of the rows before them (ascending).
+// The rows are eliminated one by one against the kept ones in 64-bit integers. If a value overflows, every row is kept (keeping a dependent row never changes the results).
+inline void CBU_Balancer::_independent_rows(const CBU_Matrix& matrix, std::vector<size_t>& rows) {
+    const size_t columns = matrix.columns();
+    thread_local std::vector<long long> reduced; // the kept rows, each reduced by the previous ones (its pivot is its first nonzero entry)
+    thread_local std::vector<size_t> pivots;
+    reduced.resize((matrix.rows() + 1) * columns);
+    pivots.clear();
+    rows.clear();
+    for (size_t row = 0; row < matrix.rows(); row++) {
+        long long* current = &reduced[rows.size() * columns];
+        std::copy(matrix[row], matrix[row] + columns, current);
+        for (size_t k = 0; k < rows.size(); k++) {
+            const long long* kept = &reduced[k * columns];
+            const long long factor = current[pivots[k]];
+            if (factor == 0) { continue; }
+            const long long pivot = kept[pivots[k]];
+            bool large = false;
+            for (size_t j = 0; j < columns; j++) { // current = current * pivot - kept * factor
+                long long a, b;
+                if (!CBU_Balancer::_checked_mul(current[j], pivot, a) || !CBU_Balancer::_checked_mul(kept[j], factor, b) || !CBU_Balancer::_checked_sub(a, b, current[j])) {
+                    rows.resize(matrix.rows());
+                    std::iota(rows.begin(), rows.end(), 0);
+                    return;
+                }
+                large |= (current[j] > INT32_MAX || current[j] < -INT32_MAX);
+            }
+            if (large) { // divides the row by its content before the entries overflow
+                long long content = 0;
+                for (size_t j = 0; j < columns; j++) { content = CBU_Balancer::_gcd(content, current[j]); }
+                for (size_t j = 0; j < columns; j++) { current[j] /= content; }
+            }
+        }
+        const long long* pivot = std::find_if(current, current + columns, [](long long entry) { return entry != 0; });
+        if (pivot == current + columns) { continue; } // a combination of the kept rows
+        pivots.push_back(pivot - current);
+        rows.push_back(row);
+    }
+}
+
+// This method presolves the main matrix for the enumerating solvers (CBU_Solver::NULLSPACE and CBU_Solver::MODULAR_NULLSPACE do not need it: their elimination skips the dependent rows, and its cost does not explode with the columns;
+// CBU_Solver::HILBERT_BASIS neither: its residuals ignore the dependent rows, and its basis is not the product of the bases of the blocks).
+// The element rows that are combinations of the previous rows are dropped, the identical compound columns are merged into one column (whose coefficient is their sum), and the matrix is split into blocks
+// that share no element, i.e., the connected components of the element-compound graph. Each block is then solved on its own, which turns max_coef^(a+b) leaves into max_coef^a + max_coef^b.
+// Nothing is stored if the matrix is one block without merged columns: it is solved as it is, since the dependent rows cost the recursion kernel nothing (one lane each) and help the pruned recursion prune.
+// The blocks and the scratch vectors keep their buffers (they are never shrunk), so a presolve only allocates for an equation with more rows, columns or blocks than those presolved before.
+inline void CBU_Balancer::_presolve() {
+    CBU_Balancer::_resize_keeping(this->_presolve_blocks, 0, this->_workspace.spare_blocks);
+    if (this->_options.solver == CBU_Solver::NULLSPACE || this->_options.solver == CBU_Solver::MODULAR_NULLSPACE || this->_options.solver == CBU_Solver::HILBERT_BASIS) { return; }
+    const CBU_Matrix& matrix = this->_main_matrix;
+    const size_t compounds_count = matrix.columns();
+    thread_local std::vector<size_t> rows, representative, parent, block_of, column_of; // reused by every equation presolved on this thread
+    thread_local std::vector<std::vector<size_t>> block_rows; // the first blocks are in use
+    CBU_Balancer::_independent_rows(matrix, rows);
+
+    // With multiple results, a column equal to a previous one (on the independent rows, hence on every row) is merged into it, unless the sum of their coefficients may overflow.
+    // With a single result, the first result is found early anyway, and a merged column would need every result of its block (see _solve_presolve_blocks).
+    representative.resize(compounds_count);
+    std::iota(representative.begin(), representative.end(), 0);
+    bool merged = false;
+    if (this->_options.multiple_results && (compounds_count == 0 || this->_options.max_coef <= UINT_MAX / compounds_count)) {
+        for (size_t j = 0; j < compounds_count; j++) {
+            for (size_t i = 0; i < j; i++) {
+                if (representative[i] != i) { continue; }
+                bool identical = true;
+                for (size_t row : rows) { identical &= (matrix[row][i] == matrix[row][j]); }
+                if (identical) { representative[j] = i; merged = true; break; }
+            }
+        }
+    }
+
+    // The columns sharing an element are in the same block (union-find)
+    parent.resize(compounds_count);
+    std::iota(parent.begin(), parent.end(), 0);
+    auto find = [](size_t j) {
+        while (parent[j] != j) { j = parent[j] = parent[parent[j]]; }
+        return j;
+    };
+    for (size_t row : rows) {
+        size_t first = SIZE_MAX;
+        for (size_t j = 0; j < compounds_count; j++) {
+            if (matrix[row][j] == 0) { continue; }
+            if (first == SIZE_MAX) { first = j; }
+            else { parent[find(j)] = find(first); }
+        }
+    }
+    size_t blocks_count = 0;
+    for (size_t j = 0; j < compounds_count; j++) { blocks_count += (find(j) == j); }
+    if (!merged && blocks_count <= 1) { return; }
+
+    // The blocks are ordered by their first compound, and so are the columns of a block
+    block_of.assign(compounds_count, SIZE_MAX); // by root
+    column_of.assign(compounds_count, SIZE_MAX); // by representative
+    if (block_rows.size() < blocks_count) { block_rows.resize(blocks_count); }
+    CBU_Balancer::_resize_keeping(this->_presolve_blocks, blocks_count, this->_workspace.spare_blocks);
+    for (size_t b = 0; b < blocks_count; b++) {
+        block_rows[b].clear();
+        CBU_Balancer::_resize_keeping(this->_presolve_blocks[b].compounds, 0, this->_workspace.spare_columns);
+    }
+    size_t blocks_used = 0;
+    for (size_t j = 0; j < compounds_count; j++) {
+        const size_t root = find(j);
+        if (block_of[root] == SIZE_MAX) { block_of[root] = blocks_used++; }
+        Presolve_block& block = this->_presolve_blocks[block_of[root]];
+        if (representative[j] == j) {
+            column_of[j] = block.compounds.size();
+            CBU_Balancer::_resize_keeping(block.compounds, block.compounds.size() + 1, this->_workspace.spare_columns);
+            block.compounds.back().assign(1, j);
+        } else {
+            block.compounds[column_of[representative[j]]].push_back(j);
+        }
+    }
+    for (size_t row : rows) {
+        for (size_t j = 0; j < compounds_count; j++) {
+            if (matrix[row][j] != 0) { block_rows[block_of[find(j)]].push_back(row); break; }
+        }
+    }
+    for (size_t b = 0; b < this->_presolve_blocks.size(); b++) {
+        Presolve_block& block = this->_presolve_blocks[b];
+        block.matrix.assign(block_rows[b].size(), block.compounds.size());
+        for (size_t i = 0; i < block_rows[b].size(); i++) {
+            for (size_t k = 0; k < block.compounds.size(); k++) { block.matrix[i][k] = matrix[block_rows[b][i]][block.compounds[k][0]]; }
+        }
+    }
+}
+
+// This method builds the columns searched by the recursion kernel from a matrix (the main matrix or a presolved block).
+// It returns false if a residual may not fit in int32 (the sum of the absolute entries of an element times their max_coef exceeds INT32_MAX).
+inline bool CBU_Balancer::_build_kernel_columns(const CBU_Matrix& matrix, Kernel_columns& kernel) const {
+    const size_t elements_count = matrix.rows();
+    const size_t compounds_count = matrix.columns();
+    kernel.max_coefs.resize(compounds_count);
+    for (size_t j = 0; j < compounds_count; j++) { kernel.max_coefs[j] = this->_column_max_coef(j); }
+    for (size_t row = 0; row < elements_count; row++) {
+        long long weight = 0;
+        for (size_t j = 0; j < compounds_count; j++) {
+            long long term;
+            if (!CBU_Balancer::_checked_mul(std::abs(static_cast<long long>(matrix[row][j])), static_cast<long long>(kernel.max_coefs[j]), term)) { return false; }
+            weight += term;
+            if (weight > INT32_MAX) { return false; }
+        }
+    }
+
+    kernel.stride = (elements_count + KERNEL_LANES - 1) / KERNEL_LANES * KERNEL_LANES;
+    kernel.columns.assign(compounds_count * kernel.stride, 0);
+    kernel.rewinds.assign(compounds_count * kernel.stride, 0);
+    for (size_t j = 0; j < compounds_count; j++) {
+        for (size_t row = 0; row < elements_count; row++) {
+            kernel.columns[j * kernel.stride + row] = matrix[row][j];
+            kernel.rewinds[j * kernel.stride + row] = static_cast<int32_t>((kernel.max_coefs[j] - 1LL) * matrix[row][j]);
+        }
+    }
+    return true;
+}
+
+// This method is used to solve the matrix using recursion strategy, i.e., it tries every coefficient from 1 to max_coef for each compound (the last compound changes fastest).
+// The search runs on the widest vector kernel the CPU supports (AVX2, SSE2, or scalar). If the residuals may overflow int32, the pruned recursion (which finds the same results) is used instead.
+inline void CBU_Balancer::_solving_matrix_using_recursion(const CBU_Matrix& matrix, bool log_status) {
+    for (size_t j = 0; j < matrix.columns(); j++) {
+        if (this->_column_max_coef(j) == 0) { return; }
+    }
+    Kernel_columns& kernel = this->_workspace.kernel;
+    if (!this->_build_kernel_columns(matrix, kernel)) {
+        this->_solving_matrix_using_pruned_recursion(matrix, log_status);
+        return;
+    }
+
+    Search_counters counters;
+#ifdef CBU_X86_SIMD
+    static const int vector_width = [] { __builtin_cpu_init(); return __builtin_cpu_supports("avx2") ? 8 : (__builtin_cpu_supports("sse2") ? 4 : 1); }();
+    if (vector_width == 8) { this->_recursion_kernel_avx2(kernel, log_status, counters); }
+    else if (vector_width == 4) { this->_recursion_kernel_sse2(kernel, log_status, counters); }
+    else { this->_recursion_kernel<Scalar_kernel>(kernel, log_status, counters); }
+#else
+    this->_recursion_kernel<Scalar_kernel>(kernel, log_status, counters);
+#endif
+    this->_add_search_counters(counters);
+}
+
+// This method is the search of the recursion strategy, written as an odometer over the coefficients (in the same order as the floors of a recursion).
+// residual is the sum of each column times its coefficient, so moving to the next coefficients adds one column (and rewinds the columns that wrap back to 1), and a leaf is balanced if every lane of residual is zero.
+template <typename Kernel>
+inline void CBU_Balancer::_recursion_kernel(const Kernel_columns& kernel, bool log_status, Search_counters& counters) {
+    const size_t compounds_count = kernel.max_coefs.size();
+    const size_t stride = kernel.stride;
+    std::vector<unsigned>& coefficients_temporary = this->_workspace.coefficients;
+    std::vector<int32_t>& residual = this->_workspace.lanes;
+    coefficients_temporary.assign(compounds_count, 1);
+    residual.assign(stride, 0);
+    for (size_t j = 0; j < compounds_count; j++) { Kernel::add(residual.data(), &kernel.columns[j * stride], stride); }
+    CBU_STATS(counters.nodes += compounds_count;)
+
+    while (true) {
+        CBU_STATS(counters.leaves++;)
+        if (Kernel::is_zero(residual.data(), stride) && CBU_Balancer::_is_primitive(coefficients_temporary)) { // a multiple of a result is not a new result
+            if (this->_options.multiple_results && log_status) {
+                this->_report(CBU_Severity::LOG, "A possible result found. ");
+            }
+            this->_push_result(this->_results_coefs, coefficients_temporary);
+            if (!this->_options.multiple_results) { return; }
+        }
+
+        size_t floor = compounds_count; // the deepest floor that can still take a larger coefficient, plus 1
+        while (floor > 0 && coefficients_temporary[floor - 1] == kernel.max_coefs[floor - 1]) { floor--; }
+        if (floor == 0) { return; } // every coefficient has been tried
+        for (size_t j = floor; j < compounds_count; j++) {
+            Kernel::sub(residual.data(), &kernel.rewinds[j * stride], stride);
+            coefficients_temporary[j] = 1;
+        }
+        coefficients_temporary[floor - 1]++;
+        Kernel::add(residual.data(), &kernel.columns[(floor - 1) * stride], stride);
+        CBU_STATS(counters.nodes += compounds_count - floor + 1;)
+    }
+}
+
+// This method builds the bounds used by the pruned recursion from a matrix (the main matrix or a presolved block).
+// With constrained_first (multiple results), the most constraining compounds (those containing the most elements) are fixed first.
+// Otherwise, the compounds keep their given order so the results are found in the order of the plain recursion (e.g., the first result is the same one).
+// The bounds are rebuilt in the buffers of the previous ones.
+inline void CBU_Balancer::_build_pruning_bounds(const CBU_Matrix& matrix, bool constrained_first, Pruning_bounds& bounds) const {
+    const size_t elements_count = matrix.rows();
+    const size_t compounds_count = matrix.columns();
+
+    bounds.order.resize(compounds_count);
+    std::iota(bounds.order.begin(), bounds.order.end(), 0);
+    if (constrained_first) {
+        auto constraint = [&matrix](size_t column) {
+            std::pair<size_t, long long> count_and_weight = {0, 0};
+            for (size_t row = 0; row < matrix.rows(); row++) {
+                const int32_t* element = matrix[row];
+                if (element[column] != 0) { count_and_weight.first++; count_and_weight.second += std::abs(element[column]); }
+            }
+            return count_and_weight;
+        };
+        std::sort(bounds.order.begin(), bounds.order.end(), [&constraint](size_t a, size_t b) { // stable (ties keep the given order), without the buffer of std::stable_sort
+            const auto constraint_a = constraint(a), constraint_b = constraint(b);
+            return constraint_a > constraint_b || (constraint_a == constraint_b && a < b);
+        });
+    }
+
+    if (bounds.min_remaining.size() < compounds_count + 1) { // only grows, so the rows of a larger equation keep their buffers (the floors beyond compounds_count are not read)
+        bounds.min_remaining.resize(compounds_count + 1);
+        bounds.max_remaining.resize(compounds_count + 1);
+    }
+    for (size_t floor = 0; floor <= compounds_count; floor++) {
+        bounds.min_remaining[floor].assign(elements_count, 0);
+        bounds.max_remaining[floor].assign(elements_count, 0);
+    }
+    for (size_t floor = compounds_count; floor-- > 0;) {
+        for (size_t i = 0; i < elements_count; i++) {
+            long long entry = matrix[i][bounds.order[floor]];
+            long long max_coef = this->_column_max_coef(bounds.order[floor]);
+            long long low = (entry > 0) ? entry : entry * max_coef; // a coefficient is in [1, max_coef]
+            long long high = (entry > 0) ? entry * max_coef : entry;
+            bounds.min_remaining[floor][i] = bounds.min_remaining[floor + 1][i] + low;
+            bounds.max_remaining[floor][i] = bounds.max_remaining[floor + 1][i] + high;
+        }
+    }
+}
+
+// This method checks if the compound fixed at floor can take coefficient, given the residual of the previous floors.
+// exhausted is set when every larger coefficient is infeasible as well.
+inline bool CBU_Balancer::_pruning_check(const CBU_Matrix& matrix, const Pruning_bounds& bounds, const std::vector<long long>& residual, size_t floor, unsigned coefficient, bool& exhausted) {
+    const size_t column = bounds.order[floor];
+    const std::vector<long long>& min_remaining = bounds.min_remaining[floor + 1];
+    const std::vector<long long>& max_remaining = bounds.max_remaining[floor + 1];
+    bool feasible = true;
+    exhausted = false;
+    for (size_t e = 0; e < residual.size(); e++) {
+        long long entry = matrix[e][column];
+        long long current = residual[e] + entry * coefficient;
+        if (current + min_remaining[e] > 0) { feasible = false; exhausted |= (entry > 0); }
+        else if (current + max_remaining[e] < 0) { feasible = false; exhausted |= (entry < 0); }
+    }
+    return feasible;
+}
+
+// This method solves the main matrix with the same enumeration as _solving_matrix_using_recursion, but keeps a running residual of each element and cuts every subtree where some residual can no longer reach zero.
+// With multiple results, the results are sorted back into the order of the plain recursion.
+inline void CBU_Balancer::_solving_matrix_using_pruned_recursion(const CBU_Matrix& matrix, bool log_status) {
+    Pruning_bounds& bounds = this->_workspace.bounds;
+    this->_build_pruning_bounds(matrix, this->_options.multiple_results, bounds);
+    std::vector<unsigned>& coefficients_temporary = this->_workspace.coefficients;
+    std::vector<long long>& residual = this->_workspace.residual;
+    coefficients_temporary.assign(matrix.columns(), 0);
+    residual.assign(matrix.rows(), 0);
+    Search_counters counters;
+    CBU_Balancer::_pruned_recursion(matrix, bounds, coefficients_temporary, residual, 0, this->_results_coefs, nullptr, 0, counters);
+    this->_add_search_counters(counters);
+
+    if (this->_options.multiple_results) {
+        std::sort(this->_results_coefs.begin(), this->_results_coefs.end());
+    }
+    if (this->_options.multiple_results && log_status) {
+        for (size_t i = 0; i < this->_results_coefs.size(); i++) { this->_report(CBU_Severity::LOG, "A possible result found. "); }
+    }
+}
+
+// This method is one floor of the pruned recursion. residual is the sum of the compounds fixed on the previous floors (per element).
+// The results are stored in results. In a parallel search, found_task is the lowest task index that has found a result, and the search gives up once it is lower than task_index (single result only).
+inline bool CBU_Balancer::_pruned_recursion(const CBU_Matrix& matrix, const Pruning_bounds& bounds, std::vector<unsigned>& coefficients_temporary, std::vector<long long>& residual, size_t floor,
+                                     std::vector<std::vector<unsigned>>& results, const std::atomic<size_t>* found_task, size_t task_index, Search_counters& counters) {
+    if (found_task != nullptr && found_task->load(std::memory_order_relaxed) < task_index) { return false; } // cancelled
+
+    if (floor == bounds.order.size()) { // recursion end, every residual is zero here (guaranteed by the bounds)
+        CBU_STATS(counters.leaves++;)
+        if (!CBU_Balancer::_is_primitive(coefficients_temporary)) { return false; } // a multiple of a result is not a new result
+        if (this->_options.multiple_results || results.empty()) {
+            this->_push_result(results, coefficients_temporary);
+        }
+        return true;
+    }
+
+    const size_t column = bounds.order[floor];
+    bool found = false;
+
+    const unsigned max_coef = this->_column_max_coef(column);
+    for (unsigned i = 1; i <= max_coef; i++) {
+        bool exhausted;
+        if (!CBU_Balancer::_pruning_check(matrix, bounds, residual, floor, i, exhausted)) {
+            CBU_STATS(counters.prunes++;)
+            if (exhausted) { break; }
+            continue;
+        }
+
+        CBU_STATS(counters.nodes++;)
+        coefficients_temporary[column] = i;
+        for (size_t e = 0; e < residual.size(); e++) { residual[e] += matrix[e][column] * static_cast<long long>(i); }
+        bool balanced = CBU_Balancer::_pruned_recursion(matrix, bounds, coefficients_temporary, residual, floor + 1, results, found_task, task_index, counters);
+        for (size_t e = 0; e < residual.size(); e++) { residual[e] -= matrix[e][column] * static_cast<long long>(i); }
+
+        found |= balanced;
+        if (balanced && !this->_options.multiple_results) { return true; }
+    }
+
+    return found;
+}
+
+// This method adds the counters of a search to the stats
+inline void CBU_Balancer::_add_search_counters(const Search_counters& counters) {
+    CBU_STATS(this->_stats.nodes += counters.nodes; this->_stats.leaves += counters.leaves; this->_stats.prunes += counters.prunes;)
+    (void)counters;
+}
+
+// This method resizes items to count like resize, but moves the dropped items into spare_items and takes the new ones from there first,
+// so the buffers of strings and vectors outlive an equation with fewer of them and serve the next ones
+template <typename Item>
+void CBU_Balancer::_resize_keeping(std::vector<Item>& items, size_t count, std::vector<Item>& spare_items) {
+    for (; items.size() > count; items.pop_back()) { CBU_Balancer::_keep_spare(spare_items, items.back()); }
+    for (; items.size() < count && !spare_items.empty(); spare_items.pop_back()) { items.push_back(std::move(spare_items.back())); }
+    items.resize(count);
+}
+
+// This method moves a dropped item into spare_items, unless the pool already has WORKSPACE_MAX_SPARES of them (then the item is freed with its owner)
+template <typename Item>
+void CBU_Balancer::_keep_spare(std::vector<Item>& spare_items, Item& item) {
+    if (spare_items.size() < WORKSPACE_MAX_SPARES) { spare_items.push_back(std::move(item)); }
+}
+
+// This method appends a copy of coefficients to results. A result of the balancer itself (results is _results_coefs) is stored in a dropped result if one has the capacity for it, so it allocates nothing then;
+// the buffers of the tasks of the parallel recursion, filled on several threads, do not touch the workspace.
+inline void CBU_Balancer::_push_result(std::vector<std::vector<unsigned>>& results, const std::vector<unsigned>& coefficients) {
+    if (&results != &this->_results_coefs) {
+        results.push_back(coefficients);
+        return;
+    }
+    CBU_Balancer::_push_spare_result(results, coefficients, this->_workspace.spare_results);
+}
+
+// This method appends a copy of coefficients to results, stored in the spare result with the least capacity for it (a new vector only if there is none),
+// so a short result does not take the storage a longer one of a later equation needs
+inline void CBU_Balancer::_push_spare_result(std::vector<std::vector<unsigned>>& results, const std::vector<unsigned>& coefficients, std::vector<std::vector<unsigned>>& spare_results) {
+    size_t spare = SIZE_MAX;
+    for (size_t i = spare_results.size(); i-- > 0; ) {
+        const size_t capacity = spare_results[i].capacity();
+        if (capacity < coefficients.size() || (spare != SIZE_MAX && capacity >= spare_results[spare].capacity())) { continue; }
+        spare = i;
+        if (capacity == coefficients.size()) { break; }
+    }
+    if (spare == SIZE_MAX) {
+        results.push_back(coefficients);
+        return;
+    }
+    std::swap(spare_results[spare], spare_results.back());
+    results.push_back(std::move(spare_results.back()));
+    spare_results.pop_back();
+    results.back().assign(coefficients.begin(), coefficients.end());
+}
+
+// This method runs the pruned recursion on several threads.
+// The top floors are split into tasks (in the order the sequential recursion visits them), dealt to one queue per thread, and an idle thread steals tasks from the back of the other queues.
+// Each task has its own coefficients and result buffer. The buffers are merged in task order, so the results do not depend on the scheduling.
+// With a single result, a task that finds one cancels every later task, and the result of the earliest successful task is kept.
+inline void CBU_Balancer::_solving_matrix_using_parallel_recursion(const CBU_Matrix& matrix, bool log_status) {
+    Pruning_bounds& bounds = this->_workspace.bounds;
+    this->_build_pruning_bounds(matrix, this->_options.multiple_results, bounds);
+    const size_t compounds_count = bounds.order.size();
+    const unsigned thread_count = (this->_options.thread_count != 0) ? this->_options.thread_count : std::max(1u, std::thread::hardware_concurrency());
+
+    struct Search_task {
+        std::vector<unsigned> coefficients;
+        std::vector<long long> residual;
+        size_t floor;
+    };
+    std::vector<Search_task> tasks = {{std::vector<unsigned>(compounds_count, 0), std::vector<long long>(matrix.rows(), 0), 0}};
+    Search_counters split_counters;
+    while (!tasks.empty() && tasks.size() < thread_count * PARALLEL_TASKS_PER_THREAD && tasks[0].floor < compounds_count) { // every task is on the same floor
+        std::vector<Search_task> next_tasks;
+        for (const auto& task : tasks) {
+            const size_t column = bounds.order[task.floor];
+            const unsigned max_coef = this->_column_max_coef(column);
+            for (unsigned i = 1; i <= max_coef; i++) {
+                bool exhausted;
+                if (!CBU_Balancer::_pruning_check(matrix, bounds, task.residual, task.floor, i, exhausted)) {
+                    CBU_STATS(split_counters.prunes++;)
+                    if (exhausted) { break; }
+                    continue;
+                }
+                CBU_STATS(split_counters.nodes++;)
+                Search_task child = task;
+                child.coefficients[column] = i;
+                for (size_t e = 0; e < child.residual.size(); e++) { child.residual[e] += matrix[e][column] * static_cast<long long>(i); }
+                child.floor++;
+                next_tasks.push_back(std::move(child));
+            }
+        }
+        tasks = std::move(next_tasks);
+    }
+
+    std::vector<std::vector<std::vector<unsigned>>> task_results(tasks.size());
+    std::vector<Search_counters> task_counters(tasks.size());
+    std::atomic<size_t> found_task(SIZE_MAX);
+    std::vector<std::deque<size_t>> queues(thread_count);
+    std::vector<std::mutex> queue_locks(thread_count);
+    for (size_t t = 0; t < tasks.size(); t++) { queues[t % thread_count].push_back(t); }
+
+    auto worker = [&](unsigned id) {
+        while (true) {
+            size_t task_index = SIZE_MAX;
+            {
+                std::lock_guard<std::mutex> lock(queue_locks[id]);
+                if (!queues[id].empty()) { task_index = queues[id].front(); queues[id].pop_front(); }
+            }
+            for (unsigned k = 1; task_index == SIZE_MAX && k < thread_count; k++) { // steal
+                unsigned victim = (id + k) % thread_count;
+                std::lock_guard<std::mutex> lock(queue_locks[victim]);
+                if (!queues[victim].empty()) { task_index = queues[victim].back(); queues[victim].pop_back(); }
+            }
+            if (task_index == SIZE_MAX) { return; }
+
+            Search_task& task = tasks[task_index];
+            bool balanced = CBU_Balancer::_pruned_recursion(matrix, bounds, task.coefficients, task.residual, task.floor, task_results[task_index],
+                                                             this->_options.multiple_results ? nullptr : &found_task, task_index, task_counters[task_index]);
+            if (balanced && !this->_options.multiple_results) {
+                size_t current = found_task.load();
+                while (task_index < current && !found_task.compare_exchange_weak(current, task_index)) { }
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned id = 1; id < thread_count; id++) { threads.emplace_back(worker, id); }
+    worker(0);
+    for (auto& thread : threads) { thread.join(); }
+
+    this->_add_search_counters(split_counters);
+    for (const auto& counters : task_counters) { this->_add_search_counters(counters); }
+    for (auto& results : task_results) { // deterministic merge
+        for (auto& result : results) {
+            if (this->_options.multiple_results || this->_results_coefs.empty()) { this->_results_coefs.push_back(std::move(result)); }
+        }
+    }
+    if (this->_options.multiple_results) {
+        std::sort(this->_results_coefs.begin(), this->_results_coefs.end());
+    }
+    if (this->_options.multiple_results && log_status) {
+        for (size_t i = 0; i < this->_results_coefs.size(); i++) { this->_report(CBU_Severity::LOG, "A possible result found. "); }
+    }
+}
+
+// This method solves the main matrix by computing its integer nullspace directly instead of enumerating the coefficients.
+// The elimination runs in 64-bit integers first and is redone in 128-bit integers (if the compiler has them) when an intermediate value overflows.
+// A large equation is eliminated on its sparse matrix (see _build_main_matrix), with the same results.
+// A uniquely balanced equation is solved regardless of max_coef.
+inline CBU_Error CBU_Balancer::_solving_matrix_using_nullspace() {
+    const bool sparse = !this->_sparse_matrix.empty();
+    thread_local std::vector<std::vector<int64_t>> basis; // reused by every equation solved on this thread
+    if (sparse ? CBU_Balancer::_sparse_integer_nullspace(this->_sparse_matrix, basis) : CBU_Balancer::_integer_nullspace(this->_main_matrix, basis)) {
+        return this->_collect_nullspace_results(basis);
+    }
+#ifdef __SIZEOF_INT128__
+    if (this->_options.multiple_results && this->_options.log_status) { this->_report(CBU_Severity::LOG, "Switching to 128-bit integers"); }
+    std::vector<std::vector<__int128>> wide_basis;
+    if (sparse ? CBU_Balancer::_sparse_integer_nullspace(this->_sparse_matrix, wide_basis) : CBU_Balancer::_integer_nullspace(this->_main_matrix, wide_basis)) {
+        return this->_collect_nullspace_results(wide_basis);
+    }
+#endif
+    return CBU_Error::COEFFICIENT_OVERFLOW;
+}
+
+// This method is used to solve the matrix like _solving_matrix_using_nullspace, but every elimination is done modulo a 31-bit prime, in plain 64-bit integers that cannot overflow.
+// The reduced row echelon form modulo each prime is combined with the Chinese remainder theorem, and its rational entries are rebuilt with rational reconstruction.
+// It stops as soon as the rebuilt basis solves the main matrix exactly, which takes one prime for most equations, so the first prime is reduced on this thread alone.
+// If more primes are needed and the first one took at least MODULAR_PARALLEL_MIN_NS, the next ones are reduced several at once (one per thread).
+// A prime that divides a pivot gives a smaller rank or later pivot columns, and is dropped (the others are restarted if it came first).
+// Returns CBU_Error::COEFFICIENT_OVERFLOW if MODULAR_MAX_PRIMES primes are not enough.
+inline CBU_Error CBU_Balancer::_solving_matrix_using_modular_nullspace() {
+    static constexpr uint64_t primes[] = {2147483647, 2147483629, 2147483587, 2147483579, 2147483563, 2147483549, 2147483543, 2147483497}; // the largest primes below 2^31
+    const CBU_Matrix& matrix = this->_main_matrix;
+    if (matrix.empty()) { return CBU_Error::NONE; }
+
+    unsigned thread_count = 1; // for the first prime
+    unsigned parallel_thread_count = (this->_options.thread_count != 0) ? this->_options.thread_count : std::max(1u, std::thread::hardware_concurrency());
+    parallel_thread_count = std::min(parallel_thread_count, static_cast<unsigned>(MODULAR_MAX_PRIMES));
+
+    Modular_echelon best; // the echelon form of the primes combined so far (the largest rank, then the earliest pivot columns)
+    std::vector<Modular_int> residues;
+    Modular_int modulus = 1;
+    size_t combined = 0;
+    std::vector<Modular_echelon> round(1);
+    std::vector<std::vector<long long>> basis;
+    for (size_t next_prime = 0; next_prime < std::size(primes) && combined < MODULAR_MAX_PRIMES; ) {
+        const size_t round_size = std::min<size_t>(thread_count, std::size(primes) - next_prime);
+        if (round.size() < round_size) { round.resize(round_size); }
+        auto worker = [&matrix, &round, next_prime](size_t t) { CBU_Balancer::_modular_row_echelon(matrix, primes[next_prime + t], round[t]); };
+        const uint64_t round_begin_ns = CBU_Stats::now_ns();
+        std::vector<std::thread> threads;
+        for (size_t t = 1; t < round_size; t++) { threads.emplace_back(worker, t); }
+        worker(0);
+        for (auto& thread : threads) { thread.join(); }
+        if (next_prime == 0 && CBU_Stats::now_ns() - round_begin_ns >= MODULAR_PARALLEL_MIN_NS) { thread_count = parallel_thread_count; }
+        next_prime += round_size;
+
+        for (size_t t = 0; t < round_size && combined < MODULAR_MAX_PRIMES; t++) {
+            Modular_echelon& echelon = round[t];
+            const uint64_t prime = echelon.prime;
+            if (combined == 0 || echelon.pivot_columns.size() > best.pivot_columns.size()
+                || (echelon.pivot_columns.size() == best.pivot_columns.size() && echelon.pivot_columns < best.pivot_columns)) { // the first prime, or the previous ones were unlucky
+                std::swap(best, echelon);
+                residues.assign(best.free_entries.begin(), best.free_entries.end());
+                modulus = static_cast<Modular_int>(prime);
+                combined = 1;
+            } else if (echelon.pivot_columns != best.pivot_columns) {
+                continue; // an unlucky prime
+            } else { // x = residue + modulus * ((entry - residue) / modulus mod prime)
+                const uint64_t inverse = CBU_Balancer::_modular_inverse(static_cast<uint64_t>(modulus % static_cast<Modular_int>(prime)), prime);
+                for (size_t i = 0; i < residues.size(); i++) {
+                    const uint64_t residue = static_cast<uint64_t>(residues[i] % static_cast<Modular_int>(prime));
+                    const uint64_t step = (echelon.free_entries[i] + prime - residue) % prime * inverse % prime;
+                    residues[i] += modulus * static_cast<Modular_int>(step);
+                }
+                modulus *= static_cast<Modular_int>(prime);
+                combined++;
+            }
+
+            if (CBU_Balancer::_reconstruct_nullspace(matrix, best, residues, modulus, basis)) {
+                return this->_collect_nullspace_results(basis);
+            }
+        }
+    }
+    return CBU_Error::COEFFICIENT_OVERFLOW;
+}
+
+// This method computes the reduced row echelon form of a matrix modulo a prime below 2^32 (every product of two entries fits in 64 bits).
+// Only the entries at the free columns are kept, since the pivot columns are the identity.
+inline void CBU_Balancer::_modular_row_echelon(const CBU_Matrix& matrix, uint64_t prime, Modular_echelon& echelon) {
+    const size_t rows = matrix.rows();
+    const size_t columns = matrix.columns();
+    thread_local std::vector<uint64_t> reduced; // reused by every reduction on this thread
+    reduced.resize(rows * columns);
+    for (size_t i = 0; i < rows; i++) {
+        for (size_t j = 0; j < columns; j++) {
+            const long long entry = matrix[i][j] % static_cast<long long>(prime);
+            reduced[i * columns + j] = static_cast<uint64_t>((entry < 0) ? entry + static_cast<long long>(prime) : entry);
+        }
+    }
+
+    echelon.prime = prime;
+    echelon.pivot_columns.clear();
+    echelon.free_columns.clear();
+    size_t rank = 0;
+    for (size_t column = 0; column < columns; column++) {
+        size_t pivot_row = rank;
+        while (pivot_row < rows && reduced[pivot_row * columns + column] == 0) { pivot_row++; }
+        if (pivot_row == rows) { echelon.free_columns.push_back(column); continue; }
+
+        uint64_t* pivot = reduced.data() + pivot_row * columns;
+        if (pivot_row != rank) { std::swap_ranges(pivot + column, pivot + columns, reduced.data() + rank * columns + column); pivot = reduced.data() + rank * columns; }
+        const uint64_t inverse = CBU_Balancer::_modular_inverse(pivot[column], prime);
+        for (size_t j = column; j < columns; j++) { pivot[j] = pivot[j] * inverse % prime; }
+        for (size_t i = 0; i < rows; i++) {
+            uint64_t* row = reduced.data() + i * columns;
+            const uint64_t factor = row[column];
+            if (i == rank || factor == 0) { continue; }
+            for (size_t j = column; j < columns; j++) { row[j] = (row[j] + (prime - factor) * pivot[j]) % prime; }
+        }
+        echelon.pivot_columns.push_back(column);
+        rank++;
+    }
+
+    const size_t free_count = echelon.free_columns.size();
+    echelon.free_entries.resize(rank * free_count);
+    for (size_t i = 0; i < rank; i++) {
+        for (size_t k = 0; k < free_count; k++) { echelon.free_entries[i * free_count + k] = reduced[i * columns + echelon.free_columns[k]]; }
+    }
+}
+
+// This method computes the inverse of a (not 0) modulo a prime, as a^(prime - 2).
+inline uint64_t CBU_Balancer::_modular_inverse(uint64_t a, uint64_t prime) {
+    uint64_t result = 1;
+    for (uint64_t exponent = prime - 2; exponent != 0; exponent >>= 1) {
+        if (exponent & 1) { result = result * a % prime; }
+        a = a * a % prime;
+    }
+    return result;
+}
+
+// This method finds the fraction numerator / denominator that is congruent to residue modulo modulus, with both of them at most sqrt(modulus / 2) in absolute value (Wang's algorithm, a truncated extended Euclid).
+// Such a fraction is unique if it exists. Returns false if there is none.
+inline bool CBU_Balancer::_rational_reconstruction(Modular_int residue, Modular_int modulus, Modular_int& numerator, Modular_int& denominator) {
+    const Modular_int half = modulus / 2;
+    Modular_int bound = half; // floor(sqrt(modulus / 2)), by Newton's method
+    for (Modular_int next = (bound + 1) / 2; next < bound; next = (bound + half / bound) / 2) { bound = next; }
+
+    Modular_int r0 = modulus, r1 = residue, t0 = 0, t1 = 1;
+    while (r1 > bound) {
+        const Modular_int quotient = r0 / r1;
+        Modular_int r2 = r0 - quotient * r1, t2 = t0 - quotient * t1;
+        r0 = r1; r1 = r2; t0 = t1; t1 = t2;
+    }
+    if (t1 == 0 || t1 > bound || -t1 > bound || CBU_Balancer::_gcd(r1, t1) != 1) { return false; }
+    numerator = (t1 < 0) ? -r1 : r1;
+    denominator = (t1 < 0) ? -t1 : t1;
+    return true;
+}
+
+// This method rebuilds the integer nullspace basis (the one _integer_nullspace gives) from the residues of the echelon form at the free columns, and checks it against the matrix.
+// Returns false if an entry cannot be rebuilt yet, does not fit in long long, or the basis does not solve the matrix (more primes are needed).
+inline bool CBU_Balancer::_reconstruct_nullspace(const CBU_Matrix& matrix, const Modular_echelon& echelon, const std::vector<Modular_int>& residues, Modular_int modulus,
+                                                 std::vector<std::vector<long long>>& basis) {
+    const size_t columns = matrix.columns();
+    const size_t rank = echelon.pivot_columns.size();
+    const size_t free_count = echelon.free_columns.size();
+    std::vector<Modular_int> numerators(rank), denominators(rank);
+    basis.assign(free_count, std::vector<long long>(columns, 0));
+    for (size_t k = 0; k < free_count; k++) {
+        Modular_int common = 1; // the least common multiple of the denominators
+        for (size_t i = 0; i < rank; i++) {
+            if (!CBU_Balancer::_rational_reconstruction(residues[i * free_count + k], modulus, numerators[i], denominators[i])) { return false; }
+            if (!CBU_Balancer::_checked_mul(common / CBU_Balancer::_gcd(common, denominators[i]), denominators[i], common)) { return false; }
+        }
+
+        // x_free = common, x_pivot = -entry * common
+        std::vector<long long>& vector = basis[k];
+        if (common > static_cast<Modular_int>(LLONG_MAX)) { return false; }
+        vector[echelon.free_columns[k]] = static_cast<long long>(common);
+        for (size_t i = 0; i < rank; i++) {
+            Modular_int x;
+            if (!CBU_Balancer::_checked_mul(-numerators[i], common / denominators[i], x) || x > static_cast<Modular_int>(LLONG_MAX) || x < static_cast<Modular_int>(LLONG_MIN)) { return false; }
+            vector[echelon.pivot_columns[i]] = static_cast<long long>(x);
+        }
+        long long content = 0;
+        for (const auto& entry : vector) { content = CBU_Balancer::_gcd(content, entry); }
+        for (auto& entry : vector) { entry /= content; }
+
+        for (size_t i = 0; i < matrix.rows(); i++) { // the check against the matrix itself
+            Modular_int sum = 0;
+            for (size_t j = 0; j < columns; j++) {
+                Modular_int term;
+                if (!CBU_Balancer::_checked_mul(static_cast<Modular_int>(matrix[i][j]), static_cast<Modular_int>(vector[j]), term) || !CBU_Balancer::_checked_add(sum, term, sum)) { return false; }
+            }
+            if (sum != 0) { return false; }
+        }
+    }
+    return true;
+}
+
+// This method turns an integer nullspace basis into balancing results (positive and primitive coefficient vectors).
+// An underdetermined equation has more than one basis vector, so the combinations of them with weights in [1, max_coef] are enumerated.
+// Only the primitive weights (whose gcd is 1) are combined: the others give a multiple of a combination that is already listed.
+template <typename Int>
+CBU_Error CBU_Balancer::_collect_nullspace_results(const std::vector<std::vector<Int>>& basis) {
+    if (basis.empty()) { return CBU_Error::NONE; }
+
+    const size_t columns = basis[0].size();
+    const Int weight_limit = (basis.size() == 1) ? 1 : static_cast<Int>(this->_options.max_coef);
+    thread_local std::vector<Int> weights, combination; // reused by every equation solved on this thread
+    weights.assign(basis.size(), 1);
+    combination.resize(columns);
+    auto next_weights = [weight_limit]() { // the first weight changes fastest, false after the last weights
+        size_t k = 0;
+        while (k < weights.size() && weights[k] >= weight_limit) { weights[k] = 1; k++; }
+        if (k == weights.size()) { return false; }
+        weights[k]++;
+        return true;
+    };
+
+    do {
+        Int weights_content = 0;
+        for (const auto& weight : weights) { weights_content = CBU_Balancer::_gcd(weights_content, weight); }
+        if (weights_content != 1) { continue; }
+
+        CBU_STATS(this->_stats.nodes++; this->_stats.leaves++;)
+        std::fill(combination.begin(), combination.end(), 0);
+        for (size_t k = 0; k < basis.size(); k++) {
+            for (size_t i = 0; i < columns; i++) {
+                Int term;
+                if (!CBU_Balancer::_checked_mul(weights[k], basis[k][i], term) || !CBU_Balancer::_checked_add(combination[i], term, combination[i])) {
+                    return CBU_Error::COEFFICIENT_OVERFLOW;
+                }
+            }
+        }
+
+        Int content = 0;
+        bool positive = true;
+        for (const auto& coefficient : combination) {
+            if (coefficient <= 0) { positive = false; break; }
+            content = CBU_Balancer::_gcd(content, coefficient);
+        }
+
+        if (positive) {
+            std::vector<unsigned>& result = this->_workspace.coefficients;
+            result.resize(columns);
+            for (size_t i = 0; i < columns; i++) {
+                Int coefficient = combination[i] / content;
+                if (coefficient > static_cast<Int>(UINT_MAX)) { return CBU_Error::COEFFICIENT_OVERFLOW; }
+                result[i] = static_cast<unsigned>(coefficient);
+            }
+            if (this->_options.multiple_results && this->_options.log_status) {
+                this->_report(CBU_Severity::LOG, "A possible result found. ");
+            }
+            this->_push_result(this->_results_coefs, result);
+            if (!this->_options.multiple_results) { return CBU_Error::NONE; }
+        }
+    } while (next_weights());
+    return CBU_Error::NONE;
+}
+
+// This method computes the Hilbert basis of the non-negative solutions of the main matrix, i.e., the generating reactions of the equation: every balanced coefficient vector is a sum of them,
+// and none of them is a sum of other balanced vectors. It is a project-and-lift enumeration of the lattice of the integer solutions:
+// the generating reactions are the minimal lattice points (no other point is below them), and each of them is at most the sum of the extreme rays (the solutions with a minimal set of compounds),
+// since it lies in the half-open parallelepiped of the rays of a simplicial cone, or is a ray. The lattice points in that box are enumerated on the pivots of an echelon basis of the lattice
+// (see _integer_kernel_lattice), one basis vector at a time, and the coordinates fixed by the basis vectors chosen so far are checked against the box as soon as they are known.
+// The cost depends on the size of the box rather than on max_coef, which is not used at all.
+// A generating reaction leaves out the compounds it does not need (coefficient 0). If a compound is in no generating reaction, the equation cannot be balanced and there is no result.
+// A single result is the first generating reaction with every compound, or else the sum of all of them.
+// Returns CBU_Error::BASIS_TOO_LARGE if the sets of zeros tried for the extreme rays plus the lattice points in the box (estimated before the enumeration, counted during it)
+// are more than HILBERT_MAX_CANDIDATES, and CBU_Error::COEFFICIENT_OVERFLOW if a value does not fit.
+inline CBU_Error CBU_Balancer::_solving_matrix_using_hilbert_basis() {
+    const CBU_Matrix& matrix = this->_main_matrix;
+    const size_t columns = matrix.columns();
+    std::vector<std::vector<long long>> lattice;
+    std::vector<size_t> pivots;
+    if (!CBU_Balancer::_integer_kernel_lattice(matrix, lattice, pivots)) { return CBU_Error::COEFFICIENT_OVERFLOW; }
+    const size_t dimension = lattice.size();
+    if (dimension == 0) { return CBU_Error::NONE; }
+
+    // The extreme rays: a ray is zero at dimension - 1 compounds whose rows, added to the matrix, leave a single solution.
+    // Each set of zeros costs an elimination, so the C(columns, dimension - 1) sets count against HILBERT_MAX_CANDIDATES before any is tried.
+    unsigned long long zero_sets = 1; // C(columns - dimension + 1 + k, k) grows with k, so it stops growing once it is over the limit
+    for (size_t k = 1; k < dimension && zero_sets <= HILBERT_MAX_CANDIDATES; k++) { zero_sets = zero_sets * (columns - dimension + 1 + k) / k; }
+    if (zero_sets > HILBERT_MAX_CANDIDATES) { return CBU_Error::BASIS_TOO_LARGE; }
+    std::vector<std::vector<long long>> rays;
+    CBU_Matrix augmented(matrix.rows() + dimension - 1, columns);
+    std::copy(matrix.data().begin(), matrix.data().end(), augmented[0]);
+    std::vector<size_t> zeros(dimension - 1);
+    for (size_t k = 0; k < zeros.size(); k++) { zeros[k] = k; }
+    std::vector<std::vector<long long>> solutions;
+    while (true) {
+        for (size_t k = 0; k < zeros.size(); k++) {
+            std::fill(augmented[matrix.rows() + k], augmented[matrix.rows() + k] + columns, 0);
+            augmented[matrix.rows() + k][zeros[k]] = 1;
+        }
+        if (!CBU_Balancer::_integer_nullspace(augmented, solutions)) { return CBU_Error::COEFFICIENT_OVERFLOW; }
+        if (solutions.size() == 1) {
+            std::vector<long long>& ray = solutions[0];
+            const bool non_positive = std::all_of(ray.begin(), ray.end(), [](long long x) { return x <= 0; });
+            if (non_positive) { for (auto& x : ray) { x = -x; } }
+            if (std::all_of(ray.begin(), ray.end(), [](long long x) { return x >= 0; })) { rays.push_back(std::move(ray)); }
+        }
+
+        size_t k = zeros.size(); // the next set of zeros, in lexicographic order
+        while (k > 0 && zeros[k - 1] == columns - zeros.size() + k - 1) { k--; }
+        if (k == 0) { break; }
+        zeros[k - 1]++;
+        for (size_t l = k; l < zeros.size(); l++) { zeros[l] = zeros[l - 1] + 1; }
+    }
+    std::sort(rays.begin(), rays.end());
+    rays.erase(std::unique(rays.begin(), rays.end()), rays.end());
+
+    std::vector<long long> bound(columns, 0); // the sum of the rays
+    for (const auto& ray : rays) {
+        for (size_t j = 0; j < columns; j++) {
+            if (!CBU_Balancer::_checked_add(bound[j], ray[j], bound[j])) { return CBU_Error::COEFFICIENT_OVERFLOW; }
+        }
+    }
+    for (const auto& x : bound) {
+        if (x > static_cast<long long>(UINT_MAX)) { return CBU_Error::COEFFICIENT_OVERFLOW; }
+    }
+
+    // The lattice points in the box [0, bound]: basis vector k fixes the coordinates from its pivot to the next pivot.
+    // The scan visits about as many points as the box holds in the pivot coordinates (the product of their ranges, the other coordinates prune little),
+    // so a box that is too large is rejected before it is scanned. The visited points are still counted, in case the estimate is low.
+    size_t visited = static_cast<size_t>(zero_sets);
+    unsigned long long box_points = 1;
+    for (size_t k = 0; k < dimension; k++) {
+        const unsigned long long range = static_cast<unsigned long long>(bound[pivots[k]] / lattice[k][pivots[k]]) + 1;
+        if (box_points > (HILBERT_MAX_CANDIDATES - visited) / range) { return CBU_Error::BASIS_TOO_LARGE; }
+        box_points *= range;
+    }
+    auto floor_div = [](long long a, long long b) { return a / b - ((a % b != 0) && ((a < 0) != (b < 0))); };
+    std::vector<std::vector<long long>> partial(dimension + 1, std::vector<long long>(columns, 0)); // the point before each basis vector is added
+    std::vector<std::vector<unsigned>> points;
+    CBU_Error error = CBU_Error::NONE;
+    auto lift = [&](auto& self, size_t k) -> void {
+        if (k == dimension) {
+            const std::vector<long long>& point = partial[k];
+            if (std::any_of(point.begin(), point.end(), [](long long x) { return x != 0; })) { points.emplace_back(point.begin(), point.end()); }
+            return;
+        }
+        const std::vector<long long>& vector = lattice[k];
+        const size_t pivot = pivots[k];
+        const size_t end = (k + 1 < dimension) ? pivots[k + 1] : columns;
+        const long long low = -floor_div(partial[k][pivot], vector[pivot]); // the pivot entry is positive
+        const long long high = floor_div(bound[pivot] - partial[k][pivot], vector[pivot]);
+        std::copy(partial[k].begin(), partial[k].begin() + pivot, partial[k + 1].begin()); // the vector is 0 before its pivot
+        for (long long weight = low; weight <= high && error == CBU_Error::NONE; weight++) {
+            CBU_STATS(this->_stats.nodes++;)
+            if (++visited > HILBERT_MAX_CANDIDATES) { error = CBU_Error::BASIS_TOO_LARGE; return; }
+            bool inside = true;
+            for (size_t j = pivot; j < columns; j++) {
+                long long term;
+                if (!CBU_Balancer::_checked_mul(weight, vector[j], term) || !CBU_Balancer::_checked_add(partial[k][j], term, partial[k + 1][j])) {
+                    error = CBU_Error::COEFFICIENT_OVERFLOW;
+                    return;
+                }
+                if (j < end) { inside = inside && partial[k + 1][j] >= 0 && partial[k + 1][j] <= bound[j]; }
+            }
+            if (inside) { self(self, k + 1); }
+        }
+    };
+    lift(lift, 0);
+    if (error != CBU_Error::NONE) { return error; }
+    CBU_STATS(this->_stats.leaves += points.size();)
+
+    // The minimal points, by increasing sum: a point above another one is their difference plus that one
+    auto sum = [](const std::vector<unsigned>& point) { return std::accumulate(point.begin(), point.end(), 0ULL); };
+    std::sort(points.begin(), points.end(), [&sum](const auto& a, const auto& b) { return sum(a) < sum(b); });
+    std::vector<std::vector<unsigned>> basis;
+    for (auto& point : points) {
+        const bool above = std::any_of(basis.begin(), basis.end(), [&point, columns](const std::vector<unsigned>& minimal) {
+            for (size_t j = 0; j < columns; j++) {
+                if (point[j] < minimal[j]) { return false; }
+            }
+            return true;
+        });
+        if (!above) { basis.push_back(std::move(point)); }
+    }
+
+    std::vector<bool> covered(columns, false);
+    for (const auto& solution : basis) {
+        for (size_t j = 0; j < columns; j++) { covered[j] = covered[j] || solution[j] != 0; }
+    }
+    if (std::find(covered.begin(), covered.end(), false) != covered.end()) { return CBU_Error::NONE; }
+    std::sort(basis.begin(), basis.end());
+
+    if (!this->_options.multiple_results) {
+        auto positive = [](const std::vector<unsigned>& solution) { return std::find(solution.begin(), solution.end(), 0u) == solution.end(); };
+        auto first = std::find_if(basis.begin(), basis.end(), positive);
+        if (first != basis.end()) {
+            this->_results_coefs.push_back(std::move(*first));
+            return CBU_Error::NONE;
+        }
+        std::vector<unsigned> total(columns, 0);
+        for (const auto& solution : basis) {
+            for (size_t j = 0; j < columns; j++) {
+                if (!CBU_Balancer::_checked_add(total[j], solution[j], total[j])) { return CBU_Error::COEFFICIENT_OVERFLOW; }
+            }
+        }
+        CBU_Balancer::_make_primitive(total);
+        this->_results_coefs.push_back(std::move(total));
+        return CBU_Error::NONE;
+    }
+
+    for (auto& solution : basis) {
+        if (this->_options.log_status) { this->_report(CBU_Severity::LOG, "A possible result found. "); }
+        this->_results_coefs.push_back(std::move(solution));
+    }
+    return CBU_Error::NONE;
+}
+
+// This method computes a basis of the lattice of the integer solutions of a matrix: unlike _integer_nullspace, every integer solution is an integer combination of the basis.
+// The transpose of the matrix, next to an identity matrix, is brought to echelon form with unimodular row operations, and the rows whose matrix part vanishes are the basis.
+// The basis is then brought to echelon form itself: the pivot (the first non-zero entry) of each vector is positive and further right than the pivot of the previous vector.
+// Returns false if an intermediate value overflows long long.
+inline bool CBU_Balancer::_integer_kernel_lattice(const CBU_Matrix& matrix, std::vector<std::vector<long long>>& basis, std::vector<size_t>& pivots) {
+    const size_t rows = matrix.rows();
+    const size_t columns = matrix.columns();
+    std::vector<std::vector<long long>> transposed(columns, std::vector<long long>(rows + columns, 0));
+    for (size_t j = 0; j < columns; j++) {
+        for (size_t i = 0; i < rows; i++) { transposed[j][i] = matrix[i][j]; }
+        transposed[j][rows + j] = 1;
+    }
+    if (!CBU_Balancer::_unimodular_echelon(transposed, 0, rows, pivots)) { return false; }
+
+    basis.clear();
+    for (size_t j = pivots.size(); j < columns; j++) { basis.emplace_back(transposed[j].begin() + rows, transposed[j].end()); }
+    return CBU_Balancer::_unimodular_echelon(basis, 0, columns, pivots);
+}
+
+// This method brings the rows to echelon form on the entries [first, last) with unimodular row operations (swaps and adding integer multiples of a row, applied to whole rows),
+// i.e., Euclid's algorithm down each column. Each pivot is made positive, and the entries above it are reduced modulo it to keep them small. The pivot column of each leading row is written to pivots.
+// Returns false if an intermediate value overflows long long.
+inline bool CBU_Balancer::_unimodular_echelon(std::vector<std::vector<long long>>& rows, size_t first, size_t last, std::vector<size_t>& pivots) {
+    pivots.clear();
+    auto subtract_multiple = [](std::vector<long long>& row, const std::vector<long long>& other, long long multiple) {
+        for (size_t j = 0; j < row.size(); j++) {
+            long long term;
+            if (!CBU_Balancer::_checked_mul(multiple, other[j], term) || !CBU_Balancer::_checked_sub(row[j], term, row[j])) { return false; }
+        }
+        return true;
+    };
+
+    size_t rank = 0;
+    for (size_t column = first; column < last && rank < rows.size(); column++) {
+        while (true) {
+            size_t pivot_row = rows.size(); // the smallest non-zero entry, so each pass shrinks the others below it
+            for (size_t i = rank; i < rows.size(); i++) {
+                if (rows[i][column] != 0 && (pivot_row == rows.size() || std::llabs(rows[i][column]) < std::llabs(rows[pivot_row][column]))) { pivot_row = i; }
+            }
+            if (pivot_row == rows.size()) { break; } // no pivot in this column
+            std::swap(rows[rank], rows[pivot_row]);
+
+            bool done = true;
+            for (size_t i = rank + 1; i < rows.size(); i++) {
+                if (rows[i][column] == 0) { continue; }
+                if (!subtract_multiple(rows[i], rows[rank], rows[i][column] / rows[rank][column])) { return false; }
+                done = done && rows[i][column] == 0;
+            }
+            if (!done) { continue; }
+
+            if (rows[rank][column] < 0) {
+                for (auto& entry : rows[rank]) { entry = -entry; }
+            }
+            for (size_t i = 0; i < rank; i++) {
+                long long quotient = rows[i][column] / rows[rank][column];
+                if (rows[i][column] % rows[rank][column] < 0) { quotient--; }
+                if (quotient != 0 && !subtract_multiple(rows[i], rows[rank], quotient)) { return false; }
+            }
+            pivots.push_back(column);
+            rank++;
+            break;
+        }
+    }
+    return true;
+}
+
+// This method tests if the gcd of the coefficients is 1, i.e., the coefficients are not a multiple of smaller ones.
+inline bool CBU_Balancer::_is_primitive(const std::vector<unsigned>& coefficients) {
+    unsigned content = 0;
+    for (const auto& coefficient : coefficients) {
+        content = CBU_Balancer::_gcd(content, coefficient);
+        if (content == 1) { return true; }
+    }
+    return content == 1;
+}
+
+// This method divides the coefficients by their gcd.
+inline void CBU_Balancer::_make_primitive(std::vector<unsigned>& coefficients) {
+    unsigned content = 0;
+    for (const auto& coefficient : coefficients) { content = CBU_Balancer::_gcd(content, coefficient); }
+    if (content <= 1) { return; }
+    for (auto& coefficient : coefficients) { coefficient /= content; }
+}
+
+// These methods multiply (add, or subtract) two integers, return false if the result overflows Int.
+template <typename Int>
+constexpr bool CBU_Balancer::_checked_mul(Int a, Int b, Int& result) {
+#if defined(__GNUC__) || defined(__clang__)
+    return !__builtin_mul_overflow(a, b, &result);
+#else
+    if (a != 0 && b != 0) {
+        if ((a == -1 && b == std::numeric_limits<Int>::min()) || (b == -1 && a == std::numeric_limits<Int>::min())) { return false; }
+        if ((a > 0) == (b > 0) ? (a > 0 ? a > std::numeric_limits<Int>::max() / b : a < std::numeric_limits<Int>::max() / b)
+                               : (a > 0 ? b < std::numeric_limits<Int>::min() / a : a < std::numeric_limits<Int>::min() / b)) { return false; }
+    }
+    result = a * b;
+    return true;
+#endif
+}
+
+template <typename Int>
+constexpr bool CBU_Balancer::_checked_add(Int a, Int b, Int& result) {
+#if defined(__GNUC__) || defined(__clang__)
+    return !__builtin_add_overflow(a, b, &result);
+#else
+    if ((b > 0 && a > std::numeric_limits<Int>::max() - b) || (b < 0 && a < std::numeric_limits<Int>::min() - b)) { return false; }
+    result = a + b;
+    return true;
+#endif
+}
+
+template <typename Int>
+constexpr bool CBU_Balancer::_checked_sub(Int a, Int b, Int& result) {
+#if defined(__GNUC__) || defined(__clang__)
+    return !__builtin_sub_overflow(a, b, &result);
+#else
+    if ((b < 0 && a > std::numeric_limits<Int>::max() + b) || (b > 0 && a < std::numeric_limits<Int>::min() + b)) { return false; }
+    result = a - b;
+    return true;
+#endif
+}
+
+// This method returns the (non-negative) greatest common divisor of two integers. std::gcd is not used because it does not accept 128-bit integers.
+template <typename Int>
+constexpr Int CBU_Balancer::_gcd(Int a, Int b) {
+    if (a < 0) { a = -a; }
+    if (b < 0) { b = -b; }
+    while (b != 0) {
+        Int t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// This method computes an integer basis of the nullspace of a matrix using fraction-free elimination.
+// Every row operation is done in integers and each row is divided by the gcd of its entries afterwards, which keeps the entries small.
+// Each basis vector is primitive (the gcd of its entries is 1) and is positive at its own free column.
+// A matrix with at most SMALL_MAX_ELEMENTS rows and SMALL_MAX_COMPOUNDS columns is eliminated in std::array rows on the stack, a larger one in rows reused by every elimination on this thread,
+// and the vectors already in basis are refilled, so an elimination allocates nothing once they are large enough.
+// Returns false if an intermediate value overflows Int.
+template <typename Int>
+bool CBU_Balancer::_integer_nullspace(const CBU_Matrix& matrix, std::vector<std::vector<Int>>& basis) {
+    if (matrix.empty()) {
+        basis.clear();
+        return true;
+    }
+    if (matrix.rows() <= SMALL_MAX_ELEMENTS && matrix.columns() <= SMALL_MAX_COMPOUNDS) {
+        std::array<std::array<Int, SMALL_MAX_COMPOUNDS>, SMALL_MAX_ELEMENTS> reduced; // only the first rows and columns are used (and written before they are read)
+        return CBU_Balancer::_integer_nullspace_in(matrix, reduced, basis);
+    }
+    thread_local std::vector<std::vector<Int>> reduced;
+    if (reduced.size() < matrix.rows()) { reduced.resize(matrix.rows()); }
+    for (size_t i = 0; i < matrix.rows(); i++) {
+        if (reduced[i].size() < matrix.columns()) { reduced[i].resize(matrix.columns()); }
+    }
+    return CBU_Balancer::_integer_nullspace_in(matrix, reduced, basis);
+}
+
+// This method is the elimination of _integer_nullspace in the given rows (std::array or std::vector rows with at least as many rows and columns as matrix)
+template <typename Int, typename Rows>
+bool CBU_Balancer::_integer_nullspace_in(const CBU_Matrix& matrix, Rows& reduced, std::vector<std::vector<Int>>& basis) {
+    const size_t rows = matrix.rows();
+    const size_t columns = matrix.columns();
+    for (size_t i = 0; i < rows; i++) {
+        for (size_t j = 0; j < columns; j++) {
+            reduced[i][j] = static_cast<Int>(matrix[i][j]);
+        }
+    }
+
+    auto magnitude = [](Int x) { return (x < 0) ? -x : x; };
+    thread_local std::vector<size_t> pivot_columns;
+    pivot_columns.clear();
+    size_t rank = 0;
+
+    for (size_t column = 0; column < columns && rank < rows; column++) {
+        size_t pivot_row = rows; // the smallest non-zero entry is picked as the pivot to limit the growth of entries
+        for (size_t i = rank; i < rows; i++) {
+            if (reduced[i][column] != 0 && (pivot_row == rows || magnitude(reduced[i][column]) < magnitude(reduced[pivot_row][column]))) {
+                pivot_row = i;
+            }
+        }
+        if (pivot_row == rows) { continue; } // free column
+
+        std::swap_ranges(reduced[rank].begin(), reduced[rank].begin() + columns, reduced[pivot_row].begin());
+        const Int pivot = reduced[rank][column];
+
+        for (size_t i = 0; i < rows; i++) { // eliminates above and below, so every pivot column ends up with a single non-zero entry
+            if (i == rank || reduced[i][column] == 0) { continue; }
+            Int g = CBU_Balancer::_gcd(pivot, reduced[i][column]);
+            Int a = pivot / g;
+            Int b = reduced[i][column] / g;
+            Int content = 0;
+            for (size_t j = 0; j < columns; j++) {
+                Int x, y;
+                if (!CBU_Balancer::_checked_mul(reduced[i][j], a, x) || !CBU_Balancer::_checked_mul(reduced[rank][j], b, y) || !CBU_Balancer::_checked_sub(x, y, reduced[i][j])) {
+                    return false;
+                }
+                content = CBU_Balancer::_gcd(content, reduced[i][j]);
+            }
+            if (content > 1) {
+                for (size_t j = 0; j < columns; j++) { reduced[i][j] /= content; }
+            }
+        }
+
+        pivot_columns.push_back(column);
+        rank++;
+    }
+
+    Int common = 1; // the least common multiple of all pivots
+    for (size_t i = 0; i < rank; i++) {
+        Int d = magnitude(reduced[i][pivot_columns[i]]);
+        if (!CBU_Balancer::_checked_mul(common / CBU_Balancer::_gcd(common, d), d, common)) { return false; }
+    }
+
+    thread_local std::vector<std::vector<Int>> spare_vectors; // the basis vectors dropped by a smaller nullity
+    CBU_Balancer::_resize_keeping(basis, columns - rank, spare_vectors);
+    for (size_t free_column = 0, next_pivot = 0, k = 0; free_column < columns; free_column++) {
+        if (next_pivot < rank && pivot_columns[next_pivot] == free_column) { next_pivot++; continue; }
+
+        std::vector<Int>& vector = basis[k++];
+        vector.assign(columns, 0);
+        vector[free_column] = common;
+        for (size_t i = 0; i < rank; i++) { // pivot * x_pivot + entry * common == 0
+            Int x;
+            if (!CBU_Balancer::_checked_mul(reduced[i][free_column], common / reduced[i][pivot_columns[i]], x)) { return false; }
+            vector[pivot_columns[i]] = -x;
+        }
+
+        Int content = 0;
+        for (const auto& entry : vector) { content = CBU_Balancer::_gcd(content, entry); }
+        for (auto& entry : vector) { entry /= content; }
+    }
+
+    return true;
+}
+
+// This method computes the basis of _integer_nullspace on a sparse matrix, with fraction-free Gauss-Jordan elimination on sparse rows (each row lists its non-zero entries by column).
+// The columns are eliminated by ascending number of non-zero entries, i.e., the compounds with the fewest elements first, and the pivot of each column is the row with the fewest entries,
+// which keeps the rows sparse (a fill-reducing order). The basis of that order is then brought to the one of _integer_nullspace (see _canonical_nullspace_basis).
+// Returns false if an intermediate value overflows Int.
+template <typename Int>
+bool CBU_Balancer::_sparse_integer_nullspace(const CBU_Sparse_matrix& matrix, std::vector<std::vector<Int>>& basis) {
+    basis.clear();
+    const size_t rows = matrix.rows();
+    const size_t columns = matrix.columns();
+    if (columns == 0) { return true; }
+
+    using Entry = std::pair<size_t, Int>; // column, value
+    std::vector<std::vector<Entry>> sparse_rows(rows);
+    for (size_t j = 0; j < columns; j++) {
+        for (size_t k = matrix.column_start(j); k < matrix.column_start(j + 1); k++) { sparse_rows[matrix.row_index(k)].emplace_back(j, static_cast<Int>(matrix.value(k))); }
+    }
+    auto entry_at = [](const std::vector<Entry>& row, size_t column) {
+        auto it = std::lower_bound(row.begin(), row.end(), column, [](const Entry& entry, size_t c) { return entry.first < c; });
+        return (it != row.end() && it->first == column) ? it->second : Int(0);
+    };
+    auto magnitude = [](Int x) { return (x < 0) ? -x : x; };
+
+    std::vector<size_t> order(columns);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&matrix](size_t a, size_t b) {
+        return matrix.column_start(a + 1) - matrix.column_start(a) < matrix.column_start(b + 1) - matrix.column_start(b);
+    });
+
+    std::vector<size_t> pivot_row_of(columns, rows); // rows means a free column
+    std::vector<bool> used(rows, false);
+    std::vector<Entry> combined;
+    for (const size_t column : order) {
+        size_t pivot_row = rows;
+        for (size_t i = 0; i < rows; i++) {
+            if (used[i]) { continue; }
+            const Int entry = entry_at(sparse_rows[i], column);
+            if (entry == 0) { continue; }
+            if (pivot_row == rows || sparse_rows[i].size() < sparse_rows[pivot_row].size()
+                || (sparse_rows[i].size() == sparse_rows[pivot_row].size() && magnitude(entry) < magnitude(entry_at(sparse_rows[pivot_row], column)))) { pivot_row = i; }
+        }
+        if (pivot_row == rows) { continue; }
+        used[pivot_row] = true;
+        pivot_row_of[column] = pivot_row;
+
+        const std::vector<Entry>& pivot = sparse_rows[pivot_row];
+        const Int pivot_entry = entry_at(pivot, column);
+        for (size_t i = 0; i < rows; i++) { // row = row * a - pivot * b, merged by column
+            const Int entry = (i == pivot_row) ? Int(0) : entry_at(sparse_rows[i], column);
+            if (entry == 0) { continue; }
+            const Int g = CBU_Balancer::_gcd(pivot_entry, entry);
+            const Int a = pivot_entry / g;
+            const Int b = entry / g;
+            const std::vector<Entry>& row = sparse_rows[i];
+            combined.clear();
+            Int content = 0;
+            for (size_t x = 0, y = 0; x < row.size() || y < pivot.size(); ) {
+                const size_t c = (y == pivot.size() || (x < row.size() && row[x].first < pivot[y].first)) ? row[x].first : pivot[y].first;
+                Int u = 0, v = 0, value;
+                if (x < row.size() && row[x].first == c && !CBU_Balancer::_checked_mul(row[x++].second, a, u)) { return false; }
+                if (y < pivot.size() && pivot[y].first == c && !CBU_Balancer::_checked_mul(pivot[y++].second, b, v)) { return false; }
+                if (!CBU_Balancer::_checked_sub(u, v, value)) { return false; }
+                if (value != 0) {
+                    combined.emplace_back(c, value);
+                    content = CBU_Balancer::_gcd(content, value);
+                }
+            }
+            if (content > 1) {
+                for (auto& entry_of_row : combined) { entry_of_row.second /= content; }
+            }
+            sparse_rows[i].swap(combined);
+        }
+    }
+
+    // Each pivot row is pivot * x_pivot + sum(entry * x_free) == 0, so the vector of a free column takes common at it and -entry * common / pivot at the pivot of each row that has it
+    std::vector<size_t> vector_of(columns, columns); // the index of the basis vector of each free column
+    for (size_t column = 0; column < columns; column++) {
+        if (pivot_row_of[column] != rows) { continue; }
+        vector_of[column] = basis.size();
+        basis.emplace_back(columns, Int(0));
+        basis.back()[column] = 1; // the least common multiple of the pivots of the rows that have this column
+    }
+    for (size_t column = 0; column < columns; column++) {
+        if (pivot_row_of[column] == rows) { continue; }
+        const std::vector<Entry>& row = sparse_rows[pivot_row_of[column]];
+        const Int d = magnitude(entry_at(row, column));
+        for (const auto& entry : row) {
+            if (entry.first == column) { continue; }
+            Int& common = basis[vector_of[entry.first]][entry.first];
+            if (!CBU_Balancer::_checked_mul(common / CBU_Balancer::_gcd(common, d), d, common)) { return false; }
+        }
+    }
+    for (size_t column = 0; column < columns; column++) {
+        if (pivot_row_of[column] == rows) { continue; }
+        const std::vector<Entry>& row = sparse_rows[pivot_row_of[column]];
+        const Int pivot = entry_at(row, column);
+        for (const auto& entry : row) {
+            if (entry.first == column) { continue; }
+            std::vector<Int>& vector = basis[vector_of[entry.first]];
+            Int x;
+            if (!CBU_Balancer::_checked_mul(entry.second, vector[entry.first] / pivot, x)) { return false; }
+            vector[column] = -x;
+        }
+    }
+    for (auto& vector : basis) {
+        Int content = 0;
+        for (const auto& entry : vector) { content = CBU_Balancer::_gcd(content, entry); }
+        for (auto& entry : vector) { entry /= content; }
+    }
+    return CBU_Balancer::_canonical_nullspace_basis(basis);
+}
+
+// This method brings any basis of a nullspace to the one _integer_nullspace gives: vector k is 0 at the free columns of the other vectors, and it is primitive and positive at its own free column.
+// The free columns of _integer_nullspace are the columns where some solution has its last non-zero entry, so they are the pivots of an echelon form of the basis taken from the right.
+// Returns false if an intermediate value overflows Int.
+template <typename Int>
+bool CBU_Balancer::_canonical_nullspace_basis(std::vector<std::vector<Int>>& basis) {
+    if (basis.empty()) { return true; }
+    const size_t count = basis.size();
+    const size_t columns = basis[0].size();
+    auto magnitude = [](Int x) { return (x < 0) ? -x : x; };
+    std::vector<size_t> free_columns;
+
+    for (size_t column = columns; column-- > 0 && free_columns.size() < count; ) {
+        const size_t rank = free_columns.size();
+        size_t pivot_row = count;
+        for (size_t i = rank; i < count; i++) {
+            if (basis[i][column] != 0 && (pivot_row == count || magnitude(basis[i][column]) < magnitude(basis[pivot_row][column]))) { pivot_row = i; }
+        }
+        if (pivot_row == count) { continue; }
+        std::swap(basis[rank], basis[pivot_row]);
+
+        const Int pivot = basis[rank][column];
+        for (size_t i = 0; i < count; i++) {
+            if (i == rank || basis[i][column] == 0) { continue; }
+            const Int g = CBU_Balancer::_gcd(pivot, basis[i][column]);
+            const Int a = pivot / g;
+            const Int b = basis[i][column] / g;
+            Int content = 0;
+            for (size_t j = 0; j < columns; j++) {
+                Int x, y;
+                if (!CBU_Balancer::_checked_mul(basis[i][j], a, x) || !CBU_Balancer::_checked_mul(basis[rank][j], b, y) || !CBU_Balancer::_checked_sub(x, y, basis[i][j])) { return false; }
+                content = CBU_Balancer::_gcd(content, basis[i][j]);
+            }
+            if (content > 1) {
+                for (auto& entry : basis[i]) { entry /= content; }
+            }
+        }
+        free_columns.push_back(column);
+    }
+
+    for (size_t k = 0; k < count; k++) {
+        const Int sign = (basis[k][free_columns[k]] < 0) ? -1 : 1;
+        Int content = 0;
+        for (const auto& entry : basis[k]) { content = CBU_Balancer::_gcd(content, entry); }
+        for (auto& entry : basis[k]) { entry = entry / content * sign; }
+    }
+    std::reverse(basis.begin(), basis.end()); // by ascending free column
+    return true;
+}
+
+// This method removes linear dependent items (the first one of each kind is kept).
+// Two results are linear dependent exactly when they are equal after dividing by their gcd, so each result is made primitive and the repeated ones are dropped through a hash set (exact, O(results * compounds)).
+// The hash set is an open-addressing table of the indices of the kept results in the workspace, and a dropped result goes to the spare results (within WORKSPACE_MAX_SPARES), so nothing is allocated in steady state.
+// The solvers only generate primitive results, so nothing is dropped unless a solver repeats a result.
+// Modifying private members
+inline void CBU_Balancer::_filter_linear_independent_results() {
+    if (this->_options.multiple_results && this->_options.log_status) { this->_report(CBU_Severity::LOG, "Filtering linear independent items"); }
+
+    std::vector<std::vector<unsigned>>& results = this->_results_coefs;
+    auto hash = [&results](size_t index) {
+        size_t hash_value = results[index].size();
+        for (const auto& coefficient : results[index]) { hash_value = (hash_value ^ coefficient) * 0x100000001b3ULL; } // FNV-1a
+        return hash_value;
+    };
+    std::vector<size_t>& kept_slots = this->_workspace.kept_slots; // the indices of the kept results (SIZE_MAX for an empty slot), at most half full
+    size_t slots_count = 1;
+    while (slots_count < 2 * results.size()) { slots_count *= 2; }
+    kept_slots.assign(slots_count, SIZE_MAX);
+
+    size_t kept = 0;
+    for (size_t i = 0; i < results.size(); i++) {
+        CBU_Balancer::_make_primitive(results[i]);
+        if (kept != i) { std::swap(results[kept], results[i]); } // the dropped result keeps its storage
+        size_t slot = hash(kept) & (slots_count - 1);
+        while (kept_slots[slot] != SIZE_MAX && results[kept_slots[slot]] != results[kept]) { slot = (slot + 1) & (slots_count - 1); }
+        if (kept_slots[slot] == SIZE_MAX) { kept_slots[slot] = kept++; }
+    }
+    for (size_t i = kept; i < results.size(); i++) { CBU_Balancer::_keep_spare(this->_workspace.spare_results, results[i]); }
+    results.resize(kept);
+}
+
+// This method takes a half equation (for example, the half equations of "N + O2 -> NO2" is "N + O2" and "NO2") as input and outputs the compounds str of that half equation.
+// The half equation is scanned once, and the spaces are left out of the compound strings. The strings already in compounds_str are refilled, so they keep their buffers.
+// View _get_compounds_str
+inline CBU_Error CBU_Balancer::_separate_half_equation(std::string_view half_equation, std::vector<std::string>& compounds_str) {
+    std::vector<std::string>& spare_compounds_str = CBU_Balancer::_spare_compounds_str();
+    size_t count = 0;
+    auto next_compound = [&compounds_str, &spare_compounds_str, &count]() {
+        if (count == compounds_str.size()) { CBU_Balancer::_resize_keeping(compounds_str, count + 1, spare_compounds_str); }
+        compounds_str[count].clear();
+        count++;
+    };
+    next_compound();
+    bool blank = true;
+    for (const char c : half_equation) {
+        if (std::isspace(static_cast<unsigned char>(c))) { continue; }
+        blank = false;
+        if (c == '+') { next_compound(); }
+        else { compounds_str[count - 1] += c; }
+    }
+    CBU_Balancer::_resize_keeping(compounds_str, count, spare_compounds_str);
+    if (blank) {
+        CBU_Balancer::_resize_keeping(compounds_str, 0, spare_compounds_str);
+        return CBU_Error::INCOMPLETE_EQUATION;
+    }
+    return CBU_Error::NONE;
+}
+
+// This method finds the arrow of an equation, i.e., its [begin, end) bounds. The spaces are not part of any compound, so blanks between '-' and '>' are allowed (e.g., "A - > B").
+// It returns false if the equation has no arrow, or more than one.
+constexpr bool CBU_Balancer::_find_arrow(std::string_view equation, size_t& begin, size_t& end) {
+    auto is_space = [](char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r'; };
+    size_t arrows = 0;
+    for (size_t i = 0; i < equation.size(); i++) {
+        if (equation[i] != '-') { continue; }
+        size_t j = i + 1;
+        while (j < equation.size() && is_space(equation[j])) { j++; }
+        if (j == equation.size() || equation[j] != '>') { continue; }
+        begin = i;
+        end = j + 1;
+        arrows++;
+        i = j;
+    }
+    return arrows == 1;
+}
+
+// This method is used to generate the compounds str (std::pair for reactant and products; std::vector<std::string> for compounds str) from an equation
+// The equation is viewed (not copied) and split at its only arrow.
+inline CBU_Error CBU_Balancer::_get_compounds_str(const std::string &equation, std::pair<std::vector<std::string>, std::vector<std::string>>& compounds_str) {
+    const std::string_view equation_view(equation);
+    size_t arrow = 0, arrow_end = 0;
+    if (!CBU_Balancer::_find_arrow(equation_view, arrow, arrow_end)) { return CBU_Error::INVALID_EQUATION; }
+
+    CBU_Error error = CBU_Balancer::_separate_half_equation(equation_view.substr(0, arrow), compounds_str.first);
+    if (error != CBU_Error::NONE) { return error; }
+    return CBU_Balancer::_separate_half_equation(equation_view.substr(arrow_end), compounds_str.second);
+}
+
+// This method records the error of the recent equation and reports it (after its context, e.g., the compound that cannot be parsed).
+inline CBU_Error CBU_Balancer::_fail(CBU_Error error, std::string_view context) {
+    this->_error = error;
+    if (this->_options.sink) {
+        std::string message = context.empty() ? std::string() : std::string(context) + ": ";
+        message += CBU_Balancer::error_name(error);
+        this->_report(CBU_Severity::ERROR, message);
+    }
+    return error;
+}
+
+// This method parses the given compounds and outputs their compositions and the elements in them, sorted by symbol (the rows of the main matrix).
+inline CBU_Error CBU_Balancer::_parse_compounds(const std::vector<std::string>& reactants, const std::vector<std::string>& products,
+                                                std::vector<CBU_Composition>& reactants_composition, std::vector<CBU_Composition>& products_composition, std::vector<unsigned>& elements) {
+    CBU_Balancer::_resize_keeping(reactants_composition, reactants.size(), this->_workspace.spare_reactants_composition);
+    CBU_Balancer::_resize_keeping(products_composition, products.size(), this->_workspace.spare_products_composition);
+    for (size_t i = 0; i < reactants.size(); i++) {
+        if (reactants[i].empty()) { return this->_fail(CBU_Error::INCOMPLETE_REACTANT, {}); }
+        CBU_Error error = this->_get_compound_composition(reactants[i], reactants_composition[i]);
+        if (error != CBU_Error::NONE) { return this->_fail(error, reactants[i]); }
+    } // to all reactants
+    for (size_t i = 0; i < products.size(); i++) {
+        if (products[i].empty()) { return this->_fail(CBU_Error::INCOMPLETE_REACTANT, {}); }
+        CBU_Error error = this->_get_compound_composition(products[i], products_composition[i]);
+        if (error != CBU_Error::NONE) { return this->_fail(error, products[i]); }
+    } // to all products
+    return this->_collect_elements(reactants_composition, products_composition, elements);
+}
+
+// This method lists the elements of the given compositions, sorted by symbol (the rows of the main matrix), which must be the same on both sides.
+inline CBU_Error CBU_Balancer::_collect_elements(const std::vector<CBU_Composition>& reactants_composition, const std::vector<CBU_Composition>& products_composition, std::vector<unsigned>& elements) {
+    std::vector<unsigned>& product_elements = this->_workspace.product_elements;
+    CBU_Balancer::get_elements_from_compounds_composition(reactants_composition, elements);
+    CBU_Balancer::get_elements_from_compounds_composition(products_composition, product_elements);
+    return this->_match_elements(elements, product_elements);
+}
+
+// This method checks that the reactants and the products have the same elements (both sorted by id), and orders them into the rows of the main matrix, by element symbol (as std::sort orders the symbols)
+inline CBU_Error CBU_Balancer::_match_elements(std::vector<unsigned>& elements, const std::vector<unsigned>& product_elements) {
+    if (elements != product_elements) {
+        return this->_fail(CBU_Error::ELEMENTS_MISMATCH_BETWEEN_REACTANTS_AND_PRODUCTS, {});
+    }
+    std::sort(elements.begin(), elements.end(), [](unsigned a, unsigned b) { return CBU_Elements::symbol(a) < CBU_Elements::symbol(b); });
+    return CBU_Error::NONE;
+}
+
+// This method splits the equations of a reaction set into compounds and parses each species (a distinct compound string) only once, into compositions (the shared species table).
+// Each reaction refers to its compounds by species, and lists the elements of its own main matrix. A reaction that cannot be balanced gets its error, also in results,
+// where the compounds of each equation are kept.
+inline void CBU_Balancer::_parse_reaction_set(const std::vector<std::string>& equations, std::vector<CBU_Result>& results, std::vector<CBU_Composition>& compositions, std::vector<Set_reaction>& reactions) {
+    std::unordered_map<std::string_view, size_t> species_index; // views into the compounds kept in results
+    std::vector<CBU_Error> species_errors; // the parsing error of each species
+    std::vector<CBU_Composition> reactants_composition, products_composition;
+    std::pair<std::vector<std::string>, std::vector<std::string>> compounds_str;
+    reactions.assign(equations.size(), Set_reaction());
+    for (size_t r = 0; r < equations.size(); r++) {
+        Set_reaction& reaction = reactions[r];
+        CBU_Result& result = results[r];
+        reaction.error = CBU_Balancer::_get_compounds_str(equations[r], compounds_str);
+        result.reactants = std::move(compounds_str.first);
+        result.products = std::move(compounds_str.second);
+        if (reaction.error != CBU_Error::NONE) { result.error = this->_fail(reaction.error, equations[r]); continue; }
+
+        reaction.reactants_count = result.reactants.size();
+        reaction.species.reserve(result.reactants.size() + result.products.size());
+        for (size_t k = 0; k < result.reactants.size() + result.products.size() && reaction.error == CBU_Error::NONE; k++) {
+            const std::string& compound = (k < reaction.reactants_count) ? result.reactants[k] : result.products[k - reaction.reactants_count];
+            if (compound.empty()) { reaction.error = this->_fail(CBU_Error::INCOMPLETE_REACTANT, {}); break; }
+            const auto inserted = species_index.try_emplace(compound, compositions.size());
+            if (inserted.second) { // a new species
+                compositions.emplace_back();
+                species_errors.push_back(this->_get_compound_composition(compound, compositions.back()));
+            }
+            reaction.species.push_back(inserted.first->second);
+            if (species_errors[inserted.first->second] != CBU_Error::NONE) { reaction.error = this->_fail(species_errors[inserted.first->second], compound); }
+        }
+        if (reaction.error == CBU_Error::NONE) {
+            CBU_Balancer::_reaction_compositions(compositions, reaction, reactants_composition, products_composition);
+            reaction.error = this->_collect_elements(reactants_composition, products_composition, reaction.elements);
+        }
+        result.error = reaction.error;
+    }
+}
 
-    // Private methods
-    static bool _is_valid_char(const char& c);
-    static std::deque<std::string> _compound_str_separator(const std::string& compound_str);
-    static std::pair<std::string, unsigned> _entity_str_to_entity_and_coef(const std::string& entity_str);
-    static std::map<std::string, unsigned> _get_compound_composition(const std::string& compound_str);
-    static std::vector<std::string> get_elements_from_compounds_composition(const std::vector<std::map<std::string, unsigned>>& compounds_composition);
-    static std::vector<std::vector<unsigned>> _build_matrix(const std::vector<std::map<std::string, unsigned>>& compounds_composition, const std::vector<std::string>& elements);
-    bool _solving_matrix_using_recursion(std::vector<unsigned>& coefficients_temporary, size_t floor);
+// This method copies the compositions of the compounds of a reaction (reactants then products) out of the species table of its reaction set
+inline void CBU_Balancer::_reaction_compositions(const std::vector<CBU_Composition>& compositions, const Set_reaction& reaction,
+                                                 std::vector<CBU_Composition>& reactants_composition, std::vector<CBU_Composition>& products_composition) {
+    reactants_composition.resize(reaction.reactants_count);
+    products_composition.resize(reaction.species.size() - reaction.reactants_count);
+    for (size_t k = 0; k < reaction.species.size(); k++) {
+        (k < reaction.reactants_count ? reactants_composition[k] : products_composition[k - reaction.reactants_count]) = compositions[reaction.species[k]];
+    }
+}
 
-    //// Math tools
-    static bool _are_linear_dependent(const std::vector<unsigned>& a, const std::vector<unsigned>& b);
-    void _filter_linear_independent_results();
+// This method solves the main matrix with the chosen solver (see CBU_Solver), block by block if it has been presolved (only for the enumerating solvers, see _presolve)
+inline CBU_Error CBU_Balancer::_solve_matrix() {
+    CBU_Error error = CBU_Error::NONE;
+    if (this->_options.solver == CBU_Solver::NULLSPACE) {
+        error = CBU_Balancer::_solving_matrix_using_nullspace();
+    } else if (this->_options.solver == CBU_Solver::HILBERT_BASIS) {
+        error = CBU_Balancer::_solving_matrix_using_hilbert_basis();
+    } else if (this->_options.solver == CBU_Solver::MODULAR_NULLSPACE) {
+        error = CBU_Balancer::_solving_matrix_using_modular_nullspace();
+    } else if (this->_presolve_blocks.empty()) {
+        this->_search_matrix(this->_main_matrix, this->_options.log_status);
+    } else {
+        this->_solve_presolve_blocks();
+    }
+    return (error == CBU_Error::NONE) ? error : this->_fail(error, {});
+}
 
-    //// String tools
-    static std::string _remove_spaces(const std::string& str);
-    static std::pair<std::string, std::string> _get_reactants_and_products_str(const std::string& equation);
-    static std::vector<std::string> _separate_half_equation(const std::string& half_equation);
-    static std::pair<std::vector<std::string>,std::vector<std::string>> _get_compounds_str(const std::string& equation);
-    void _balance_with_given_compounds_str(const std::vector<std::string>& reactants, const std::vector<std::string>& products);
-public:
-    // Constructors, getters and setters
-    CBU_Balancer() : _multiple_results(true), _max_coef(DEFAULT_MAX_COEF), _log_status(true), _reactants_and_products(),_elements(),_main_matrix(), _results_coefs() { };
-    void set_multiple_results(bool option) { this->_multiple_results = option; }
-    void set_max_coef(unsigned max_coef) { this->_max_coef = max_coef;  }
-    void set_log_status(bool option) { this->_log_status = option; };
-    // Public interfaces
-    void balance_with_given_compounds(const std::vector<std::string>& reactants, const std::vector<std::string>& products) { // alias
-        _balance_with_given_compounds_str(reactants, products);
+// This method searches a matrix (the main matrix or a presolved block) with the chosen enumerating solver, and logs the results it finds if log_status is set
+inline void CBU_Balancer::_search_matrix(const CBU_Matrix& matrix, bool log_status) {
+    if (this->_options.solver == CBU_Solver::PRUNED_RECURSION) {
+        CBU_Balancer::_solving_matrix_using_pruned_recursion(matrix, log_status);
+    } else if (this->_options.solver == CBU_Solver::PARALLEL_RECURSION) {
+        CBU_Balancer::_solving_matrix_using_parallel_recursion(matrix, log_status);
+    } else { // brute force
+        CBU_Balancer::_solving_matrix_using_recursion(matrix, log_status);
     }
-    void balance(const std::string& equation);
-    // Common getters
-    std::pair<std::vector<std::string>, std::vector<std::string>> get_reactants_and_products() { return this->_reactants_and_products; }
-    std::pair<std::vector<std::string>, std::vector<std::vector<int>>> get_main_matrix() { return {this->_elements, this->_main_matrix}; };
-    [[nodiscard]] std::string get_result() const;
-    void clear_data();
-    static std::string version();
-};
+}
 
-// This method checks if a character (const char &c) is valid in a chemical equation
-inline bool CBU_Balancer::_is_valid_char(const char& c) {
-    return std::isupper(c) || std::islower(c) || std::isdigit(c) || (c == '(') || (c == ')');
+// This method solves each presolved block with the chosen solver and combines their results into the results of the main matrix, exactly as the solver would find them on the whole matrix.
+// A result of the whole matrix is a balanced coefficient vector of each block (not necessarily primitive) whose union is primitive, so each block lists every balanced vector (see _expand_block_results).
+// With a single result, the first result of the whole matrix is made of the first vector of each block.
+inline void CBU_Balancer::_solve_presolve_blocks() {
+    const size_t compounds_count = this->_main_matrix.columns();
+    const size_t blocks_count = this->_presolve_blocks.size();
+    std::vector<std::vector<unsigned>>& spare_results = this->_workspace.spare_results;
+    std::vector<std::vector<std::vector<unsigned>>>& blocks_results = this->_workspace.blocks_results;
+    if (blocks_results.size() < blocks_count) { blocks_results.resize(blocks_count); }
+    for (size_t b = 0; b < blocks_count; b++) { CBU_Balancer::_resize_keeping(blocks_results[b], 0, spare_results); } // the vectors of the previous equation
+    for (size_t b = 0; b < blocks_count; b++) {
+        Presolve_block& block = this->_presolve_blocks[b];
+        this->_max_coefs.clear();
+        for (const auto& compounds : block.compounds) {
+            this->_max_coefs.push_back(static_cast<unsigned>(compounds.size()) * this->_options.max_coef); // the sum of the merged coefficients
+        }
+        CBU_Balancer::_resize_keeping(this->_results_coefs, 0, spare_results);
+        this->_search_matrix(block.matrix, false); // the results of a block are not results of the equation
+        this->_expand_block_results(block, this->_results_coefs, compounds_count, blocks_results[b]);
+        if (blocks_results[b].empty()) { break; } // no result at all
+    }
+    this->_max_coefs.clear();
+    CBU_Balancer::_resize_keeping(this->_results_coefs, 0, spare_results);
+    for (size_t b = 0; b < blocks_count; b++) {
+        if (blocks_results[b].empty()) { return; }
+    }
+
+    std::vector<unsigned>& result = this->_workspace.coefficients;
+    if (!this->_options.multiple_results) { // the smallest vector of each block
+        result.assign(compounds_count, 0);
+        for (size_t b = 0; b < blocks_count; b++) {
+            const auto& first = *std::min_element(blocks_results[b].begin(), blocks_results[b].end());
+            for (size_t j = 0; j < compounds_count; j++) { result[j] += first[j]; }
+        }
+        this->_push_result(this->_results_coefs, result);
+        return;
+    }
+
+    thread_local std::vector<size_t> choice; // every combination of one vector per block
+    choice.assign(blocks_count, 0);
+    result.resize(compounds_count);
+    while (true) {
+        std::fill(result.begin(), result.end(), 0);
+        for (size_t b = 0; b < blocks_count; b++) {
+            for (size_t j = 0; j < compounds_count; j++) { result[j] += blocks_results[b][choice[b]][j]; }
+        }
+        if (CBU_Balancer::_is_primitive(result)) { this->_push_result(this->_results_coefs, result); }
+
+        size_t b = blocks_count;
+        while (b > 0 && choice[b - 1] + 1 == blocks_results[b - 1].size()) { choice[--b] = 0; }
+        if (b == 0) { break; }
+        choice[b - 1]++;
+    }
+    std::sort(this->_results_coefs.begin(), this->_results_coefs.end()); // the order of the recursion
+    if (this->_options.log_status) {
+        for (size_t i = 0; i < this->_results_coefs.size(); i++) { this->_report(CBU_Severity::LOG, "A possible result found. "); }
+    }
 }
 
-// This method takes a compound string (const std::string &compound_str) as input and returns the chemical entity strings (i.e., chemical entity + coefficients strings) in the compound.
-HAS_EXCEPTIONS
-std::deque<std::string> CBU_Balancer::_compound_str_separator(const std::string& compound_str) {
-    try {
-        std::deque<std::string> compound_separated; // Note: CaSO4 will be separated into ["Ca", "SO4"] and stored here
-        int in_parentheses = 0;
+// This method turns the (primitive) results of a presolved block into every balanced coefficient vector of its compounds, i.e., each multiple of a result within the coefficient limits,
+// and each way to split the coefficient of a merged column among its compounds (each in [1, max_coef]). The vectors are over every compound of the equation (0 outside the block).
+inline void CBU_Balancer::_expand_block_results(const Presolve_block& block, const std::vector<std::vector<unsigned>>& results, size_t compounds_count, std::vector<std::vector<unsigned>>& expanded) {
+    const unsigned long long max_coef = this->_options.max_coef;
+    const size_t columns_count = block.compounds.size();
+    std::vector<std::vector<unsigned>>& spare_results = this->_workspace.spare_results; // the vectors are stored in dropped results
+    thread_local std::vector<unsigned> multiple, coefficients;
+    multiple.resize(columns_count);
+    coefficients.assign(compounds_count, 0);
 
-        for (const auto& c : compound_str) {
-            if (!_is_valid_char(c)) { throw std::runtime_error("INVALID_CHAR"); }
+    // column k gives remaining to its compounds from part on
+    auto split = [&](auto& self, size_t k, size_t part, unsigned long long remaining) -> void {
+        if (k == columns_count) { CBU_Balancer::_push_spare_result(expanded, coefficients, spare_results); return; }
+        const std::vector<size_t>& compounds = block.compounds[k];
+        const unsigned long long others = compounds.size() - part - 1;
+        if (others == 0) {
+            if (remaining < 1 || remaining > max_coef) { return; }
+            coefficients[compounds[part]] = static_cast<unsigned>(remaining);
+            if (k + 1 < columns_count) { self(self, k + 1, 0, multiple[k + 1]); }
+            else { self(self, k + 1, 0, 0); }
+            return;
+        }
+        for (unsigned long long c = 1; c <= max_coef && c + others <= remaining; c++) {
+            if (remaining - c > others * max_coef) { continue; }
+            coefficients[compounds[part]] = static_cast<unsigned>(c);
+            self(self, k, part + 1, remaining - c);
+        }
+    };
 
-            if (c == '(') {
-                in_parentheses++;
-                if (in_parentheses == 1) { compound_separated.emplace_back(1, c); continue; } // 'actually' not in parentheses
+    for (const auto& result : results) {
+        for (unsigned long long factor = 1; ; factor++) {
+            bool fits = true;
+            for (size_t k = 0; k < columns_count; k++) {
+                const unsigned long long value = factor * result[k];
+                fits &= (value <= block.compounds[k].size() * max_coef);
+                multiple[k] = static_cast<unsigned>(value);
             }
+            if (!fits) { break; }
+            split(split, 0, 0, multiple[0]);
+        }
+    }
+}
+
+// These methods time the recent equation and its stages (one clock read at each boundary), and record them in the stats
+inline void CBU_Balancer::_begin_equation() {
+    CBU_STATS(this->_equation_begin_ns = this->_stage_begin_ns = CBU_Stats::now_ns(); this->_equation_nodes_begin = this->_stats.nodes;)
+}
 
-            if (in_parentheses == 0) {
-                if (std::isupper(c)) { compound_separated.emplace_back(1, c); continue; } // compound_separated.emplace_back(std::string(1, c));
+inline void CBU_Balancer::_end_stage(CBU_Stage stage) {
+    CBU_STATS(
+        const uint64_t now = CBU_Stats::now_ns();
+        this->_stats.stage_ns[static_cast<size_t>(stage)] += now - this->_stage_begin_ns;
+        this->_stage_begin_ns = now;
+    )
+    (void)stage;
+}
 
-                // c is not a capital letter.
-                if (!compound_separated.empty()) {
-                    if (std::islower(c) || std::isdigit(c)) { compound_separated.back() += c; }
-                    else { throw std::runtime_error(compound_str + ": " + "UNMATCHED_PARENTHESES"); }
-                } else { throw std::runtime_error("INVALID_CHAR_OR_CHAR_POSITION");  } // for example, compound_str == "c26" or ")CO2"
-            }
+inline void CBU_Balancer::_end_equation(CBU_Error error) { // the equation ends with its last stage
+    CBU_STATS(this->_stats.add_equation(error, this->_stage_begin_ns - this->_equation_begin_ns, this->_stats.nodes - this->_equation_nodes_begin);)
+    (void)error;
+}
 
-            else if (in_parentheses > 0) { // in_parentheses
-                if (c == ')') { in_parentheses--; }
+// This method is used to generate balancing result from given compounds (and records the equation in the stats)
+inline CBU_Error CBU_Balancer::_balance_with_given_compounds_str(const std::vector<std::string>& reactants, const std::vector<std::string>& products) {
+    CBU_Error error = this->_balance_stages(reactants, products);
+    this->_end_equation(error);
+    return error;
+}
 
-                if (!compound_separated.empty()) { compound_separated.back() += std::string(1, c); }
-                else { throw std::runtime_error("EMPTY_CONTAINER"); }
-            }
+// This method runs the balancing stages on given compounds (and times each stage)
+// Processing of complex compounds is included
+inline CBU_Error CBU_Balancer::_balance_stages(const std::vector<std::string>& reactants, const std::vector<std::string>& products) {
+    if (reactants.empty() || products.empty()) { return this->_fail(CBU_Error::EMPTY_COMPOUND_LIST, {}); }
 
-            else { throw std::runtime_error("UNMATCHED_PARENTHESES"); } // in_parentheses < 0
+    std::pair<std::vector<std::string>, std::vector<std::string>>& stored = this->_reactants_and_products;
+    if (&reactants != &stored.first || &products != &stored.second) { // else balance has already stored them
+        if (&reactants == &stored.first || &reactants == &stored.second || &products == &stored.first || &products == &stored.second) {
+            std::pair<std::vector<std::string>, std::vector<std::string>> copies(reactants, products); // a stored vector is given (e.g., from get_reactants_and_products), so it is read before it is overwritten
+            stored = std::move(copies);
+        } else {
+            stored.first = reactants;
+            stored.second = products;
         }
+    }
+
+    // Initialization && parse (of the stored compounds, which the given ones may no longer be)
+    std::vector<CBU_Composition>& reactants_composition = this->_workspace.reactants_composition;
+    std::vector<CBU_Composition>& products_composition = this->_workspace.products_composition;
+    std::vector<unsigned>& elements = this->_workspace.elements;
+    CBU_Error error = this->_parse_compounds(stored.first, stored.second, reactants_composition, products_composition, elements);
+    this->_end_stage(CBU_Stage::PARSE);
+    if (error != CBU_Error::NONE) { return error; }
+    if (this->_options.result_cache) { return this->_balance_through_result_cache(stored.first, stored.second, reactants_composition, products_composition, elements); }
+    return this->_balance_compositions(reactants_composition, products_composition, elements);
+}
+
+// This method builds the main matrix of parsed compounds and balances it (the stages after parsing)
+inline CBU_Error CBU_Balancer::_balance_compositions(const std::vector<CBU_Composition>& reactants_composition, const std::vector<CBU_Composition>& products_composition, const std::vector<unsigned>& elements) {
+    this->_build_stage(reactants_composition, products_composition, elements);
+    return this->_balance_main_matrix();
+}
+
+// This method runs the build stage: it saves the elements and builds the main matrix of parsed compounds
+inline void CBU_Balancer::_build_stage(const std::vector<CBU_Composition>& reactants_composition, const std::vector<CBU_Composition>& products_composition, const std::vector<unsigned>& elements) {
+    this->_elements.clear();
+    for (const auto& element : elements) { this->_elements.emplace_back(CBU_Elements::symbol(element)); } // save to private member
+
+    // Build matrix
+    this->_build_main_matrix(reactants_composition, products_composition, elements); // save to private member
+    this->_end_stage(CBU_Stage::BUILD);
+    CBU_STATS(
+        this->_stats.peak_rows = std::max(this->_stats.peak_rows, elements.size());
+        this->_stats.peak_columns = std::max(this->_stats.peak_columns, reactants_composition.size() + products_composition.size());
+    )
+}
+
+// This method runs the presolve, solve and filter stages on the main matrix
+inline CBU_Error CBU_Balancer::_balance_main_matrix() {
+    // Presolve
+    this->_presolve();
+    this->_end_stage(CBU_Stage::PRESOLVE);
 
-        if (in_parentheses) { throw std::runtime_error("UNMATCHED_PARENTHESES"); }
+    // Balancing
+    CBU_Error error = this->_solve_matrix();
+    this->_end_stage(CBU_Stage::SOLVE);
+    CBU_STATS(this->_stats.solutions_found += this->_results_coefs.size();)
+    if (error != CBU_Error::NONE) { return error; }
+    CBU_STATS(const size_t found = this->_results_coefs.size();)
+    CBU_Balancer::_filter_linear_independent_results(); // here will be faster
+    this->_end_stage(CBU_Stage::FILTER);
+    CBU_STATS(this->_stats.solutions_filtered += found - this->_results_coefs.size();)
 
-        return compound_separated;
-    } catch (std::runtime_error &re) {
-        std::cerr << re.what() << std::endl;
-        return {};
+    if (this->_results_coefs.empty()) {
+        return this->_fail(CBU_Error::FAILED_TO_BALANCE, {});
     }
+    return CBU_Error::NONE;
 }
 
-// This method converts a chemical entity string into an std::pair of <chemical entity, coefficient>.
-HAS_EXCEPTIONS
-inline std::pair<std::string, unsigned> CBU_Balancer::_entity_str_to_entity_and_coef(const std::string& entity_str) {
-    try {
-        if (entity_str.empty()) {
-            throw std::runtime_error("EMPTY_ENTITY_STR");
-        }
+// This method gives the key of given compounds in a CBU_Result_cache: the settings that change the results, then the equation with its compounds sorted within each side (':'),
+// or in the given order ('|'). order[k] is the given position (reactants then products) of the k-th compound of the key.
+inline std::string CBU_Balancer::_result_cache_key(const std::vector<std::string>& reactants, const std::vector<std::string>& products, bool sorted, std::vector<size_t>& order) const {
+    static const char solver_keys[] = {'R', 'R', 'R', 'N', 'H', 'M'}; // by CBU_Solver (the recursions find the same results)
+    std::string key(1, solver_keys[static_cast<size_t>(this->_options.solver)]);
+    key += this->_options.multiple_results ? '*' : '1';
+    key += std::to_string(this->_options.max_coef) + (sorted ? ':' : '|');
 
-        bool is_subcompound = (entity_str[0] == '(');
-        int separating_index = -1; // the beginning position index of the coefficient
+    const size_t reactants_count = reactants.size();
+    auto compound = [&](size_t k) -> const std::string& { return k < reactants_count ? reactants[k] : products[k - reactants_count]; };
+    order.resize(reactants_count + products.size());
+    std::iota(order.begin(), order.end(), 0);
+    if (sorted) {
+        auto by_compound = [&](size_t a, size_t b) { return compound(a) < compound(b); };
+        std::stable_sort(order.begin(), order.begin() + static_cast<std::ptrdiff_t>(reactants_count), by_compound);
+        std::stable_sort(order.begin() + static_cast<std::ptrdiff_t>(reactants_count), order.end(), by_compound);
+    }
+    for (size_t k = 0; k < order.size(); k++) {
+        if (k > 0) { key += (k == reactants_count) ? "->" : "+"; }
+        key += compound(order[k]);
+    }
+    return key;
+}
 
-        if (std::isdigit(entity_str[entity_str.size() - 1])) {
-            for (size_t index = entity_str.size() - 1; index >= 0; index--) {
-                if (!isdigit(entity_str[index])) {
-                    separating_index = static_cast<int>(index) + 1;
-                    break;
-                }
-            }
+// This method checks if the results of the main matrix do not depend on the order of its compounds: its nullspace has at most one basis vector,
+// so there is one primitive result at most, whichever the solver (false if the elimination overflows).
+inline bool CBU_Balancer::_has_order_independent_results() const {
+    thread_local std::vector<std::vector<int64_t>> basis; // reused by every check on this thread
+    const bool sparse = !this->_sparse_matrix.empty();
+    return (sparse ? CBU_Balancer::_sparse_integer_nullspace(this->_sparse_matrix, basis) : CBU_Balancer::_integer_nullspace(this->_main_matrix, basis)) && basis.size() <= 1;
+}
+
+// This method balances parsed compounds through the result cache (the stages after parsing). A hit only builds the main matrix, and a miss is balanced by _balance_compositions and then cached,
+// so the results are always those of _balance_compositions.
+// An equation whose results do not depend on the order of its compounds (see _has_order_independent_results) is cached under its sorted key, with its results in that order,
+// and a hit puts them back in the given order, so "O2+H2->H2O" hits the results of "H2+O2->H2O". Any other equation (several independent results, whose combination and order
+// depend on the order of the compounds) is cached under its key in the given order.
+inline CBU_Error CBU_Balancer::_balance_through_result_cache(const std::vector<std::string>& reactants, const std::vector<std::string>& products,
+                                                             const std::vector<CBU_Composition>& reactants_composition, const std::vector<CBU_Composition>& products_composition, const std::vector<unsigned>& elements) {
+    CBU_Result_cache& result_cache = *this->_options.result_cache;
+    std::vector<size_t> order, given_order;
+    const std::string sorted_key = this->_result_cache_key(reactants, products, true, order);
+    const std::string given_key = this->_result_cache_key(reactants, products, false, given_order);
+    const size_t columns = order.size();
+    CBU_Error error = CBU_Error::NONE;
+    std::vector<std::vector<unsigned>> results;
+    const bool sorted_hit = result_cache.find(sorted_key, columns, error, results, false);
+    if (sorted_hit) { // back in the given order
+        this->_results_coefs.assign(results.size(), std::vector<unsigned>(columns));
+        for (size_t r = 0; r < results.size(); r++) {
+            for (size_t k = 0; k < columns; k++) { this->_results_coefs[r][order[k]] = results[r][k]; }
         }
+    }
+    if (sorted_hit || result_cache.find(given_key, columns, error, this->_results_coefs)) {
+        this->_build_stage(reactants_composition, products_composition, elements);
+        this->_end_stage(CBU_Stage::SOLVE);
+        return (error == CBU_Error::NONE) ? error : this->_fail(error, {});
+    }
 
-        std::pair <std::string, unsigned> entity_and_coefficient;
+    error = this->_balance_compositions(reactants_composition, products_composition, elements);
+    if (!CBU_Result_cache::is_cacheable(error)) { return error; }
+    if (!this->_has_order_independent_results()) {
+        result_cache.insert(given_key, error, this->_results_coefs, columns);
+        return error;
+    }
+    results.assign(this->_results_coefs.size(), std::vector<unsigned>(columns));
+    for (size_t r = 0; r < results.size(); r++) {
+        for (size_t k = 0; k < columns; k++) { results[r][k] = this->_results_coefs[r][order[k]]; }
+    }
+    result_cache.insert(sorted_key, error, results, columns);
+    return error;
+}
 
-        // To enhance readability, these conditional statements will not be shortened by the ternary operator (?:).
-        if (!is_subcompound) {
-            if (separating_index == -1) { // coef = 1
-                entity_and_coefficient.first = entity_str;
-                entity_and_coefficient.second = 1;
-            } else {
-                entity_and_coefficient.first = entity_str.substr(0, separating_index);
-                entity_and_coefficient.second = std::stoi(entity_str.substr(separating_index, entity_str.size() - separating_index));
-            }
-        } else { // is_subcompound (within parentheses)
-            if (separating_index == -1) { // coef = 1
-                entity_and_coefficient.first = entity_str.substr(1, entity_str.size() - 2);
-                entity_and_coefficient.second = 1;
-            } else {
-                entity_and_coefficient.first = entity_str.substr(1, separating_index - 2);
-                entity_and_coefficient.second = std::stoi(entity_str.substr(separating_index, entity_str.size() - separating_index));
-            }
+// Main balance method
+inline void CBU_Balancer::balance(const std::string &equation) {
+    this->_begin_equation();
+    this->_clear_equation();
+    CBU_Error error = _get_compounds_str(equation, this->_reactants_and_products); // into the stored compounds, whose strings are reused
+    if (error != CBU_Error::NONE) {
+        CBU_Balancer::_resize_keeping(this->_reactants_and_products.first, 0, CBU_Balancer::_spare_compounds_str());
+        CBU_Balancer::_resize_keeping(this->_reactants_and_products.second, 0, CBU_Balancer::_spare_compounds_str());
+        this->_end_stage(CBU_Stage::PARSE);
+        this->_end_equation(this->_fail(error, equation));
+        return;
+    }
+    _balance_with_given_compounds_str(this->_reactants_and_products.first, this->_reactants_and_products.second);
+}
+
+// This method moves the stored balancing data (and the stats) into a CBU_Result, leaving the balancer cleared.
+inline CBU_Result CBU_Balancer::_take_result() {
+    CBU_Result result;
+    result.reactants = std::move(this->_reactants_and_products.first);
+    result.products = std::move(this->_reactants_and_products.second);
+    result.elements = std::move(this->_elements);
+    result.main_matrix = this->_sparse_matrix.empty() ? std::move(this->_main_matrix) : this->_sparse_matrix.to_dense();
+    result.coefficients = std::move(this->_results_coefs);
+    result.error = this->_error;
+    result.stats = this->_stats;
+    this->clear_data();
+    this->reset_stats();
+    return result;
+}
+
+// These methods balance an equation (or given compounds) and return its balancing data, without touching the data stored in this balancer.
+// They only read the settings, so one balancer can serve many threads at the same time. The static ones take the settings as options.
+inline CBU_Result CBU_Balancer::solve(const std::string& equation, const CBU_Options& options) {
+    CBU_Balancer balancer(options); // lives on this thread's stack only
+    balancer.balance(equation);
+    return balancer._take_result();
+}
+
+inline CBU_Result CBU_Balancer::solve_with_given_compounds(const std::vector<std::string>& reactants, const std::vector<std::string>& products, const CBU_Options& options) {
+    CBU_Balancer balancer(options);
+    balancer.balance_with_given_compounds(reactants, products);
+    return balancer._take_result();
+}
+
+// This method balances many equations on several threads (set_thread_count) and returns their balancing data in the given order.
+// Each thread keeps one balancer (a copy of this one's settings) and reuses it for every equation it takes. The data stored in this balancer is not touched.
+inline std::vector<CBU_Result> CBU_Balancer::balance_batch(const std::vector<std::string>& equations) const {
+    std::vector<CBU_Result> results(equations.size());
+    const unsigned hardware_threads = std::max(1u, std::thread::hardware_concurrency());
+    const size_t thread_count = std::min<size_t>((this->_options.thread_count != 0) ? this->_options.thread_count : hardware_threads, equations.size());
+    std::atomic<size_t> next_equation(0);
+
+    auto worker = [&]() {
+        CBU_Balancer balancer = *this;
+        balancer.clear_data();
+        balancer.reset_stats(); // each result has the stats of its own equation
+        balancer.set_thread_count(1); // the parallelism is across equations
+        for (size_t i = next_equation++; i < equations.size(); i = next_equation++) {
+            balancer.balance(equations[i]);
+            results[i] = balancer._take_result();
         }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t id = 1; id < thread_count; id++) { threads.emplace_back(worker); }
+    worker();
+    for (auto& thread : threads) { thread.join(); }
+    return results;
+}
+
+// This method balances a set of related reactions (e.g., the steps of a mechanism) and returns their balancing data in the given order, one CBU_Result per equation.
+// Each species (a distinct compound) is parsed only once into the species table of the set, so the parsing cost grows with the species rather than with the compounds written.
+// By default, each reaction is balanced on its own (its block of the block-diagonal main matrix of the set) and gets the stats of its own equation, the first one with the parsing.
+// With couple_intermediates, a species that is a product of one reaction and a reactant of another takes the same coefficient in every reaction, and the set is balanced as one equation
+// (see _balance_coupled_set), so every result has the stats of the whole set. The data stored in this balancer is not touched.
+inline std::vector<CBU_Result> CBU_Balancer::balance_set(const std::vector<std::string>& equations, bool couple_intermediates) const {
+    std::vector<CBU_Result> results(equations.size());
+    CBU_Balancer balancer = *this;
+    balancer.clear_data();
+    balancer.reset_stats();
+    balancer._begin_equation();
+    std::vector<CBU_Composition> compositions;
+    std::vector<Set_reaction> reactions;
+    balancer._parse_reaction_set(equations, results, compositions, reactions);
+    balancer._end_stage(CBU_Stage::PARSE);
+    if (couple_intermediates) {
+        balancer._balance_coupled_set(compositions, reactions, results);
+        return results;
+    }
 
-        if (!is_subcompound && entity_and_coefficient.first.size() >= 3) {
-            std::cout << ("WARNING: special element \"" + entity_and_coefficient.first + "\", the equation may not exist.") << std::endl;
+    std::vector<CBU_Composition> reactants_composition, products_composition;
+    for (size_t r = 0; r < reactions.size(); r++) {
+        if (r > 0) { balancer._begin_equation(); }
+        balancer._reactants_and_products = {std::move(results[r].reactants), std::move(results[r].products)};
+        balancer._error = reactions[r].error;
+        CBU_Error error = reactions[r].error;
+        if (error == CBU_Error::NONE) {
+            CBU_Balancer::_reaction_compositions(compositions, reactions[r], reactants_composition, products_composition);
+            error = balancer._balance_compositions(reactants_composition, products_composition, reactions[r].elements);
         }
+        balancer._end_equation(error);
+        results[r] = balancer._take_result();
+    }
+    return results;
+}
 
-        return entity_and_coefficient;
-    } catch (const std::invalid_argument &ia) {
-        std::cerr << ia.what() << std::endl;
-        return {};
-    } catch (const std::out_of_range &oor) {
-        std::cerr << oor.what() << std::endl;
-        return {};
-    } catch (const std::runtime_error &re) {
-        std::cerr << re.what() << std::endl;
-        return {};
+// This method balances a coupled reaction set as one equation: its block-structured main matrix (see _build_coupled_matrix) goes through the presolve, solve and filter stages,
+// so each result is primitive over the whole set, and it is cut into the coefficients of each reaction. If a reaction has an error, the others get CBU_Error::NO_RESULT.
+inline void CBU_Balancer::_balance_coupled_set(const std::vector<CBU_Composition>& compositions, const std::vector<Set_reaction>& reactions, std::vector<CBU_Result>& results) {
+    const bool parsed = std::all_of(reactions.begin(), reactions.end(), [](const Set_reaction& reaction) { return reaction.error == CBU_Error::NONE; });
+    CBU_Error error = CBU_Error::NO_RESULT;
+    if (parsed) {
+        this->_build_coupled_matrix(compositions, reactions);
+        this->_end_stage(CBU_Stage::BUILD);
+        CBU_STATS(
+            const bool sparse = !this->_sparse_matrix.empty();
+            this->_stats.peak_rows = std::max(this->_stats.peak_rows, sparse ? this->_sparse_matrix.rows() : this->_main_matrix.rows());
+            this->_stats.peak_columns = std::max(this->_stats.peak_columns, sparse ? this->_sparse_matrix.columns() : this->_main_matrix.columns());
+        )
+        error = this->_balance_main_matrix();
     }
-} // .first is the entity, .second is its coefficient
+    this->_end_equation(error);
 
-// This method takes a compound string as input and outputs a std::map that records the coefficient of each element in the compound.
-// The compound string must be valid, or there will be exceptions.
-HAS_EXCEPTIONS
-std::map<std::string, unsigned> CBU_Balancer::_get_compound_composition(const std::string& compound_str) {
-    try {
-        std::deque<std::string> entities_str = CBU_Balancer::_compound_str_separator(compound_str); // Note: CaSO4 will be separated into ["Ca", "SO4"] and stored here
-        if (entities_str.empty()) { throw std::runtime_error("INVALID_COMPOUND"); }
+    std::vector<CBU_Composition> reactants_composition, products_composition;
+    size_t column = 0;
+    for (size_t r = 0; r < reactions.size(); r++) {
+        const Set_reaction& reaction = reactions[r];
+        CBU_Result& result = results[r];
+        if (result.error == CBU_Error::NONE) { result.error = error; }
+        if (reaction.error == CBU_Error::NONE) {
+            CBU_Balancer::_reaction_compositions(compositions, reaction, reactants_composition, products_composition);
+            CBU_Balancer::_build_matrix(reactants_composition, products_composition, reaction.elements, result.main_matrix);
+            for (const auto& element : reaction.elements) { result.elements.emplace_back(CBU_Elements::symbol(element)); }
+        }
+        if (error == CBU_Error::NONE) {
+            for (const auto& solution : this->_results_coefs) { result.coefficients.emplace_back(solution.begin() + column, solution.begin() + column + reaction.species.size()); }
+        }
+        column += reaction.species.size();
+        result.stats = this->_stats;
+    }
+}
 
-        std::map<std::string, unsigned> composition; // elements and their counts in [current] compound
+// These methods start a lazy search over an equation (see CBU_Generator). The static one takes the settings as options.
+inline CBU_Generator CBU_Balancer::generate(const std::string& equation, const CBU_Options& options, const CBU_Limits& limits) {
+    return CBU_Generator(equation, options, limits);
+}
 
-        for (const auto& entity_str : entities_str) {
-            std::pair<std::string, int> entity_and_coefficient = CBU_Balancer::_entity_str_to_entity_and_coef(entity_str);
+inline CBU_Generator CBU_Balancer::generate(const std::string& equation, const CBU_Limits& limits) const {
+    return CBU_Generator(equation, this->_options, limits);
+}
 
-            if (entity_str[0] == '(') {
-                std::map <std::string, unsigned> composition_subcompound = CBU_Balancer::_get_compound_composition(entity_and_coefficient.first);
-                for (const auto &cs : composition_subcompound) {
-                    composition[cs.first] += cs.second * entity_and_coefficient.second;
-                }
-            } else {
-                composition[entity_and_coefficient.first] += entity_and_coefficient.second;
-            }
-        }
-        return composition;
-    } catch (const std::runtime_error &re) {
-        std::cerr << re.what() << std::endl;
-        return {};
+// This constructor parses the equation and builds its main matrix and pruning bounds (the search itself starts with next)
+inline CBU_Generator::CBU_Generator(const std::string& equation, const CBU_Options& options, const CBU_Limits& limits) : _balancer(options) {
+    this->set_limits(limits);
+    CBU_Balancer& balancer = this->_balancer;
+    balancer._begin_equation();
+    CBU_Error error = CBU_Balancer::_get_compounds_str(equation, balancer._reactants_and_products);
+    std::vector<CBU_Composition> reactants_composition, products_composition;
+    std::vector<unsigned> elements;
+    if (error == CBU_Error::NONE && (balancer._reactants_and_products.first.empty() || balancer._reactants_and_products.second.empty())) { error = CBU_Error::EMPTY_COMPOUND_LIST; }
+    if (error == CBU_Error::NONE) {
+        error = balancer._parse_compounds(balancer._reactants_and_products.first, balancer._reactants_and_products.second, reactants_composition, products_composition, elements);
     }
+    balancer._end_stage(CBU_Stage::PARSE);
+    if (error != CBU_Error::NONE) {
+        balancer._end_equation(balancer._error == error ? error : balancer._fail(error, equation)); // _parse_compounds reports its own errors
+        this->_status = CBU_Search_status::COMPLETE;
+        return;
+    }
+    for (const auto& element : elements) { balancer._elements.emplace_back(CBU_Elements::symbol(element)); }
+    CBU_Balancer::_build_matrix(reactants_composition, products_composition, elements, balancer._main_matrix);
+    balancer._build_pruning_bounds(balancer._main_matrix, false, this->_bounds);
+    this->_coefficients.assign(balancer._main_matrix.columns(), 0);
+    this->_residual.assign(balancer._main_matrix.rows(), 0);
+    balancer._end_stage(CBU_Stage::BUILD);
+    CBU_STATS(
+        balancer._stats.peak_rows = balancer._main_matrix.rows();
+        balancer._stats.peak_columns = balancer._main_matrix.columns();
+    )
+}
+
+// This method sets the limits of the search from now on: the node budget counts from here, and a search that was cut off goes on
+inline void CBU_Generator::set_limits(const CBU_Limits& limits) {
+    this->_limits = limits;
+    this->_node_limit = (limits.node_budget != 0 && limits.node_budget <= UINT64_MAX - this->_nodes) ? this->_nodes + limits.node_budget : UINT64_MAX;
+    if (this->_status != CBU_Search_status::COMPLETE) { this->_status = CBU_Search_status::RUNNING; }
+}
+
+// This method checks the deadline and the cancel flag, and stops the search if one of them is reached
+inline bool CBU_Generator::_limit_reached() {
+    if (this->_limits.cancel != nullptr && this->_limits.cancel->load(std::memory_order_relaxed)) { this->_status = CBU_Search_status::CANCELLED; }
+    else if (this->_limits.deadline != std::chrono::steady_clock::time_point::max() && std::chrono::steady_clock::now() >= this->_limits.deadline) { this->_status = CBU_Search_status::DEADLINE; }
+    return this->_status != CBU_Search_status::RUNNING;
 }
 
-// This method takes a compound composition (std::map) vector (i.e., std::vector<std::map>) as input and outputs the elements list (sorted) in these compounds
-HAS_EXCEPTIONS
-std::vector<std::string>
-CBU_Balancer::get_elements_from_compounds_composition(const std::vector<std::map<std::string, unsigned>>& compounds_composition) {
-    try {
-        if (compounds_composition.empty()) {
-            throw std::runtime_error("EMPTY_CONTAINER");
+// This method searches for the next solution and stores it in coefficients (in the order of reactants then products).
+// It returns false if there is none before a limit is reached (see get_status), or if there is no more solution (CBU_Search_status::COMPLETE).
+inline bool CBU_Generator::next(std::vector<unsigned>& coefficients) {
+    if (this->_status != CBU_Search_status::RUNNING) { return false; }
+    CBU_Balancer& balancer = this->_balancer;
+    const CBU_Matrix& matrix = balancer._main_matrix;
+    const size_t compounds_count = matrix.columns();
+    const unsigned max_coef = balancer._options.max_coef;
+    auto move_up = [this, &matrix]() { // back to the previous floor, whose coefficient leaves the residual
+        this->_floor--;
+        for (size_t e = 0; e < this->_residual.size(); e++) { this->_residual[e] -= matrix[e][this->_floor] * static_cast<long long>(this->_coefficients[this->_floor]); }
+    };
+    CBU_STATS(balancer._stage_begin_ns = CBU_Stats::now_ns();) // the time between two calls is not search time
+
+    bool found = false;
+    for (uint64_t step = 0; !found; step++) {
+        if ((step & (GENERATOR_CHECK_INTERVAL - 1)) == 0 && this->_limit_reached()) { break; }
+
+        if (this->_floor == compounds_count) { // a leaf, where every residual is zero (guaranteed by the bounds)
+            CBU_STATS(balancer._stats.leaves++;)
+            found = CBU_Balancer::_is_primitive(this->_coefficients); // a multiple of a result is not a new result
+            if (found) { coefficients = this->_coefficients; }
+            move_up();
+            continue;
         }
 
-        std::set<std::string> elements_set;
-        for (const auto& compound_composition : compounds_composition) {
-            for (const auto& element : compound_composition) {
-                elements_set.insert(element.first);
+        // The next feasible coefficient on this floor (the order is the given one, so the column is the floor)
+        unsigned coefficient = this->_coefficients[this->_floor];
+        bool feasible = false;
+        while (coefficient < max_coef && !feasible) {
+            coefficient++;
+            bool exhausted;
+            feasible = CBU_Balancer::_pruning_check(matrix, this->_bounds, this->_residual, this->_floor, coefficient, exhausted);
+            if (!feasible) {
+                CBU_STATS(balancer._stats.prunes++;)
+                if (exhausted) { break; }
             }
         }
 
-        std::vector<std::string> elements = {elements_set.begin(), elements_set.end()};
-        std::sort(elements.begin(), elements.end());
-        return elements;
-    } catch (std::runtime_error &re) {
-        std::cerr << re.what() << std::endl;
-        return {};
+        if (feasible) { // down to the next floor
+            if (this->_nodes == this->_node_limit) { this->_status = CBU_Search_status::NODE_BUDGET; break; }
+            this->_nodes++;
+            CBU_STATS(balancer._stats.nodes++;)
+            this->_coefficients[this->_floor] = coefficient;
+            for (size_t e = 0; e < this->_residual.size(); e++) { this->_residual[e] += matrix[e][this->_floor] * static_cast<long long>(coefficient); }
+            if (++this->_floor < compounds_count) { this->_coefficients[this->_floor] = 0; }
+        } else { // every coefficient of this floor has been tried
+            this->_coefficients[this->_floor] = 0;
+            if (this->_floor == 0) { this->_status = CBU_Search_status::COMPLETE; break; }
+            move_up();
+        }
+    }
+
+    balancer._end_stage(CBU_Stage::SOLVE);
+    if (found) {
+        this->_solutions++;
+        CBU_STATS(balancer._stats.solutions_found++;)
+        return true;
     }
+    if (this->_status == CBU_Search_status::COMPLETE) { this->_finish(); }
+    return false;
 }
 
-// This method takes compounds composition (std::vector<std::map>) and elements list (std::vector) as input and outputs a matrix, where [the row is each element] and [the column is each compound].
-HAS_EXCEPTIONS
-std::vector<std::vector<unsigned>>
-CBU_Balancer::_build_matrix(const std::vector<std::map<std::string, unsigned>> &compounds_composition, const std::vector<std::string>& elements) {
-    try {
-        if (compounds_composition.empty() || elements.empty()) {
-            throw std::runtime_error("EMPTY_CONTAINER");
-        }
+// This method records the equation in the stats once the search is complete (FAILED_TO_BALANCE if there was no solution at all)
+inline void CBU_Generator::_finish() {
+    CBU_Error error = (this->_solutions == 0) ? this->_balancer._fail(CBU_Error::FAILED_TO_BALANCE, {}) : CBU_Error::NONE;
+    this->_balancer._end_equation(error);
+}
 
-        // 2D vector
-        std::vector<std::vector<unsigned>> matrix(elements.size(), std::vector<unsigned>(compounds_composition.size(), 0));
+// These methods start an editable equation (see CBU_Session), empty or with the compounds of an equation. The static ones take the settings as options.
+inline CBU_Session CBU_Balancer::session(const CBU_Options& options) {
+    return CBU_Session(options);
+}
 
-        for (size_t i = 0; i < elements.size(); i++) { // row: element
-            for (size_t j = 0; j < compounds_composition.size(); j++) { // column: compounds
-                matrix[i][j] = static_cast<int>(compounds_composition[j].count(elements[i]) ? compounds_composition[j].at(elements[i]) : 0);
-            }
-        }
+inline CBU_Session CBU_Balancer::session(const std::string& equation, const CBU_Options& options) {
+    return CBU_Session(equation, options);
+}
+
+inline CBU_Session CBU_Balancer::session() const {
+    return CBU_Session(this->_options);
+}
 
-        return matrix;
-    } catch (std::runtime_error &re) {
-        std::cerr << re.what() << std::endl;
-        return {};
+inline CBU_Session CBU_Balancer::session(const std::string& equation) const {
+    return CBU_Session(equation, this->_options);
+}
+
+inline CBU_Session::CBU_Session(const CBU_Options& options) : _balancer(options), _factored(options.solver == CBU_Solver::NULLSPACE) {
+    this->_balancer._error = CBU_Error::NO_RESULT;
+}
+
+// This constructor adds the compounds of an equation. If the equation or one of its compounds is invalid, the session stays empty and get_error tells why.
+inline CBU_Session::CBU_Session(const std::string& equation, const CBU_Options& options) : CBU_Session(options) {
+    std::pair<std::vector<std::string>, std::vector<std::string>> compounds_str;
+    CBU_Error error = CBU_Balancer::_get_compounds_str(equation, compounds_str);
+    if (error != CBU_Error::NONE) {
+        this->_balancer._fail(error, equation);
+        return;
+    }
+    for (const auto& reactant : compounds_str.first) { if (error == CBU_Error::NONE) { error = this->add_reactant(reactant); } }
+    for (const auto& product : compounds_str.second) { if (error == CBU_Error::NONE) { error = this->add_product(product); } }
+    if (error != CBU_Error::NONE) {
+        *this = CBU_Session(options);
+        this->_balancer._error = error;
     }
 }
 
-// This method is used to solve the matrix (where, the result is a std::vector<unsigned>) using recursion strategy. To the inputs, coefficients is a temporary vector and floor is the recursion floor.
-bool CBU_Balancer::_solving_matrix_using_recursion(std::vector<unsigned>& coefficients_temporary, size_t floor) {
-    if (floor == this->_main_matrix[0].size()) { // recursion end
-        bool balanced = true;
-        for (const auto& element :this->_main_matrix) {
-            int sum = 0;
-            for (size_t i = 0; i < coefficients_temporary.size(); i++) {
-                sum += static_cast<int>(coefficients_temporary[i]) * element[i];
-            }
-            if (sum != 0) { balanced = false; break; }
-        }
+// This method parses a compound and appends it to the reactants or the products. A new element gets a row first, and the compound is added to the reduced form as a new column.
+// An invalid compound is reported and not added (the equation is unchanged).
+inline CBU_Error CBU_Session::_add_compound(const std::string& compound, bool product) {
+    CBU_Composition composition;
+    CBU_Error error = compound.empty() ? CBU_Error::INCOMPLETE_REACTANT : this->_balancer._get_compound_composition(compound, composition);
+    if (error != CBU_Error::NONE) {
+        this->_balancer._report(CBU_Severity::ERROR, compound + ": " + std::string(CBU_Balancer::error_name(error)));
+        return error;
+    }
+    this->_edited();
 
-        if (balanced) {
-            if (this->_multiple_results && this->_log_status) {
-                std::clog << "A possible result found. " << std::endl;
-            }
-            if (this->_multiple_results || this->_results_coefs.empty()) {
-                this->_results_coefs.push_back(coefficients_temporary);
-            }
-            return true;
-        }
-        return false;
+    for (const auto& element : composition) {
+        if (this->_element_rows.find(element.first) == this->_element_rows.end()) { this->_add_element_row(element.first); }
     }
+    if (this->_factored) { this->_factored = this->_add_column(composition, product ? -1 : 1); }
+    (product ? this->_product_columns : this->_reactant_columns).push_back(this->_compositions.size());
+    (product ? this->_balancer._reactants_and_products.second : this->_balancer._reactants_and_products.first).push_back(compound);
+    this->_compositions.push_back(std::move(composition));
+    return CBU_Error::NONE;
+}
 
-    for (size_t i = 1; i <= this->_max_coef; i++) {
-        coefficients_temporary[floor] = i;
-        bool balanced = CBU_Balancer::_solving_matrix_using_recursion(coefficients_temporary, floor + 1);
-        if (balanced && !this->_multiple_results) { return true; }
+// This method removes a reactant or a product (by its index on its side), and its column from the reduced form. Returns false if there is no such compound.
+inline bool CBU_Session::_remove_compound(size_t index, bool product) {
+    std::vector<size_t>& columns = product ? this->_product_columns : this->_reactant_columns;
+    std::vector<std::string>& compounds = product ? this->_balancer._reactants_and_products.second : this->_balancer._reactants_and_products.first;
+    if (index >= columns.size()) { return false; }
+    this->_edited();
+
+    const size_t column = columns[index];
+    if (this->_factored) { this->_factored = this->_remove_column(column); }
+    this->_compositions.erase(this->_compositions.begin() + column);
+    columns.erase(columns.begin() + index);
+    compounds.erase(compounds.begin() + index);
+    for (auto* side : {&this->_reactant_columns, &this->_product_columns}) {
+        for (auto& other : *side) { if (other > column) { other--; } }
     }
+    return true;
+}
 
-    return false;
+// This method adds the row of a new element, which is zero in every column so far: a zero reduced row, and a new element row in the row operations
+inline void CBU_Session::_add_element_row(unsigned element) {
+    const size_t row = this->_element_rows.size();
+    this->_element_rows.emplace(element, row);
+    if (!this->_factored) { return; }
+    for (auto& operations : this->_transform) { operations.push_back(0); }
+    this->_transform.emplace_back(row + 1, 0);
+    this->_transform.back()[row] = 1;
+    this->_reduced.emplace_back(this->_compositions.size(), 0);
+    this->_pivots.push_back(SIZE_MAX);
 }
 
-// This method tests if two vectors are linear [dependent].
-inline bool CBU_Balancer::_are_linear_dependent(const std::vector<unsigned> &a, const std::vector<unsigned> &b) {
-    if (a.empty() || b.empty() || (a.size() != b.size())) { return false; }
-    double ratio = 0;
-    bool ratio_set = false;
+// This method appends the column of a compound to the reduced form. The column goes through the row operations (one product by _transform),
+// and if it is not a combination of the columns so far, one of the zero rows takes it as its pivot and it is eliminated from the other rows.
+// Returns false if a value overflows.
+inline bool CBU_Session::_add_column(const CBU_Composition& composition, int32_t sign) {
+    const size_t column = this->_compositions.size();
+    size_t pivot_row = SIZE_MAX;
+    for (size_t i = 0; i < this->_reduced.size(); i++) {
+        long long entry = 0;
+        for (const auto& element : composition) {
+            long long term;
+            if (!CBU_Balancer::_checked_mul(this->_transform[i][this->_element_rows[element.first]], static_cast<long long>(sign) * element.second, term) || !CBU_Balancer::_checked_add(entry, term, entry)) { return false; }
+        }
+        this->_reduced[i].push_back(entry);
+        if (this->_pivots[i] == SIZE_MAX && entry != 0 && (pivot_row == SIZE_MAX || std::llabs(entry) < std::llabs(this->_reduced[pivot_row][column]))) { pivot_row = i; }
+    }
+    if (pivot_row == SIZE_MAX) { return true; } // a free column
+    this->_pivots[pivot_row] = column;
+    return this->_eliminate(pivot_row, column);
+}
 
-    for (size_t i = 0; i < a.size(); i++) {
-        if (a[i] != 0) {
-            double current_ratio = static_cast<double>(b[i]) / static_cast<double>(a[i]);
-            if (!ratio_set) {
-                ratio = current_ratio;
-                ratio_set = true;
-            } else if (std::abs(ratio - current_ratio) > 1e-9) {
-                return false;
-            }
-        } else if (b[i] != 0) { // a[i] == 0 && b[i] != 0
-            return false;
+// This method removes a column from the reduced form. If it is the pivot of a row, another column of that row (a free one) takes its place and is eliminated from the other rows,
+// or else the row becomes a zero row. Returns false if a value overflows.
+inline bool CBU_Session::_remove_column(size_t column) {
+    bool fits = true;
+    const auto pivot = std::find(this->_pivots.begin(), this->_pivots.end(), column);
+    if (pivot != this->_pivots.end()) {
+        const size_t row = pivot - this->_pivots.begin();
+        const std::vector<long long>& reduced = this->_reduced[row];
+        size_t replacement = SIZE_MAX; // the smallest non-zero entry limits the growth of entries
+        for (size_t j = 0; j < reduced.size(); j++) {
+            if (j != column && reduced[j] != 0 && (replacement == SIZE_MAX || std::llabs(reduced[j]) < std::llabs(reduced[replacement]))) { replacement = j; }
         }
+        *pivot = replacement;
+        if (replacement != SIZE_MAX) { fits = this->_eliminate(row, replacement); }
     }
-    return true;
+    for (auto& reduced : this->_reduced) { reduced.erase(reduced.begin() + column); }
+    for (auto& other : this->_pivots) { if (other != SIZE_MAX && other > column) { other--; } }
+    return fits;
 }
 
-// This method removes linear dependent items.
-// Modifying private members
-void CBU_Balancer::_filter_linear_independent_results() {
-    if (this->_multiple_results && this->_log_status) { std::clog << "Filtering linear independent items" << std::endl; }
-
-    std::vector<std::vector<unsigned>> independent_results_coefs;
-    for (const auto& result : this->_results_coefs) {
-        bool independent = true;
-        if (!independent_results_coefs.empty()) {
-            for (const auto& confirmed_result : independent_results_coefs) {
-                if (CBU_Balancer::_are_linear_dependent(confirmed_result, result)) {
-                    independent = false;
-                }
+// This method eliminates a pivot column from every other row of the reduced form, with the fraction-free row operation of _integer_nullspace (applied to the row operations too),
+// and divides each changed row by the gcd of its entries. Returns false if a value overflows.
+inline bool CBU_Session::_eliminate(size_t pivot_row, size_t column) {
+    const long long pivot = this->_reduced[pivot_row][column];
+    for (size_t i = 0; i < this->_reduced.size(); i++) {
+        if (i == pivot_row || this->_reduced[i][column] == 0) { continue; }
+        const long long g = CBU_Balancer::_gcd(pivot, this->_reduced[i][column]);
+        const long long a = pivot / g;
+        const long long b = this->_reduced[i][column] / g;
+        long long content = 0;
+        for (auto* part : {&this->_reduced, &this->_transform}) {
+            std::vector<long long>& row = (*part)[i];
+            const std::vector<long long>& pivot_part = (*part)[pivot_row];
+            for (size_t j = 0; j < row.size(); j++) {
+                long long x, y;
+                if (!CBU_Balancer::_checked_mul(row[j], a, x) || !CBU_Balancer::_checked_mul(pivot_part[j], b, y) || !CBU_Balancer::_checked_sub(x, y, row[j])) { return false; }
+                content = CBU_Balancer::_gcd(content, row[j]);
             }
         }
-        if (independent) {
-            independent_results_coefs.push_back(result);
+        if (content > 1) {
+            for (auto& entry : this->_reduced[i]) { entry /= content; }
+            for (auto& entry : this->_transform[i]) { entry /= content; }
         }
     }
-    this->_results_coefs = std::move(independent_results_coefs);
+    return true;
 }
 
-// This method removes all spaces from a string and returns the new string.
-inline std::string CBU_Balancer::_remove_spaces(const std::string &str) {
-    std::string result = str;
-    result.erase(std::remove_if(result.begin(), result.end(), [](unsigned char c) { return std::isspace(c); }), result.end());
-    return result;
+// This method rebuilds the reduced form from the kept compositions (after an overflow), one element row and one column at a time. Returns false if a value still overflows.
+inline bool CBU_Session::_refactor() {
+    const size_t rows = this->_element_rows.size();
+    this->_reduced.assign(rows, std::vector<long long>());
+    this->_transform.assign(rows, std::vector<long long>(rows, 0));
+    for (size_t i = 0; i < rows; i++) { this->_transform[i][i] = 1; }
+    this->_pivots.assign(rows, SIZE_MAX);
+    std::vector<int32_t> signs(this->_compositions.size(), 1);
+    for (const auto& column : this->_product_columns) { signs[column] = -1; }
+
+    const std::vector<CBU_Composition> compositions = std::move(this->_compositions);
+    this->_compositions.clear(); // _add_column appends after the columns so far
+    bool fits = true;
+    for (size_t j = 0; j < compositions.size(); j++) {
+        if (fits) { fits = this->_add_column(compositions[j], signs[j]); }
+        this->_compositions.push_back(compositions[j]);
+    }
+    return fits;
 }
 
-// This method generates reactants and products string (std::pair<std::string, std::string> from an equation string)
-HAS_EXCEPTIONS
-std::pair<std::string, std::string> CBU_Balancer::_get_reactants_and_products_str(const std::string &equation) {
-    try {
-        std::string delimiter = "->";
-        std::vector<std::string> tokens;
-        size_t start = 0;
-        size_t end = equation.find(delimiter);
+// This method reads the nullspace basis of the equation from the reduced form, like _integer_nullspace: a vector per free column, in the order of the compounds in the equation,
+// and brings it to the basis of _integer_nullspace (see _canonical_nullspace_basis), whose pivots are the first independent columns of the equation.
+// Returns false if a value overflows.
+inline bool CBU_Session::_nullspace_basis(std::vector<std::vector<long long>>& basis) const {
+    basis.clear();
+    const size_t columns = this->_compositions.size();
+    std::vector<size_t> position(columns); // the position of each column in the equation
+    for (size_t k = 0; k < this->_reactant_columns.size(); k++) { position[this->_reactant_columns[k]] = k; }
+    for (size_t k = 0; k < this->_product_columns.size(); k++) { position[this->_product_columns[k]] = this->_reactant_columns.size() + k; }
 
-        while (end != std::string::npos) {
-            tokens.push_back(equation.substr(start, end - start));
-            start = end + delimiter.length();
-            end = equation.find(delimiter, start);
-        }
-        tokens.push_back(equation.substr(start));
+    std::vector<bool> free(columns, true);
+    long long common = 1; // the least common multiple of all pivots
+    for (size_t i = 0; i < this->_reduced.size(); i++) {
+        if (this->_pivots[i] == SIZE_MAX) { continue; }
+        free[this->_pivots[i]] = false;
+        const long long d = std::llabs(this->_reduced[i][this->_pivots[i]]);
+        if (!CBU_Balancer::_checked_mul(common / CBU_Balancer::_gcd(common, d), d, common)) { return false; }
+    }
 
-        if (tokens.size() == 2) {
-            return {tokens[0], tokens[1]};
-        } else {
-            throw std::runtime_error("INVALID_EQUATION");
+    for (size_t free_column = 0; free_column < columns; free_column++) {
+        if (!free[free_column]) { continue; }
+        std::vector<long long> vector(columns, 0);
+        vector[position[free_column]] = common;
+        for (size_t i = 0; i < this->_reduced.size(); i++) { // pivot * x_pivot + entry * common == 0
+            if (this->_pivots[i] == SIZE_MAX) { continue; }
+            long long x;
+            if (!CBU_Balancer::_checked_mul(this->_reduced[i][free_column], common / this->_reduced[i][this->_pivots[i]], x)) { return false; }
+            vector[position[this->_pivots[i]]] = -x;
         }
-    } catch (const std::runtime_error &re) {
-        std::cerr << re.what() << std::endl;
-        return {};
+        basis.push_back(std::move(vector));
     }
+    return CBU_Balancer::_canonical_nullspace_basis(basis);
 }
 
-// This method takes a half equation (for example, the half equations of "N + O2 -> NO2" is "N + O2" and "NO2") as input and outputs the compounds str of that half equation.
-// Generally, 'half_equations' are from the previous method, _get_reactants_and_products_str.
-// View _get_compounds_str
-HAS_EXCEPTIONS
-std::vector<std::string> CBU_Balancer::_separate_half_equation(const std::string &half_equation) {
-    try {
-        if (half_equation.empty()) {
-            throw std::runtime_error("INCOMPLETE_EQUATION");
+// This method drops the results of the recent balance, which do not match the edited equation
+inline void CBU_Session::_edited() {
+    this->_balancer._results_coefs.clear();
+    this->_balancer._elements.clear();
+    this->_balancer._main_matrix.clear();
+    this->_balancer._sparse_matrix.clear();
+    this->_balancer._error = CBU_Error::NO_RESULT;
+    this->_elements.clear();
+}
+
+// This method collects the elements of the equation straight from the kept compositions (as CBU_Balancer::_collect_elements does from compositions by side), in the order of the rows of its main matrix
+inline CBU_Error CBU_Session::_collect_elements() {
+    auto side_elements = [this](const std::vector<size_t>& columns, std::vector<unsigned>& elements) {
+        elements.clear();
+        for (const auto& column : columns) {
+            for (const auto& element : this->_compositions[column]) { elements.push_back(element.first); }
         }
-        std::string delimiter = "+";
-        std::vector<std::string> tokens;
-        size_t start = 0;
-        size_t end = half_equation.find(delimiter);
+        std::sort(elements.begin(), elements.end());
+        elements.erase(std::unique(elements.begin(), elements.end()), elements.end());
+    };
+    std::vector<unsigned>& product_elements = this->_balancer._workspace.product_elements;
+    side_elements(this->_reactant_columns, this->_elements);
+    side_elements(this->_product_columns, product_elements);
+    return this->_balancer._match_elements(this->_elements, product_elements);
+}
 
-        while (end != std::string::npos) {
-            tokens.push_back(half_equation.substr(start, end - start));
-            start = end + delimiter.length();
-            end = half_equation.find(delimiter, start);
+// This method balances the equation as it is now, with the stages of balance. The compounds are already parsed, and with CBU_Solver::NULLSPACE the basis is read from the reduced form
+// (rebuilt first if an edit overflowed, or else the main matrix is built and solved as by balance, with 128-bit integers if needed). The main matrix is not built otherwise (see get_main_matrix).
+inline CBU_Error CBU_Session::balance() {
+    CBU_Balancer& balancer = this->_balancer;
+    this->_edited();
+    balancer._error = CBU_Error::NONE;
+    balancer._begin_equation();
+    CBU_Error error = (this->_reactant_columns.empty() || this->_product_columns.empty()) ? balancer._fail(CBU_Error::EMPTY_COMPOUND_LIST, {}) : this->_collect_elements();
+    balancer._end_stage(CBU_Stage::PARSE);
+    if (error != CBU_Error::NONE) {
+        this->_elements.clear();
+        balancer._end_equation(error);
+        return error;
+    }
+
+    std::vector<CBU_Composition> reactants_composition, products_composition; // copied only to build the main matrix
+    if (balancer._options.solver != CBU_Solver::NULLSPACE) { // the other solvers build the main matrix anyway
+        this->_split_compositions(reactants_composition, products_composition);
+        error = balancer._balance_compositions(reactants_composition, products_composition, this->_elements);
+        balancer._end_equation(error);
+        return error;
+    }
+
+    for (const auto& element : this->_elements) { balancer._elements.emplace_back(CBU_Elements::symbol(element)); }
+    if (!this->_factored) { this->_factored = this->_refactor(); }
+    balancer._end_stage(CBU_Stage::BUILD);
+    CBU_STATS(
+        balancer._stats.peak_rows = std::max(balancer._stats.peak_rows, this->_elements.size());
+        balancer._stats.peak_columns = std::max(balancer._stats.peak_columns, this->_compositions.size());
+    )
+    balancer._end_stage(CBU_Stage::PRESOLVE); // nothing to presolve for CBU_Solver::NULLSPACE
+
+    std::vector<std::vector<long long>> basis;
+    if (this->_factored && this->_nullspace_basis(basis)) {
+        error = balancer._collect_nullspace_results(basis);
+    } else { // the fallback solves the main matrix
+        this->_split_compositions(reactants_composition, products_composition);
+        balancer._build_main_matrix(reactants_composition, products_composition, this->_elements);
+        error = balancer._solving_matrix_using_nullspace();
+    }
+    balancer._end_stage(CBU_Stage::SOLVE);
+    CBU_STATS(balancer._stats.solutions_found += balancer._results_coefs.size();)
+    if (error == CBU_Error::NONE) {
+        CBU_STATS(const size_t found = balancer._results_coefs.size();)
+        balancer._filter_linear_independent_results();
+        balancer._end_stage(CBU_Stage::FILTER);
+        CBU_STATS(balancer._stats.solutions_filtered += found - balancer._results_coefs.size();)
+        if (balancer._results_coefs.empty()) { error = CBU_Error::FAILED_TO_BALANCE; }
+    }
+    if (error != CBU_Error::NONE) { balancer._fail(error, {}); }
+    balancer._end_equation(error);
+    return error;
+}
+
+// This method copies the kept compositions by side, in the order of the equation
+inline void CBU_Session::_split_compositions(std::vector<CBU_Composition>& reactants_composition, std::vector<CBU_Composition>& products_composition) const {
+    for (const auto& column : this->_reactant_columns) { reactants_composition.push_back(this->_compositions[column]); }
+    for (const auto& column : this->_product_columns) { products_composition.push_back(this->_compositions[column]); }
+}
+
+// This method builds the main matrix of the recent balance if the basis was read from the reduced form (for get_matrix and get_sparse_matrix), as balance would have built it
+inline void CBU_Session::_build_main_matrix() {
+    CBU_Balancer& balancer = this->_balancer;
+    if (this->_elements.empty() || !balancer._main_matrix.empty() || !balancer._sparse_matrix.empty()) { return; }
+    std::vector<CBU_Composition> reactants_composition, products_composition;
+    this->_split_compositions(reactants_composition, products_composition);
+    balancer._build_main_matrix(reactants_composition, products_composition, this->_elements);
+}
+
+// This method gives the main matrix of the recent balance like CBU_Balancer::get_main_matrix. If the basis was read from the reduced form, the matrix was not built, so it is built here from the compositions.
+inline std::pair<std::vector<std::string>, std::vector<std::vector<int>>> CBU_Session::get_main_matrix() const {
+    const CBU_Balancer& balancer = this->_balancer;
+    if (this->_elements.empty() || !balancer._main_matrix.empty() || !balancer._sparse_matrix.empty()) { return balancer.get_main_matrix(); }
+    std::vector<std::vector<int>> matrix(this->_elements.size(), std::vector<int>(this->_compositions.size(), 0));
+    auto fill_columns = [this, &matrix](const std::vector<size_t>& columns, size_t first, int sign) {
+        for (size_t k = 0; k < columns.size(); k++) {
+            for (const auto& element : this->_compositions[columns[k]]) {
+                const size_t row = std::find(this->_elements.begin(), this->_elements.end(), element.first) - this->_elements.begin();
+                matrix[row][first + k] = sign * static_cast<int>(element.second);
+            }
         }
-        tokens.push_back(half_equation.substr(start));
-        return tokens;
-    } catch (const std::runtime_error &re) {
-        std::cerr << re.what() << std::endl;
-        return {};
+    };
+    fill_columns(this->_reactant_columns, 0, 1);
+    fill_columns(this->_product_columns, this->_reactant_columns.size(), -1);
+    return {balancer._elements, std::move(matrix)};
+}
+
+// This method checks if a string has nothing but spaces
+constexpr bool CBU_Constexpr::_is_blank(std::string_view str) {
+    for (const char c : str) {
+        if (!CBU_Constexpr::_is_space(c)) { return false; }
     }
+    return true;
 }
 
-// This method is used to generate the compounds str (std::pair for reactant and products; std::vector<std::string> for compounds str) from an equation
-HAS_EXCEPTIONS
-std::pair<std::vector<std::string>, std::vector<std::string>>
-CBU_Balancer::_get_compounds_str(const std::string &equation) {
-    try {
-        std::string equation_without_space = CBU_Balancer::_remove_spaces(equation);
-        std::pair<std::string, std::string> reactants_and_products_str = CBU_Balancer::_get_reactants_and_products_str(equation_without_space);
-
-        std::pair<std::vector<std::string>, std::vector<std::string>> compounds_str = {
-            CBU_Balancer::_separate_half_equation(reactants_and_products_str.first),
-            CBU_Balancer::_separate_half_equation(reactants_and_products_str.second)
-        };
-        return compounds_str;
-    } catch (const std::runtime_error &re) {
-        std::cerr << re.what() << std::endl;
-        return {};
+// This method compares two element symbols, leaving out the spaces in them (as CBU_Balancer leaves out the spaces in an equation), e.g., "C a" is "Ca"
+constexpr bool CBU_Constexpr::_same_symbol(std::string_view a, std::string_view b) {
+    size_t i = 0, j = 0;
+    while (true) {
+        while (i < a.size() && CBU_Constexpr::_is_space(a[i])) { i++; }
+        while (j < b.size() && CBU_Constexpr::_is_space(b[j])) { j++; }
+        if (i == a.size() || j == b.size()) { return i == a.size() && j == b.size(); }
+        if (a[i++] != b[j++]) { return false; }
     }
 }
 
-// This method is used to generate balancing result from given compounds
-// Processing of complex compounds is included
-HAS_EXCEPTIONS
-void CBU_Balancer::_balance_with_given_compounds_str(const std::vector<std::string>& reactants, const std::vector<std::string>& products) {
-    try {
-        if (reactants.empty() || products.empty()) { throw std::runtime_error("EMPTY_COMPOUND_LIST"); }
-
-        this->_reactants_and_products = {reactants, products};
-
-        // Initialization && parse
-        std::vector<std::map<std::string, unsigned>> reactants_composition, products_composition;
-        for (const auto& reactant : reactants) {
-            if (reactant.empty()) { throw std::runtime_error("INCOMPLETE_REACTANT"); }
-            reactants_composition.push_back(CBU_Balancer::_get_compound_composition(reactant));
-        } // to all reactants
-        for (const auto& product : products) {
-            if (product.empty()) { throw std::runtime_error("INCOMPLETE_REACTANT"); }
-            products_composition.push_back(CBU_Balancer::_get_compound_composition(product));
-        } // to all products
-
-        std::vector<std::string> reactant_elements = CBU_Balancer::get_elements_from_compounds_composition(reactants_composition);
-        std::vector<std::string> product_elements = CBU_Balancer::get_elements_from_compounds_composition(products_composition);
-
-        if (reactant_elements.size() == product_elements.size()) {
-            auto mismatch_result = std::mismatch(reactant_elements.begin(), reactant_elements.end(),
-                                                 product_elements.begin(), product_elements.end());
-            if (mismatch_result.first != reactant_elements.end() || mismatch_result.second != product_elements.end()) {
-                throw std::runtime_error("ELEMENTS_MISMATCH_BETWEEN_REACTANTS_AND_PRODUCTS");
+// This method parses a compound in one pass like CBU_Balancer::_parse_compound, skipping the spaces in it, and writes the count of each element to the column of the main matrix (negated for a product).
+// The counts of the compound are kept by row, and the counts when a group or a hydrate part begins are kept as well, so the multiplier of the group or the part scales the difference.
+// Returns CBU_Error::NO_RESULT if the compound has an element beyond the Elements rows.
+template <size_t Compounds, size_t Elements>
+constexpr CBU_Error CBU_Constexpr::_parse_compound(std::string_view compound, size_t column, bool product, Static_matrix<Compounds, Elements>& matrix) {
+    using Counts = std::array<long long, Elements>;
+    Counts counts{}; // the count of each row in the compound
+    std::array<Counts, MAX_PARENTHESES_DEPTH> group_counts{}; // the counts when each open group began
+    std::array<size_t, MAX_PARENTHESES_DEPTH> group_begins{}; // the number of elements read when each open group began (an empty group has none)
+    Counts part_counts{};
+    size_t part_begin = 0;
+    size_t entities = 0; // the element occurrences read so far
+    size_t depth = 0;
+    unsigned part_multiplier = 1;
+    size_t i = 0;
+    const size_t n = compound.size();
+
+    auto skip_spaces = [&]() { while (i < n && CBU_Constexpr::_is_space(compound[i])) { i++; } };
+    auto read_number = [&](unsigned& value) { // the number at i (1 if there is none), false if it overflows
+        value = 1;
+        skip_spaces();
+        if (i == n || !CBU_Constexpr::_is_digit(compound[i])) { return true; }
+        value = 0;
+        while (i < n && CBU_Constexpr::_is_digit(compound[i])) {
+            const unsigned digit = compound[i++] - '0';
+            if (value > (UINT_MAX - digit) / 10) { return false; }
+            value = value * 10 + digit;
+            skip_spaces();
+        }
+        return true;
+    };
+    auto multiply = [&](const Counts& begin, unsigned multiplier) { // the counts since begin, times multiplier, false if a count overflows
+        for (size_t r = 0; r < matrix.rows; r++) {
+            long long scaled = 0;
+            if (!CBU_Balancer::_checked_mul(counts[r] - begin[r], static_cast<long long>(multiplier), scaled) || !CBU_Balancer::_checked_add(begin[r], scaled, counts[r]) || counts[r] > INT32_MAX) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    skip_spaces();
+    while (i < n) {
+        const char c = compound[i];
+        if (CBU_Constexpr::_is_upper(c)) { // an element, e.g., "Ca" or "O2"
+            const size_t begin = i++;
+            size_t end = i;
+            skip_spaces();
+            while (i < n && CBU_Constexpr::_is_lower(compound[i])) { end = ++i; skip_spaces(); }
+            const std::string_view symbol = compound.substr(begin, end - begin);
+            unsigned count = 0;
+            if (!read_number(count)) { return CBU_Error::COEFFICIENT_OVERFLOW; }
+
+            size_t row = 0;
+            while (row < matrix.rows && !CBU_Constexpr::_same_symbol(matrix.symbols[row], symbol)) { row++; }
+            if (row == matrix.rows) {
+                if (matrix.rows == Elements) { return CBU_Error::NO_RESULT; }
+                matrix.symbols[matrix.rows++] = symbol;
             }
+            matrix.sides[row] |= product ? 2 : 1;
+            if (!CBU_Balancer::_checked_add(counts[row], static_cast<long long>(count), counts[row]) || counts[row] > INT32_MAX) { return CBU_Error::COEFFICIENT_OVERFLOW; }
+            entities++;
+        } else if (c == '(') {
+            if (depth == MAX_PARENTHESES_DEPTH) { return CBU_Error::PARENTHESES_TOO_DEEP; }
+            group_counts[depth] = counts;
+            group_begins[depth++] = entities;
+            i++;
+        } else if (c == ')') {
+            if (depth == 0) { return CBU_Error::UNMATCHED_PARENTHESES; }
+            if (group_begins[--depth] == entities) { return CBU_Error::INVALID_COMPOUND; } // "()"
+            i++;
+            unsigned multiplier = 1;
+            if (!read_number(multiplier) || !multiply(group_counts[depth], multiplier)) { return CBU_Error::COEFFICIENT_OVERFLOW; }
+        } else if (c == '.') { // a hydrate part begins
+            if (depth != 0) { return CBU_Error::UNMATCHED_PARENTHESES; }
+            if (part_begin == entities) { return CBU_Error::INVALID_COMPOUND; } // empty part, e.g., ".5H2O"
+            if (!multiply(part_counts, part_multiplier)) { return CBU_Error::COEFFICIENT_OVERFLOW; }
+            i++;
+            part_counts = counts;
+            part_begin = entities;
+            if (!read_number(part_multiplier)) { return CBU_Error::COEFFICIENT_OVERFLOW; }
+            if (i == n) { return CBU_Error::INVALID_COMPOUND; } // e.g., "CuSO4.5"
+        } else if (CBU_Constexpr::_is_lower(c) || CBU_Constexpr::_is_digit(c)) { // a lowercase letter or a digit that does not follow an element or a group, e.g., "c26"
+            return CBU_Error::INVALID_CHAR_OR_CHAR_POSITION;
         } else {
-            throw std::runtime_error("ELEMENTS_MISMATCH_BETWEEN_REACTANTS_AND_PRODUCTS");
+            return CBU_Error::INVALID_CHAR;
         }
+        skip_spaces();
+    }
+
+    if (depth != 0) { return CBU_Error::UNMATCHED_PARENTHESES; }
+    if (!multiply(part_counts, part_multiplier)) { return CBU_Error::COEFFICIENT_OVERFLOW; }
+    for (size_t r = 0; r < matrix.rows; r++) { matrix.entries[r][column] = product ? -counts[r] : counts[r]; }
+    return CBU_Error::NONE;
+}
+
+// This method solves the main matrix like CBU_Balancer::_integer_nullspace (fraction-free Gauss-Jordan elimination in Int), and balances the equation if its nullspace has a single basis vector,
+// which is the result if it is positive. Returns false if an intermediate value overflows Int.
+template <typename Int, size_t Compounds, size_t Elements>
+constexpr bool CBU_Constexpr::_solve(const Static_matrix<Compounds, Elements>& matrix, CBU_Static_result<Compounds>& result) {
+    const size_t rows = matrix.rows;
+    const size_t columns = result.compounds;
+    std::array<std::array<Int, Compounds>, Elements> reduced{};
+    for (size_t i = 0; i < rows; i++) {
+        for (size_t j = 0; j < columns; j++) { reduced[i][j] = static_cast<Int>(matrix.entries[i][j]); }
+    }
 
-        this->_elements = std::move(reactant_elements); // save to private member
+    auto magnitude = [](Int x) { return (x < 0) ? -x : x; };
+    std::array<size_t, Elements> pivot_columns{};
+    size_t rank = 0;
 
-        // Build matrices
-        std::vector<std::vector<unsigned>> reactant_matrix = CBU_Balancer::_build_matrix(reactants_composition, _elements);
-        std::vector<std::vector<unsigned>> product_matrix = CBU_Balancer::_build_matrix(products_composition, _elements);
+    for (size_t column = 0; column < columns && rank < rows; column++) {
+        size_t pivot_row = rows; // the smallest non-zero entry is picked as the pivot to limit the growth of entries
+        for (size_t i = rank; i < rows; i++) {
+            if (reduced[i][column] != 0 && (pivot_row == rows || magnitude(reduced[i][column]) < magnitude(reduced[pivot_row][column]))) {
+                pivot_row = i;
+            }
+        }
+        if (pivot_row == rows) { continue; } // free column
 
-        std::vector<std::vector<int>> main_matrix(
-            this->_elements.size(), // row is the element
-            std::vector<int>(reactants.size() + products.size(), 0) // column is the reactants and the products
-            // all filling 0
-        );
+        for (size_t j = 0; j < columns; j++) { // std::swap is not constexpr before C++20
+            const Int entry = reduced[rank][j];
+            reduced[rank][j] = reduced[pivot_row][j];
+            reduced[pivot_row][j] = entry;
+        }
+        const Int pivot = reduced[rank][column];
 
-        for (size_t i = 0; i < this->_elements.size(); i++) {
-            for (size_t j = 0; j < reactants.size(); ++j) {
-                main_matrix[i][j] = static_cast<int>(reactant_matrix[i][j]);
+        for (size_t i = 0; i < rows; i++) { // eliminates above and below, so every pivot column ends up with a single non-zero entry
+            if (i == rank || reduced[i][column] == 0) { continue; }
+            const Int g = CBU_Balancer::_gcd(pivot, reduced[i][column]);
+            const Int a = pivot / g;
+            const Int b = reduced[i][column] / g;
+            Int content = 0;
+            for (size_t j = 0; j < columns; j++) {
+                Int x = 0, y = 0;
+                if (!CBU_Balancer::_checked_mul(reduced[i][j], a, x) || !CBU_Balancer::_checked_mul(reduced[rank][j], b, y) || !CBU_Balancer::_checked_sub(x, y, reduced[i][j])) {
+                    return false;
+                }
+                content = CBU_Balancer::_gcd(content, reduced[i][j]);
             }
-            for (size_t j = 0; j < products.size(); j++) {
-                main_matrix[i][reactants.size() + j] = - static_cast<int>(product_matrix[i][j]);
+            if (content > 1) {
+                for (size_t j = 0; j < columns; j++) { reduced[i][j] /= content; }
             }
         }
 
-        this->_main_matrix = std::move(main_matrix); // save to private member
+        pivot_columns[rank++] = column;
+    }
+
+    result.reactions = columns - rank;
+    if (result.reactions != 1) { // nothing balances it, or no single result does
+        result.error = CBU_Error::FAILED_TO_BALANCE;
+        return true;
+    }
+
+    Int common = 1; // the least common multiple of all pivots
+    for (size_t i = 0; i < rank; i++) {
+        const Int d = magnitude(reduced[i][pivot_columns[i]]);
+        if (!CBU_Balancer::_checked_mul(common / CBU_Balancer::_gcd(common, d), d, common)) { return false; }
+    }
 
-        // Brute force balancing
-        std::vector<unsigned> results_coefficients(reactants.size() + products.size(), 0);
-        CBU_Balancer::_solving_matrix_using_recursion(results_coefficients, 0); // !
-        CBU_Balancer::_filter_linear_independent_results(); // here will be faster
+    size_t free_column = 0;
+    while (free_column < rank && pivot_columns[free_column] == free_column) { free_column++; }
+    std::array<Int, Compounds> vector{};
+    vector[free_column] = common;
+    for (size_t i = 0; i < rank; i++) { // pivot * x_pivot + entry * common == 0
+        Int x = 0;
+        if (!CBU_Balancer::_checked_mul(reduced[i][free_column], common / reduced[i][pivot_columns[i]], x)) { return false; }
+        vector[pivot_columns[i]] = -x;
+    }
 
-        if (this->_results_coefs.empty()) {
-            throw std::runtime_error("FAILED_TO_BALANCE");
+    Int content = 0;
+    for (size_t j = 0; j < columns; j++) {
+        if (vector[j] <= 0) { // a compound that takes no part, or is on the wrong side
+            result.error = CBU_Error::FAILED_TO_BALANCE;
+            return true;
+        }
+        content = CBU_Balancer::_gcd(content, vector[j]);
+    }
+    for (size_t j = 0; j < columns; j++) {
+        const Int coefficient = vector[j] / content;
+        if (coefficient > static_cast<Int>(UINT_MAX)) {
+            result.error = CBU_Error::COEFFICIENT_OVERFLOW;
+            return true;
         }
-    } catch (std::runtime_error &re) {
-        std::cerr << re.what() << std::endl;
+        result.coefficients[j] = static_cast<unsigned>(coefficient);
     }
+    result.error = CBU_Error::NONE;
+    return true;
 }
 
-// Main balance method
-void CBU_Balancer::balance(const std::string &equation) {
-    std::pair<std::vector<std::string>, std::vector<std::string>> reactants_and_products = _get_compounds_str(equation);
-    this->_reactants_and_products = reactants_and_products;
-    _balance_with_given_compounds_str(reactants_and_products.first, reactants_and_products.second);
+// This method balances an equation in a constant expression (or at run time, without allocating), with the errors of CBU_Balancer in the same order:
+// the arrow, the blank sides, the empty compounds, each compound from left to right, and the elements on one side only.
+// The elimination runs in 64-bit integers first and is redone in 128-bit integers (if the compiler has them) when an intermediate value overflows, as CBU_Solver::NULLSPACE does.
+template <size_t Compounds, size_t Elements>
+constexpr CBU_Static_result<Compounds> CBU_Constexpr::balance(std::string_view equation) {
+    CBU_Static_result<Compounds> result;
+    size_t arrow = 0, arrow_end = 0;
+    if (!CBU_Balancer::_find_arrow(equation, arrow, arrow_end)) {
+        result.error = CBU_Error::INVALID_EQUATION;
+        return result;
+    }
+    const std::array<std::string_view, 2> sides = {equation.substr(0, arrow), equation.substr(arrow_end)};
+    for (const auto& side : sides) {
+        if (CBU_Constexpr::_is_blank(side)) {
+            result.error = CBU_Error::INCOMPLETE_EQUATION;
+            return result;
+        }
+    }
+    if (CBU_Constexpr::compounds_bound(equation) > Compounds) { return result; } // CBU_Error::NO_RESULT
+
+    Static_matrix<Compounds, Elements> matrix;
+    for (size_t side = 0; side < sides.size(); side++) {
+        size_t begin = 0;
+        while (begin <= sides[side].size()) {
+            size_t end = sides[side].find('+', begin);
+            if (end == std::string_view::npos) { end = sides[side].size(); }
+            const std::string_view compound = sides[side].substr(begin, end - begin);
+            if (CBU_Constexpr::_is_blank(compound)) {
+                result.error = CBU_Error::INCOMPLETE_REACTANT;
+                return result;
+            }
+            result.error = CBU_Constexpr::_parse_compound(compound, result.compounds++, side == 1, matrix);
+            if (result.error != CBU_Error::NONE) { return result; }
+            begin = end + 1;
+        }
+        if (side == 0) { result.reactants = result.compounds; }
+    }
+
+    for (size_t r = 0; r < matrix.rows; r++) {
+        if (matrix.sides[r] != 3) {
+            result.error = CBU_Error::ELEMENTS_MISMATCH_BETWEEN_REACTANTS_AND_PRODUCTS;
+            return result;
+        }
+    }
+
+    if (CBU_Constexpr::_solve<long long>(matrix, result)) { return result; }
+#ifdef __SIZEOF_INT128__
+    if (CBU_Constexpr::_solve<__int128>(matrix, result)) { return result; }
+#endif
+    result.error = CBU_Error::COEFFICIENT_OVERFLOW;
+    return result;
+}
+
+constexpr size_t CBU_Constexpr::compounds_bound(std::string_view equation) {
+    size_t compounds = 2;
+    for (const char c : equation) { compounds += (c == '+') ? 1 : 0; }
+    return compounds;
+}
+
+constexpr size_t CBU_Constexpr::elements_bound(std::string_view equation) {
+    size_t elements = 0;
+    for (const char c : equation) { elements += CBU_Constexpr::_is_upper(c) ? 1 : 0; }
+    return std::max<size_t>(elements, 1);
+}
+
+#if defined(__cpp_consteval) && defined(__cpp_nontype_template_args) && __cpp_nontype_template_args >= 201911L
+// A string literal that can be a template argument (C++20), see CBU_balanced
+template <size_t Size>
+struct CBU_Literal {
+    std::array<char, Size> chars{};
+    consteval CBU_Literal(const char (&literal)[Size]) {
+        for (size_t i = 0; i < Size; i++) { this->chars[i] = literal[i]; }
+    }
+    [[nodiscard]] constexpr std::string_view view() const { return std::string_view(this->chars.data(), Size - 1); }
+};
+
+// This method balances an equation at compile time and gives the coefficient of each compound (the reactants first), e.g., CBU_balanced<"Zn+HCl->ZnCl2+H2">() is {1, 2, 1, 1}.
+// The matrix is as large as the equation can need, and an equation that cannot be balanced to a single result does not compile, with the reason as the message
+// (an underdetermined one too: no result of it is more right than the others, so none is picked).
+template <CBU_Literal equation>
+consteval auto CBU_balanced() {
+    constexpr std::string_view equation_view = equation.view();
+    constexpr auto result = CBU_Constexpr::balance<CBU_Constexpr::compounds_bound(equation_view), CBU_Constexpr::elements_bound(equation_view)>(equation_view);
+    static_assert(result.error != CBU_Error::INVALID_EQUATION, "CBU_balanced: the equation needs exactly one \"->\"");
+    static_assert(result.error != CBU_Error::INCOMPLETE_EQUATION, "CBU_balanced: a side of the equation is blank");
+    static_assert(result.error != CBU_Error::INCOMPLETE_REACTANT, "CBU_balanced: an empty compound, e.g., \"C++O2->CO2\"");
+    static_assert(result.error != CBU_Error::INVALID_CHAR, "CBU_balanced: a character that cannot be in a compound");
+    static_assert(result.error != CBU_Error::INVALID_CHAR_OR_CHAR_POSITION, "CBU_balanced: a lowercase letter or a digit that does not follow an element or a group");
+    static_assert(result.error != CBU_Error::UNMATCHED_PARENTHESES, "CBU_balanced: unmatched parentheses");
+    static_assert(result.error != CBU_Error::PARENTHESES_TOO_DEEP, "CBU_balanced: parentheses nested deeper than MAX_PARENTHESES_DEPTH");
+    static_assert(result.error != CBU_Error::INVALID_COMPOUND, "CBU_balanced: an empty group or hydrate part, e.g., \"Ca()\" or \"CuSO4.5\"");
+    static_assert(result.error != CBU_Error::ELEMENTS_MISMATCH_BETWEEN_REACTANTS_AND_PRODUCTS, "CBU_balanced: an element is on one side of the equation only");
+    static_assert(result.error != CBU_Error::COEFFICIENT_OVERFLOW, "CBU_balanced: a coefficient overflows");
+    static_assert(result.error != CBU_Error::FAILED_TO_BALANCE || result.reactions <= 1, "CBU_balanced: the equation is underdetermined (several independent reactions, e.g., \"Fe2O3+C->Fe+CO+CO2\"), so it has no single result and is rejected; "
+                                                                                        "list its reactions with CBU_Solver::NULLSPACE at run time instead");
+    static_assert(result.error != CBU_Error::FAILED_TO_BALANCE || result.reactions > 1, "CBU_balanced: the equation cannot be balanced");
+
+    std::array<unsigned, result.compounds> coefficients{};
+    for (size_t i = 0; i < result.compounds; i++) { coefficients[i] = result.coefficients[i]; }
+    return coefficients;
+}
+#endif
+
+// Get the main matrix (the dense view, also for a large equation kept as a sparse matrix)
+inline std::pair<std::vector<std::string>, std::vector<std::vector<int>>> CBU_Balancer::get_main_matrix() const {
+    if (!this->_sparse_matrix.empty()) { return {this->_elements, this->_sparse_matrix.to_dense().to_vectors()}; }
+    return {this->_elements, this->_main_matrix.to_vectors()};
 }
 
 // Get results
-HAS_EXCEPTIONS
 inline std::string CBU_Balancer::get_result() const {
-    try {
-        std::string result_str = "";
-        if (this->_reactants_and_products.first.empty() || this->_reactants_and_products.second.empty()) {
-            throw std::runtime_error("NO_RESULT");
+    if (this->_reactants_and_products.first.empty() || this->_reactants_and_products.second.empty()) {
+        this->_report(CBU_Severity::ERROR, CBU_Balancer::error_name(CBU_Error::NO_RESULT));
+        return "";
+    }
+    if (this->_results_coefs.size() >= 2) { this->_report(CBU_Severity::WARNING, "There are multiple possible solutions. Please select the most correct one."); }
+    return CBU_Balancer::_format_results(this->_reactants_and_products.first, this->_reactants_and_products.second, this->_results_coefs);
+}
+
+inline std::string CBU_Balancer::get_result(const CBU_Result& result) {
+    return CBU_Balancer::_format_results(result.reactants, result.products, result.coefficients);
+}
+
+// This method writes each result as a balanced equation (one per line)
+inline std::string CBU_Balancer::_format_results(const std::vector<std::string>& reactants, const std::vector<std::string>& products, const std::vector<std::vector<unsigned>>& results_coefs) {
+    std::string result_str = "";
+    if (reactants.empty() || products.empty()) { return result_str; }
+
+    unsigned reactants_count = reactants.size();
+    unsigned products_count = products.size();
+
+    for (const auto& solution : results_coefs) { // solution: const std::vector<unsigned>
+        bool first = true;
+        for (size_t i = 0; i < reactants_count; i++) {
+            auto coefficient = solution[i];
+            if (coefficient == 0) { continue; } // a generating reaction (CBU_Solver::HILBERT_BASIS) leaves the compound out
+            result_str += (first ? "" : " + ");
+            result_str += ((coefficient != 1) ? std::to_string(coefficient) : "");
+            result_str += reactants[i];
+            first = false;
         }
+        result_str += " == ";
+        first = true;
+        for (size_t i = 0; i < products_count; i++) {
+            auto coefficient = static_cast<unsigned>(solution[reactants_count + i]);
+            if (coefficient == 0) { continue; }
+            result_str += (first ? "" : " + ");
+            result_str += ((coefficient != 1) ? std::to_string(coefficient) : "");
+            result_str += products[i];
+            first = false;
+        }
+        result_str += '\n';
+    }
+    result_str = result_str.substr(0, result_str.size() - 1);
+    return result_str;
+}
 
-        unsigned reactants_count = _reactants_and_products.first.size();
-        unsigned products_count = _reactants_and_products.second.size();
+// This method gives the name of an error code, e.g., "FAILED_TO_BALANCE"
+inline std::string_view CBU_Balancer::error_name(CBU_Error error) {
+    switch (error) {
+        case CBU_Error::NONE: return "NONE";
+        case CBU_Error::INVALID_CHAR: return "INVALID_CHAR";
+        case CBU_Error::INVALID_CHAR_OR_CHAR_POSITION: return "INVALID_CHAR_OR_CHAR_POSITION";
+        case CBU_Error::UNMATCHED_PARENTHESES: return "UNMATCHED_PARENTHESES";
+        case CBU_Error::PARENTHESES_TOO_DEEP: return "PARENTHESES_TOO_DEEP";
+        case CBU_Error::INVALID_COMPOUND: return "INVALID_COMPOUND";
+        case CBU_Error::COEFFICIENT_OVERFLOW: return "COEFFICIENT_OVERFLOW";
+        case CBU_Error::BASIS_TOO_LARGE: return "BASIS_TOO_LARGE";
+        case CBU_Error::INVALID_EQUATION: return "INVALID_EQUATION";
+        case CBU_Error::INCOMPLETE_EQUATION: return "INCOMPLETE_EQUATION";
+        case CBU_Error::EMPTY_COMPOUND_LIST: return "EMPTY_COMPOUND_LIST";
+        case CBU_Error::INCOMPLETE_REACTANT: return "INCOMPLETE_REACTANT";
+        case CBU_Error::ELEMENTS_MISMATCH_BETWEEN_REACTANTS_AND_PRODUCTS: return "ELEMENTS_MISMATCH_BETWEEN_REACTANTS_AND_PRODUCTS";
+        case CBU_Error::FAILED_TO_BALANCE: return "FAILED_TO_BALANCE";
+        case CBU_Error::TOO_MANY_SPECIAL_ELEMENTS: return "TOO_MANY_SPECIAL_ELEMENTS";
+        case CBU_Error::NO_RESULT: return "NO_RESULT";
+    }
+    return "UNKNOWN_ERROR";
+}
 
-        if (this->_results_coefs.size() >= 2) { std::cout << "There are multiple possible solutions. Please select the most correct one." << std::endl; }
+// These methods give the short name of a solver (e.g., "pruned" for CBU_Solver::PRUNED_RECURSION, as the console and the command lines take it), and the solver of a name (false if there is none)
+inline std::string_view CBU_Balancer::solver_name(CBU_Solver solver) {
+    switch (solver) {
+        case CBU_Solver::RECURSION: return "recursion";
+        case CBU_Solver::PRUNED_RECURSION: return "pruned";
+        case CBU_Solver::PARALLEL_RECURSION: return "parallel";
+        case CBU_Solver::NULLSPACE: return "nullspace";
+        case CBU_Solver::MODULAR_NULLSPACE: return "modular";
+        case CBU_Solver::HILBERT_BASIS: return "hilbert";
+    }
+    return "unknown";
+}
 
-        for (const auto& solution : this->_results_coefs) { // solution: const std::vector<unsigned>
-            for (size_t i = 0; i < reactants_count; i++) {
-                auto coefficient = solution[i];
-                result_str += ((coefficient != 1) ? std::to_string(coefficient) : "");
-                result_str += _reactants_and_products.first[i];
-                if (i < reactants_count - 1) {
-                    result_str += " + ";
-                }
-            }
-            result_str += " == ";
-            for (size_t i = 0; i < products_count; i++) {
-                auto coefficient = static_cast<unsigned>(solution[reactants_count + i]);
-                result_str += ((coefficient != 1) ? std::to_string(coefficient) : "");
-                result_str += _reactants_and_products.second[i];
-                if (i < products_count - 1) {
-                    result_str += " + ";
-                }
-            }
-            result_str += '\n';
+inline bool CBU_Balancer::solver_from_name(std::string_view name, CBU_Solver& solver) {
+    static const CBU_Solver solvers[] = {CBU_Solver::RECURSION, CBU_Solver::PRUNED_RECURSION, CBU_Solver::PARALLEL_RECURSION,
+                                         CBU_Solver::NULLSPACE, CBU_Solver::HILBERT_BASIS, CBU_Solver::MODULAR_NULLSPACE};
+    for (const auto candidate : solvers) {
+        if (CBU_Balancer::solver_name(candidate) == name) {
+            solver = candidate;
+            return true;
         }
-        result_str = result_str.substr(0, result_str.size() - 1);
-        return result_str;
-    } catch (const std::runtime_error& re) {
-        std::cerr << re.what() << std::endl;
-        return "";
     }
+    return false;
 }
 
+// This method clears the balancing data. The workspace keeps its storage (and the results dropped here), so the next equation reuses it.
 inline void CBU_Balancer::clear_data() {
-    this->_reactants_and_products.first.clear();
-    this->_reactants_and_products.second.clear();
+    CBU_Balancer::_resize_keeping(this->_reactants_and_products.first, 0, CBU_Balancer::_spare_compounds_str()); // their buffers take the next compounds
+    CBU_Balancer::_resize_keeping(this->_reactants_and_products.second, 0, CBU_Balancer::_spare_compounds_str());
+    this->_clear_equation();
+}
+
+// This method clears what was balanced from the stored compounds (which stay, as balance and balance_with_given_compounds may read them), so a balance never adds to the data of the previous one
+inline void CBU_Balancer::_clear_equation() {
     this->_elements.clear();
     this->_main_matrix.clear();
+    this->_sparse_matrix.clear();
+    for (auto& result : this->_results_coefs) { CBU_Balancer::_keep_spare(this->_workspace.spare_results, result); } // their storage takes the next results
     this->_results_coefs.clear();
+    CBU_Balancer::_resize_keeping(this->_presolve_blocks, 0, this->_workspace.spare_blocks);
+    this->_error = CBU_Error::NONE;
 }
 
 // Get program version
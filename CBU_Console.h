@@ -13,14 +13,35 @@
 #define CBU_CONSOLE_H
 
 #include <iostream>
+#include <fstream>
+#include <map>
+#include <condition_variable>
 #include "CBU_Balancer.h"
 
+#define BATCH_CHUNK_LINES 256 // the equations of the batch mode solved by one worker at a time (and written at once)
+#define BATCH_READ_BYTES (1 << 20) // the bytes the batch mode reads at a time
+#define BATCH_CHUNKS_PER_THREAD 4 // the chunks in flight per worker (read and not yet written), beyond which the reader waits for the writer
+
 class CBU_Console {
 public:
+    // The settings of the batch mode (see batch)
+    struct Batch_settings {
+        std::string input; // the equations, one per line (empty means the standard input)
+        std::string output; // the results, one line per equation (empty means the standard output)
+        bool json = false; // JSON Lines instead of plain text
+        CBU_Options options;
+    };
+
     CBU_Console() { std::cout << CBU_Console::version() << CBU_Balancer::version() << std::endl << CBU_Console::guide_message() << std::endl; }
     static std::string version();
     static std::string guide_message();
+    static std::string stats_message(const CBU_Stats& stats);
     void boot();
+    static bool parse_arguments(int argc, char** argv, Batch_settings& settings);
+    static int batch(const Batch_settings& settings);
+private:
+    static void _write_result(std::string_view equation, const CBU_Result& result, bool json, std::string& text);
+    static void _escape(std::string_view str, std::string& text);
 };
 
 inline std::string CBU_Console::version() {
@@ -34,11 +55,27 @@ inline std::string CBU_Console::guide_message() {
     std::string guide_message = "";
     guide_message += "Use quit() to quit the console.\n";
     guide_message += "Use multiple_results(off)` to disable multiple results, use multiple_results(on) to allow it. Multiple results is enabled by default.\n" ; 
+    guide_message += "Use solver(nullspace) to solve the equation exactly without the maximum coefficient limit, use solver(pruned) to search faster with the same results, use solver(parallel) to run that search on every core, use solver(modular) to solve large systems like nullspace with modular arithmetic, use solver(hilbert) to list the generating reactions, use solver(recursion) to go back to the default solver.\n";
+    guide_message += "Use stats() to show what the balancing has cost so far, use stats(<file>) to write it to a file in the Prometheus text format.\n";
+    guide_message += "Use result_cache(<file>) to keep every result in a file, so that an equation balanced before (in this or any earlier session) is answered at once.\n";
     guide_message += "Directly type your chemical equation to call the built-in ChemicalBalancingUtility to balance.\n";
     return guide_message;
 }
 
-void CBU_Console::boot() {
+inline std::string CBU_Console::stats_message(const CBU_Stats& stats) {
+    static const char* const stage_names[STATS_STAGE_COUNT] = {"parse", "build", "presolve", "solve", "filter"};
+    std::string stats_message = "";
+    stats_message += "Equations: " + std::to_string(stats.equations) + " (" + std::to_string(stats.failures) + " failed)\n";
+    stats_message += "Search: " + std::to_string(stats.nodes) + " nodes, " + std::to_string(stats.leaves) + " leaves, " + std::to_string(stats.prunes) + " prunes\n";
+    stats_message += "Solutions: " + std::to_string(stats.solutions_found) + " found, " + std::to_string(stats.solutions_filtered) + " filtered\n";
+    stats_message += "Largest matrix: " + std::to_string(stats.peak_rows) + " x " + std::to_string(stats.peak_columns) + "\n";
+    stats_message += "Time (us):";
+    for (size_t i = 0; i < STATS_STAGE_COUNT; i++) { stats_message += std::string(" ") + stage_names[i] + " " + std::to_string(stats.stage_ns[i] / 1000); }
+    stats_message += ", total " + std::to_string(stats.equations_ns / 1000);
+    return stats_message;
+}
+
+inline void CBU_Console::boot() {
     std::string command;
     CBU_Balancer balancer = CBU_Balancer();
     balancer.set_log_status(false);
@@ -54,6 +91,46 @@ void CBU_Console::boot() {
             balancer.set_multiple_results(false);
             std::cout << "Multiple results is disabled. The balancing result my be not correct!" << std::endl;
         }
+        else if (command == "solver(recursion)") {
+            balancer.set_solver(CBU_Solver::RECURSION);
+            std::cout << "Solver is set to recursion." << std::endl;
+        }
+        else if (command == "solver(pruned)") {
+            balancer.set_solver(CBU_Solver::PRUNED_RECURSION);
+            std::cout << "Solver is set to pruned recursion." << std::endl;
+        }
+        else if (command == "solver(parallel)") {
+            balancer.set_solver(CBU_Solver::PARALLEL_RECURSION);
+            std::cout << "Solver is set to parallel recursion." << std::endl;
+        }
+        else if (command == "solver(nullspace)") {
+            balancer.set_solver(CBU_Solver::NULLSPACE);
+            std::cout << "Solver is set to nullspace." << std::endl;
+        }
+        else if (command == "solver(modular)") {
+            balancer.set_solver(CBU_Solver::MODULAR_NULLSPACE);
+            std::cout << "Solver is set to modular nullspace." << std::endl;
+        }
+        else if (command == "solver(hilbert)") {
+            balancer.set_solver(CBU_Solver::HILBERT_BASIS);
+            std::cout << "Solver is set to Hilbert basis." << std::endl;
+        }
+        else if (command == "stats()") {
+            std::cout << CBU_Console::stats_message(balancer.get_stats()) << std::endl;
+        }
+        else if (command.rfind("stats(", 0) == 0 && command.back() == ')') {
+            std::string path = command.substr(6, command.size() - 7);
+            std::ofstream file(path);
+            if (file << balancer.get_stats().to_prometheus()) { std::cout << "Stats are written to " << path << "." << std::endl; }
+            else { std::cout << "Cannot write " << path << "." << std::endl; }
+        }
+        else if (command.rfind("result_cache(", 0) == 0 && command.back() == ')') {
+            std::string path = command.substr(13, command.size() - 14);
+            auto result_cache = std::make_shared<CBU_Result_cache>(path);
+            if (result_cache->is_open()) { std::cout << "Results are cached in " << path << " (" << result_cache->size() << " equations)." << std::endl; }
+            else { std::cout << "Cannot open " << path << ", results are cached in memory." << std::endl; }
+            balancer.set_result_cache(std::move(result_cache));
+        }
         else {
             balancer.balance(command);
             std::cout << balancer.get_result() << std::endl;
@@ -62,4 +139,185 @@ void CBU_Console::boot() {
     }
 }
 
+// This method reads the command line of the batch mode ("--batch" and its settings) into settings, false if it is invalid
+inline bool CBU_Console::parse_arguments(int argc, char** argv, Batch_settings& settings) {
+    settings.options.log_status = false;
+    settings.options.sink = nullptr; // a failed equation is written out, not reported
+    settings.options.cache = std::make_shared<CBU_Composition_cache>();
+    for (int i = 1; i < argc; i++) {
+        const std::string_view argument = argv[i];
+        const bool has_value = (i + 1 < argc);
+        if (argument == "--batch") { }
+        else if (argument == "--json") { settings.json = true; }
+        else if (argument == "--single") { settings.options.multiple_results = false; }
+        else if (argument == "--input" && has_value) { settings.input = argv[++i]; }
+        else if (argument == "--output" && has_value) { settings.output = argv[++i]; }
+        else if (argument == "--max-coef" && has_value) { settings.options.max_coef = std::strtoul(argv[++i], nullptr, 10); }
+        else if (argument == "--threads" && has_value) { settings.options.thread_count = std::strtoul(argv[++i], nullptr, 10); }
+        else if (argument == "--result-cache" && has_value) { settings.options.result_cache = std::make_shared<CBU_Result_cache>(argv[++i]); }
+        else if (argument == "--solver" && has_value) { if (!CBU_Balancer::solver_from_name(argv[++i], settings.options.solver)) { return false; } }
+        else { return false; }
+    }
+    return settings.options.max_coef > 0;
+}
+
+// This method balances every line of the input and writes one line per equation, in the order of the input, through a pipeline of three stages:
+// a reader that splits the input (read BATCH_READ_BYTES at a time) into chunks of BATCH_CHUNK_LINES equations, the workers that solve a chunk each (thread_count of them),
+// and a writer (the calling thread) that writes the chunks back in order, each with one fwrite and no flush. At most BATCH_CHUNKS_PER_THREAD chunks per worker are in flight,
+// so a reader ahead of the writer waits for it (e.g., when the output is a slow pipe), and the memory does not grow with the input. Returns 0, or 1 if a file cannot be opened or written.
+inline int CBU_Console::batch(const Batch_settings& settings) {
+    FILE* input = settings.input.empty() ? stdin : std::fopen(settings.input.c_str(), "rb");
+    FILE* output = settings.output.empty() ? stdout : std::fopen(settings.output.c_str(), "wb");
+    if (input == nullptr || output == nullptr) {
+        std::cerr << "Cannot open " << (input == nullptr ? settings.input : settings.output) << "." << std::endl;
+        if (input != nullptr && input != stdin) { std::fclose(input); }
+        if (output != nullptr && output != stdout) { std::fclose(output); }
+        return 1;
+    }
+    const CBU_Balancer balancer(settings.options); // only solve is used (it is reentrant), so every worker shares it
+    unsigned thread_count = settings.options.thread_count;
+    if (thread_count == 0) { thread_count = std::max(1u, std::thread::hardware_concurrency()); }
+    const size_t window = static_cast<size_t>(BATCH_CHUNKS_PER_THREAD) * thread_count;
+
+    struct Chunk {
+        size_t index = 0;
+        std::vector<std::string> equations;
+    };
+    std::mutex lock;
+    std::condition_variable changed;
+    std::deque<Chunk> read_chunks; // read and not yet solved
+    std::map<size_t, std::string> solved_chunks; // solved and not yet written, by index
+    size_t read_count = 0, written_count = 0;
+    bool read_done = false;
+
+    std::thread reader([&]() {
+        std::vector<char> block(BATCH_READ_BYTES);
+        std::string line;
+        Chunk chunk;
+        auto push = [&]() {
+            std::unique_lock<std::mutex> guard(lock);
+            changed.wait(guard, [&]() { return read_count - written_count < window; });
+            chunk.index = read_count++;
+            read_chunks.push_back(std::move(chunk));
+            chunk = Chunk();
+            changed.notify_all();
+        };
+        size_t size;
+        while ((size = std::fread(block.data(), 1, block.size(), input)) > 0) {
+            const char* begin = block.data();
+            const char* const end = block.data() + size;
+            for (const char* newline; (newline = static_cast<const char*>(std::memchr(begin, '\n', static_cast<size_t>(end - begin)))) != nullptr; begin = newline + 1) {
+                line.append(begin, newline);
+                if (!line.empty() && line.back() == '\r') { line.pop_back(); }
+                chunk.equations.push_back(std::move(line));
+                line.clear();
+                if (chunk.equations.size() == BATCH_CHUNK_LINES) { push(); }
+            }
+            line.append(begin, end);
+        }
+        if (!line.empty()) { chunk.equations.push_back(std::move(line)); } // the last line needs no newline
+        if (!chunk.equations.empty()) { push(); }
+        std::lock_guard<std::mutex> guard(lock);
+        read_done = true;
+        changed.notify_all();
+    });
+
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < thread_count; t++) {
+        workers.emplace_back([&]() {
+            while (true) {
+                Chunk chunk;
+                {
+                    std::unique_lock<std::mutex> guard(lock);
+                    changed.wait(guard, [&]() { return !read_chunks.empty() || read_done; });
+                    if (read_chunks.empty()) { return; }
+                    chunk = std::move(read_chunks.front());
+                    read_chunks.pop_front();
+                }
+                std::string text;
+                for (const auto& equation : chunk.equations) { CBU_Console::_write_result(equation, balancer.solve(equation), settings.json, text); }
+                std::lock_guard<std::mutex> guard(lock);
+                solved_chunks.emplace(chunk.index, std::move(text));
+                changed.notify_all();
+            }
+        });
+    }
+
+    bool written = true;
+    while (true) {
+        std::string text;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            changed.wait(guard, [&]() { return solved_chunks.count(written_count) || (read_done && written_count == read_count); });
+            auto it = solved_chunks.find(written_count);
+            if (it == solved_chunks.end()) { break; }
+            text = std::move(it->second);
+            solved_chunks.erase(it);
+        }
+        written = written && std::fwrite(text.data(), 1, text.size(), output) == text.size();
+        std::lock_guard<std::mutex> guard(lock);
+        written_count++;
+        changed.notify_all();
+    }
+    reader.join();
+    for (auto& worker : workers) { worker.join(); }
+
+    if (input != stdin) { std::fclose(input); }
+    written = (std::fflush(output) == 0) && written;
+    if (output != stdout) { written = (std::fclose(output) == 0) && written; }
+    if (!written) { std::cerr << "Cannot write " << (settings.output.empty() ? "the output" : settings.output) << "." << std::endl; }
+    return written ? 0 : 1;
+}
+
+// This method writes the line of an equation in the batch mode: its results (separated by " ; ") or the name of its error,
+// or in JSON Lines, e.g., {"equation":"H2+O2->H2O","error":"NONE","results":["2H2 + O2 == 2H2O"],"coefficients":[[2,1,2]]}
+inline void CBU_Console::_write_result(std::string_view equation, const CBU_Result& result, bool json, std::string& text) {
+    const std::string results = result.coefficients.empty() ? std::string() : CBU_Balancer::get_result(result);
+    if (!json) {
+        if (result.error != CBU_Error::NONE) { text += CBU_Balancer::error_name(result.error); }
+        else {
+            for (const char c : results) {
+                if (c == '\n') { text += " ; "; } else { text += c; }
+            }
+        }
+        text += '\n';
+        return;
+    }
+    text += "{\"equation\":\"";
+    CBU_Console::_escape(equation, text);
+    text += "\",\"error\":\"";
+    text += CBU_Balancer::error_name(result.error);
+    text += "\",\"results\":[";
+    if (!results.empty()) {
+        text += '"';
+        for (const char c : results) {
+            if (c == '\n') { text += "\",\""; } else { CBU_Console::_escape(std::string_view(&c, 1), text); }
+        }
+        text += '"';
+    }
+    text += "],\"coefficients\":[";
+    for (size_t r = 0; r < result.coefficients.size(); r++) {
+        text += (r == 0) ? "[" : ",[";
+        for (size_t k = 0; k < result.coefficients[r].size(); k++) {
+            if (k > 0) { text += ','; }
+            text += std::to_string(result.coefficients[r][k]);
+        }
+        text += ']';
+    }
+    text += "]}\n";
+}
+
+// This method appends a string to a JSON string (without the quotes)
+inline void CBU_Console::_escape(std::string_view str, std::string& text) {
+    for (const char c : str) {
+        if (c == '"' || c == '\\') { text += '\\'; text += c; }
+        else if (static_cast<unsigned char>(c) < 0x20) {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned>(c));
+            text += escaped;
+        }
+        else { text += c; }
+    }
+}
+
 #endif // CBU_CONSOLE_H
@@ -0,0 +1,393 @@
+// Copyright (c) 2024 Frank Yang
+// All rights reserved.
+//
+// This code is proprietary and confidential.
+// Unauthorized copying of this file, via any medium is strictly prohibited.
+
+
+#ifndef CBU_SERVER_H
+#define CBU_SERVER_H
+
+#include "CBU_Balancer.h"
+#ifdef __linux__
+#define CBU_SERVER // the balancing daemon runs on epoll (Linux only)
+#include <condition_variable>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define SERVER_MAX_REQUEST (1 << 20) // the longest request line (a client that sends more without a newline is disconnected)
+#define SERVER_MAX_PENDING 1024 // the requests of one client in flight at a time (the daemon stops taking its requests until some are answered)
+#define SERVER_MAX_OUTPUT (1 << 20) // the response bytes waiting for one client past which its requests are not taken (until it reads them)
+#define SERVER_MAX_JOBS 65536 // the requests of all clients in flight at a time (the requests of a client wait in its input until some are answered)
+#define SERVER_READ_CHUNK 65536 // the bytes read from a client at a time
+#define SERVER_MAX_EVENTS 64 // the epoll events handled per wait
+
+// A balancing daemon on a Unix domain socket. It keeps its settings, caches and worker threads for its whole life, so a request costs only its solve.
+// A request is one line "<id> <equation>", and its response one line "<id> <error name>[ <result>[ ; <result>...]]" (see _respond), e.g., "7 NONE 2H2 + O2 == 2H2O".
+// A client can pipeline any number of requests: they are solved by the workers at the same time and each is answered as soon as it is done, so possibly out of order (the id tells which is which).
+// One thread runs the event loop (epoll) for every client: it accepts them, splits what they send into requests, and writes the responses the workers hand back (through an eventfd).
+// The requests of a client are taken only within SERVER_MAX_PENDING, SERVER_MAX_OUTPUT and SERVER_MAX_JOBS. Past them, the rest stays in its input and the daemon stops reading from it,
+// so a client that sends faster than it is answered, or never reads its responses, only holds its own socket buffers.
+class CBU_Server {
+private:
+    struct Connection {
+        int socket = -1;
+        std::string input; // the bytes read and not yet split into requests
+        std::string output; // the responses not yet written
+        size_t pending = 0; // the requests in flight
+        bool held = false; // complete requests are left in input, past a limit
+        bool waiting = false; // it is in _waiting
+        bool closing = false; // the client has nothing more to send (the connection is closed once every request is answered)
+        uint32_t events = 0; // the epoll events watched
+    };
+    struct Job {
+        uint64_t connection;
+        std::string id;
+        std::string equation;
+    };
+    struct Response {
+        uint64_t connection;
+        std::string text;
+    };
+
+    CBU_Balancer _balancer; // only solve is used (it is reentrant), so every worker shares it
+    std::string _path;
+    int _listener = -1;
+    int _epoll = -1;
+    int _wakeup = -1; // an eventfd, written by the workers (and stop) to wake the event loop
+    std::unordered_map<uint64_t, Connection> _connections; // by their epoll data (never reused, so a response to a closed connection is dropped)
+    uint64_t _next_connection = 2; // 0 is the listener and 1 is _wakeup
+    size_t _in_flight = 0; // the requests queued or being solved (SERVER_MAX_JOBS at most)
+    std::deque<uint64_t> _waiting; // the clients whose requests wait for SERVER_MAX_JOBS, in order
+    std::vector<char> _read_buffer;
+    std::vector<std::thread> _workers;
+    std::deque<Job> _jobs;
+    std::mutex _jobs_lock;
+    std::condition_variable _jobs_ready;
+    std::vector<Response> _responses;
+    std::mutex _responses_lock;
+    std::atomic<bool> _stopping{false};
+
+    bool _listen();
+    void _accept();
+    void _read(uint64_t connection_id);
+    void _split(uint64_t connection_id);
+    void _write(uint64_t connection_id);
+    void _watch(uint64_t connection_id, Connection& connection);
+    void _close(uint64_t connection_id);
+    void _deliver();
+    void _work();
+    static std::string _respond(const std::string& id, const CBU_Result& result);
+public:
+    CBU_Server(std::string path, const CBU_Options& options);
+    ~CBU_Server();
+    CBU_Server(const CBU_Server&) = delete;
+    CBU_Server& operator=(const CBU_Server&) = delete;
+
+    bool run();
+    void stop();
+    static bool parse_arguments(int argc, char** argv, std::string& path, CBU_Options& options);
+};
+
+inline CBU_Server::CBU_Server(std::string path, const CBU_Options& options)
+    : _balancer(options), _path(std::move(path)), _read_buffer(SERVER_READ_CHUNK) {
+    this->_wakeup = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+}
+
+inline CBU_Server::~CBU_Server() {
+    if (this->_wakeup >= 0) { ::close(this->_wakeup); }
+}
+
+// This method serves the clients until stop is called, and returns false if the socket cannot be set up (e.g., the path is taken by a file that is not a socket, or by a live daemon)
+// or if the event loop fails. A stale socket at the path (e.g., left by a daemon that was killed) is replaced, and the socket is removed on return.
+inline bool CBU_Server::run() {
+    if (this->_wakeup < 0 || !this->_listen()) {
+        if (this->_listener >= 0) { ::close(this->_listener); this->_listener = -1; }
+        if (this->_epoll >= 0) { ::close(this->_epoll); this->_epoll = -1; }
+        return false;
+    }
+    unsigned thread_count = this->_balancer.get_options().thread_count;
+    if (thread_count == 0) { thread_count = std::max(1u, std::thread::hardware_concurrency()); }
+    for (unsigned t = 0; t < thread_count; t++) { this->_workers.emplace_back(&CBU_Server::_work, this); }
+
+    epoll_event events[SERVER_MAX_EVENTS];
+    bool failed = false;
+    while (!this->_stopping.load(std::memory_order_relaxed)) {
+        const int count = ::epoll_wait(this->_epoll, events, SERVER_MAX_EVENTS, -1);
+        if (count < 0 && errno == EINTR) { continue; }
+        if (count < 0) { failed = true; break; }
+        for (int i = 0; i < count; i++) {
+            const uint64_t data = events[i].data.u64;
+            if (data == 0) { this->_accept(); }
+            else if (data == 1) { this->_deliver(); }
+            else if (events[i].events & (EPOLLHUP | EPOLLERR)) { this->_close(data); } // the client is gone, and cannot read its responses any more
+            else {
+                if (events[i].events & EPOLLIN) { this->_read(data); }
+                if ((events[i].events & EPOLLOUT) && this->_connections.count(data)) { this->_write(data); }
+            }
+        }
+    }
+
+    this->_stopping.store(true, std::memory_order_relaxed);
+    { std::lock_guard<std::mutex> lock(this->_jobs_lock); this->_jobs.clear(); }
+    this->_jobs_ready.notify_all();
+    for (auto& worker : this->_workers) { worker.join(); }
+    this->_workers.clear();
+    this->_responses.clear();
+    for (auto& connection : this->_connections) { ::close(connection.second.socket); }
+    this->_connections.clear();
+    this->_waiting.clear();
+    this->_in_flight = 0;
+    ::close(this->_epoll);
+    ::close(this->_listener);
+    this->_epoll = this->_listener = -1;
+    ::unlink(this->_path.c_str());
+    return !failed;
+}
+
+// This method makes run return (after the requests being solved are done). It can be called from any thread, or from a signal handler.
+inline void CBU_Server::stop() {
+    this->_stopping.store(true, std::memory_order_relaxed);
+    const uint64_t one = 1;
+    if (::write(this->_wakeup, &one, sizeof(one)) < 0) { } // the eventfd is already signaled
+}
+
+// This method opens the listening socket and the event loop. A socket already at the path is replaced only if no daemon answers on it,
+// and the new one is only for the user of the daemon (it is bound under the umask 077, before the workers start).
+inline bool CBU_Server::_listen() {
+    sockaddr_un address{};
+    if (this->_path.empty() || this->_path.size() >= sizeof(address.sun_path)) { return false; }
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, this->_path.c_str(), this->_path.size() + 1);
+
+    struct stat status{};
+    if (::lstat(this->_path.c_str(), &status) == 0) {
+        if (!S_ISSOCK(status.st_mode)) { return false; }
+        const int probe = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (probe < 0) { return false; }
+        const bool live = ::connect(probe, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0 || errno == EAGAIN; // EAGAIN: its backlog is full
+        ::close(probe);
+        if (live) { return false; }
+        ::unlink(this->_path.c_str());
+    }
+    this->_listener = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (this->_listener < 0) { return false; }
+    const mode_t mask = ::umask(077);
+    const bool bound = ::bind(this->_listener, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0;
+    ::umask(mask);
+    if (!bound || ::listen(this->_listener, SOMAXCONN) != 0) { return false; }
+
+    this->_epoll = ::epoll_create1(EPOLL_CLOEXEC);
+    if (this->_epoll < 0) { return false; }
+    epoll_event listener_event{}, wakeup_event{};
+    listener_event.events = wakeup_event.events = EPOLLIN;
+    listener_event.data.u64 = 0;
+    wakeup_event.data.u64 = 1;
+    return ::epoll_ctl(this->_epoll, EPOLL_CTL_ADD, this->_listener, &listener_event) == 0 && ::epoll_ctl(this->_epoll, EPOLL_CTL_ADD, this->_wakeup, &wakeup_event) == 0;
+}
+
+// This method accepts every client waiting on the listening socket
+inline void CBU_Server::_accept() {
+    while (true) {
+        const int socket = ::accept4(this->_listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (socket < 0) { return; } // EAGAIN (no more clients), or a client that gave up meanwhile
+        const uint64_t connection_id = this->_next_connection++;
+        Connection& connection = this->_connections[connection_id];
+        connection.socket = socket;
+        connection.events = EPOLLIN;
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.u64 = connection_id;
+        if (::epoll_ctl(this->_epoll, EPOLL_CTL_ADD, socket, &event) != 0) {
+            ::close(socket);
+            this->_connections.erase(connection_id);
+        }
+    }
+}
+
+// This method reads what a client sent, and takes its requests (see _split)
+inline void CBU_Server::_read(uint64_t connection_id) {
+    auto it = this->_connections.find(connection_id);
+    if (it == this->_connections.end()) { return; }
+    Connection& connection = it->second;
+    const ssize_t received = ::read(connection.socket, this->_read_buffer.data(), this->_read_buffer.size());
+    if (received < 0 && (errno == EAGAIN || errno == EINTR)) { return; }
+    if (received < 0) { this->_close(connection_id); return; }
+    if (received == 0) {
+        connection.closing = true;
+        if (!connection.input.empty() && connection.input.back() != '\n') { connection.input += '\n'; } // the last request needs no newline
+    }
+    connection.input.append(this->_read_buffer.data(), static_cast<size_t>(received));
+    this->_split(connection_id);
+}
+
+// This method queues the complete request lines of a client for the workers while it is within SERVER_MAX_PENDING and SERVER_MAX_OUTPUT, and all clients within SERVER_MAX_JOBS.
+// The rest stays in its input, and is split when its requests are answered (see _deliver), its responses are written (see _write), or other requests are answered (for SERVER_MAX_JOBS).
+inline void CBU_Server::_split(uint64_t connection_id) {
+    auto it = this->_connections.find(connection_id);
+    if (it == this->_connections.end()) { return; }
+    Connection& connection = it->second;
+    std::vector<Job> jobs;
+    size_t begin = 0, end;
+    connection.held = false;
+    while ((end = connection.input.find('\n', begin)) != std::string::npos) {
+        if (connection.pending + jobs.size() >= SERVER_MAX_PENDING || connection.output.size() >= SERVER_MAX_OUTPUT || this->_in_flight + jobs.size() >= SERVER_MAX_JOBS) {
+            connection.held = true;
+            break;
+        }
+        std::string_view line(connection.input.data() + begin, end - begin);
+        begin = end + 1;
+        if (!line.empty() && line.back() == '\r') { line.remove_suffix(1); }
+        if (line.empty()) { continue; }
+        const size_t space = line.find(' ');
+        jobs.push_back({connection_id, std::string(line.substr(0, space)), (space == std::string_view::npos) ? std::string() : std::string(line.substr(space + 1))});
+    }
+    connection.input.erase(0, begin);
+    if (!connection.held && connection.input.size() > SERVER_MAX_REQUEST) { this->_close(connection_id); return; }
+    if (connection.held && !connection.waiting && this->_in_flight + jobs.size() >= SERVER_MAX_JOBS) {
+        connection.waiting = true;
+        this->_waiting.push_back(connection_id);
+    }
+
+    if (!jobs.empty()) {
+        connection.pending += jobs.size();
+        this->_in_flight += jobs.size();
+        {
+            std::lock_guard<std::mutex> lock(this->_jobs_lock);
+            for (auto& job : jobs) { this->_jobs.push_back(std::move(job)); }
+        }
+        if (jobs.size() == 1) { this->_jobs_ready.notify_one(); } else { this->_jobs_ready.notify_all(); }
+    }
+    if (connection.closing && connection.pending == 0 && connection.output.empty() && connection.input.empty()) { this->_close(connection_id); return; }
+    this->_watch(connection_id, connection);
+}
+
+// This method writes as much of the responses to a client as its socket takes
+inline void CBU_Server::_write(uint64_t connection_id) {
+    Connection& connection = this->_connections[connection_id];
+    size_t written = 0;
+    while (written < connection.output.size()) {
+        const ssize_t sent = ::send(connection.socket, connection.output.data() + written, connection.output.size() - written, MSG_NOSIGNAL);
+        if (sent > 0) { written += static_cast<size_t>(sent); continue; }
+        if (sent < 0 && errno == EINTR) { continue; }
+        if (sent < 0 && errno == EAGAIN) { break; }
+        this->_close(connection_id);
+        return;
+    }
+    connection.output.erase(0, written);
+    this->_split(connection_id); // the requests held for SERVER_MAX_OUTPUT (or for the responses just added, see _deliver)
+}
+
+// This method watches a client for what it can do now: send requests (unless it has hung up, or its requests are held or past a limit) and take responses (if there are any to write)
+inline void CBU_Server::_watch(uint64_t connection_id, Connection& connection) {
+    const bool reading = !connection.closing && !connection.held && connection.pending < SERVER_MAX_PENDING && connection.output.size() < SERVER_MAX_OUTPUT;
+    const uint32_t events = (reading ? static_cast<uint32_t>(EPOLLIN) : 0u) | (connection.output.empty() ? 0u : static_cast<uint32_t>(EPOLLOUT));
+    if (events == connection.events) { return; }
+    epoll_event event{};
+    event.events = events;
+    event.data.u64 = connection_id;
+    ::epoll_ctl(this->_epoll, EPOLL_CTL_MOD, connection.socket, &event);
+    connection.events = events;
+}
+
+inline void CBU_Server::_close(uint64_t connection_id) {
+    auto it = this->_connections.find(connection_id);
+    if (it == this->_connections.end()) { return; }
+    ::epoll_ctl(this->_epoll, EPOLL_CTL_DEL, it->second.socket, nullptr);
+    ::close(it->second.socket);
+    this->_connections.erase(it);
+}
+
+// This method hands the responses of the workers to their clients (the responses to closed connections are dropped), and then takes the requests that waited for SERVER_MAX_JOBS
+inline void CBU_Server::_deliver() {
+    uint64_t signaled;
+    if (::read(this->_wakeup, &signaled, sizeof(signaled)) < 0) { } // the eventfd is reset, nothing else to do
+    std::vector<Response> responses;
+    {
+        std::lock_guard<std::mutex> lock(this->_responses_lock);
+        responses.swap(this->_responses);
+    }
+    std::vector<uint64_t> written;
+    this->_in_flight -= responses.size();
+    for (auto& response : responses) {
+        auto it = this->_connections.find(response.connection);
+        if (it == this->_connections.end()) { continue; }
+        it->second.output += response.text;
+        it->second.pending--;
+        written.push_back(response.connection);
+    }
+    std::sort(written.begin(), written.end());
+    written.erase(std::unique(written.begin(), written.end()), written.end());
+    for (const auto& connection_id : written) {
+        if (this->_connections.count(connection_id)) { this->_write(connection_id); }
+    }
+    while (!this->_waiting.empty() && this->_in_flight < SERVER_MAX_JOBS) {
+        const uint64_t connection_id = this->_waiting.front();
+        this->_waiting.pop_front();
+        auto it = this->_connections.find(connection_id);
+        if (it == this->_connections.end()) { continue; }
+        it->second.waiting = false;
+        this->_split(connection_id);
+    }
+}
+
+// This method is run by each worker: it solves the queued requests one by one until the daemon stops
+inline void CBU_Server::_work() {
+    while (true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(this->_jobs_lock);
+            this->_jobs_ready.wait(lock, [this]() { return this->_stopping.load(std::memory_order_relaxed) || !this->_jobs.empty(); });
+            if (this->_stopping.load(std::memory_order_relaxed)) { return; }
+            job = std::move(this->_jobs.front());
+            this->_jobs.pop_front();
+        }
+        std::string text = CBU_Server::_respond(job.id, this->_balancer.solve(job.equation));
+        {
+            std::lock_guard<std::mutex> lock(this->_responses_lock);
+            this->_responses.push_back({job.connection, std::move(text)});
+        }
+        const uint64_t one = 1;
+        if (::write(this->_wakeup, &one, sizeof(one)) < 0) { } // the eventfd is already signaled
+    }
+}
+
+// This method reads the command line of the daemon ("--serve PATH" and its settings) into path and options, false if it is invalid
+inline bool CBU_Server::parse_arguments(int argc, char** argv, std::string& path, CBU_Options& options) {
+    for (int i = 1; i < argc; i++) {
+        const std::string_view argument = argv[i];
+        const bool has_value = (i + 1 < argc);
+        if (argument == "--single") { options.multiple_results = false; }
+        else if (argument == "--serve" && has_value) { path = argv[++i]; }
+        else if (argument == "--max-coef" && has_value) { options.max_coef = std::strtoul(argv[++i], nullptr, 10); }
+        else if (argument == "--threads" && has_value) { options.thread_count = std::strtoul(argv[++i], nullptr, 10); }
+        else if (argument == "--result-cache" && has_value) { options.result_cache = std::make_shared<CBU_Result_cache>(argv[++i]); }
+        else if (argument == "--solver" && has_value) { if (!CBU_Balancer::solver_from_name(argv[++i], options.solver)) { return false; } }
+        else { return false; }
+    }
+    return !path.empty() && options.max_coef > 0;
+}
+
+// This method writes the response line of a request: its id, the name of its error, and each result (separated by " ; ")
+inline std::string CBU_Server::_respond(const std::string& id, const CBU_Result& result) {
+    std::string text = id + ' ' + std::string(CBU_Balancer::error_name(result.error));
+    std::string results = CBU_Balancer::get_result(result);
+    if (!result.coefficients.empty() && !results.empty()) {
+        text += ' ';
+        for (const char c : results) {
+            if (c == '\n') { text += " ; "; } else { text += c; }
+        }
+    }
+    text += '\n';
+    return text;
+}
+
+#endif // __linux__
+
+#endif // CBU_SERVER_H
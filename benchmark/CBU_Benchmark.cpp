@@ -0,0 +1,321 @@
+// Copyright (c) 2024 Frank Yang
+// All rights reserved.
+//
+// This code is proprietary and confidential.
+// Unauthorized copying of this file, via any medium is strictly prohibited.
+
+// The benchmark of CBU_Balancer. It balances each equation of a corpus many times with each chosen solver,
+// times every stage of the balancing separately, counts the allocations, and writes the results as JSON.
+//
+// Usage: cbu_benchmark [--corpus PATH] [--solver recursion,pruned,parallel,nullspace,modular,hilbert] [--single] [--max-coef N]
+//                      [--min-time MS] [--recursion-limit N] [--output PATH]
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
+#include <new>
+#include "CBU_Balancer.h"
+
+#ifndef CBU_BENCHMARK_CORPUS
+#define CBU_BENCHMARK_CORPUS "benchmark/corpus.txt"
+#endif
+#define DEFAULT_MIN_TIME_MS 100 // each equation is balanced for at least this long
+#define MIN_ITERATIONS 5 // and at least this many times
+#define MAX_ITERATIONS 100000
+#define DEFAULT_RECURSION_LIMIT 6 // CBU_Solver::RECURSION skips the equations with more compounds (its cost is max_coef to the power of the compounds)
+
+// Every allocation of the program is counted
+static std::atomic<size_t> allocation_count(0);
+static std::atomic<size_t> allocated_bytes(0);
+
+void* operator new(std::size_t size) {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+    if (void* pointer = std::malloc(size != 0 ? size : 1)) { return pointer; }
+    throw std::bad_alloc();
+}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete" // GCC takes the replaced operator new for a mismatch of std::free
+#endif
+void operator delete(void* pointer) noexcept { std::free(pointer); }
+void operator delete(void* pointer, std::size_t) noexcept { std::free(pointer); }
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+class CBU_Benchmark {
+public:
+    enum Stage { PARSE, BUILD, PRESOLVE, SOLVE, FILTER, STAGE_COUNT };
+
+    struct Settings {
+        std::string corpus = CBU_BENCHMARK_CORPUS;
+        std::vector<CBU_Solver> solvers = {CBU_Solver::RECURSION, CBU_Solver::PRUNED_RECURSION, CBU_Solver::NULLSPACE};
+        bool multiple_results = true;
+        unsigned max_coef = DEFAULT_MAX_COEF;
+        double min_time_ms = DEFAULT_MIN_TIME_MS;
+        size_t recursion_limit = DEFAULT_RECURSION_LIMIT;
+        std::string output; // empty means std::cout
+    };
+
+    // The measurements of one balancing (one iteration)
+    struct Sample {
+        uint64_t total_ns = 0;
+        std::array<uint64_t, STAGE_COUNT> stage_ns{};
+        size_t allocations = 0;
+        size_t bytes = 0;
+        std::array<size_t, STAGE_COUNT> stage_allocations{};
+    };
+
+    static bool parse_arguments(int argc, char** argv, Settings& settings);
+    static int run(const Settings& settings);
+private:
+    static std::vector<std::string> _read_corpus(const std::string& path);
+    static CBU_Error _balance_once(CBU_Balancer& balancer, const std::string& equation, Sample& sample);
+    static void _write_run(std::ostream& out, const std::string& equation, size_t compounds, size_t elements, size_t results, CBU_Error error,
+                           const CBU_Stats& search, std::vector<Sample>& samples);
+    static std::string _escape(std::string_view str);
+};
+
+// This method balances an equation once, through the same stages as CBU_Balancer::balance, and measures each stage.
+CBU_Error CBU_Benchmark::_balance_once(CBU_Balancer& balancer, const std::string& equation, Sample& sample) {
+    using clock = std::chrono::steady_clock;
+    balancer.clear_data();
+    const size_t allocations_begin = allocation_count.load(std::memory_order_relaxed);
+    const size_t bytes_begin = allocated_bytes.load(std::memory_order_relaxed);
+    const auto begin = clock::now();
+    auto stage_begin = begin;
+    size_t stage_allocations_begin = allocations_begin;
+    auto end_stage = [&](Stage stage) {
+        const auto now = clock::now();
+        const size_t allocations_now = allocation_count.load(std::memory_order_relaxed);
+        sample.stage_ns[stage] = std::chrono::duration_cast<std::chrono::nanoseconds>(now - stage_begin).count();
+        sample.stage_allocations[stage] = allocations_now - stage_allocations_begin;
+        stage_begin = now;
+        stage_allocations_begin = allocations_now;
+    };
+    auto end_sample = [&](CBU_Error error) {
+        sample.total_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - begin).count();
+        sample.allocations = allocation_count.load(std::memory_order_relaxed) - allocations_begin;
+        sample.bytes = allocated_bytes.load(std::memory_order_relaxed) - bytes_begin;
+        return error;
+    };
+
+    // Parsing (_get_compounds_str, _get_compound_composition), in the workspace of the balancer as balance does
+    std::pair<std::vector<std::string>, std::vector<std::string>>& compounds_str = balancer._reactants_and_products;
+    std::vector<CBU_Composition>& reactants_composition = balancer._workspace.reactants_composition;
+    std::vector<CBU_Composition>& products_composition = balancer._workspace.products_composition;
+    std::vector<unsigned>& elements = balancer._workspace.elements;
+    CBU_Error error = CBU_Balancer::_get_compounds_str(equation, compounds_str);
+    if (error == CBU_Error::NONE) {
+        error = balancer._parse_compounds(compounds_str.first, compounds_str.second, reactants_composition, products_composition, elements);
+    }
+    end_stage(PARSE);
+    if (error != CBU_Error::NONE) { return end_sample(error); }
+
+    // Matrix build (_build_main_matrix)
+    for (const auto& element : elements) { balancer._elements.emplace_back(CBU_Elements::symbol(element)); }
+    balancer._build_main_matrix(reactants_composition, products_composition, elements);
+    end_stage(BUILD);
+
+    // Presolving (_presolve)
+    balancer._presolve();
+    end_stage(PRESOLVE);
+
+    // Solving (_solving_matrix_using_*)
+    error = balancer._solve_matrix();
+    end_stage(SOLVE);
+    if (error != CBU_Error::NONE) { return end_sample(error); }
+
+    // Filtering (_filter_linear_independent_results)
+    balancer._filter_linear_independent_results();
+    end_stage(FILTER);
+    return end_sample(balancer._results_coefs.empty() ? CBU_Error::FAILED_TO_BALANCE : CBU_Error::NONE);
+}
+
+// This method runs the whole benchmark and writes its JSON report
+int CBU_Benchmark::run(const Settings& settings) {
+    const std::vector<std::string> corpus = CBU_Benchmark::_read_corpus(settings.corpus);
+    if (corpus.empty()) {
+        std::cerr << "No equation in the corpus " << settings.corpus << std::endl;
+        return 1;
+    }
+
+    std::ofstream file;
+    if (!settings.output.empty()) {
+        file.open(settings.output);
+        if (!file) {
+            std::cerr << "Cannot write " << settings.output << std::endl;
+            return 1;
+        }
+    }
+    std::ostream& out = settings.output.empty() ? std::cout : file;
+
+    out << "{\n  \"version\": \"" << CBU_Benchmark::_escape(CBU_Balancer::version().substr(0, CBU_Balancer::version().find('\n'))) << "\",\n";
+#ifdef __VERSION__
+    out << "  \"compiler\": \"" << CBU_Benchmark::_escape(__VERSION__) << "\",\n";
+#endif
+#ifdef NDEBUG
+    out << "  \"assertions\": false,\n";
+#else
+    out << "  \"assertions\": true,\n";
+#endif
+    out << "  \"timestamp\": " << std::time(nullptr) << ",\n";
+    out << "  \"corpus\": \"" << CBU_Benchmark::_escape(settings.corpus) << "\",\n";
+    out << "  \"equations\": " << corpus.size() << ",\n";
+    out << "  \"multiple_results\": " << (settings.multiple_results ? "true" : "false") << ",\n";
+    out << "  \"max_coef\": " << settings.max_coef << ",\n";
+    out << "  \"solvers\": [";
+
+    for (size_t s = 0; s < settings.solvers.size(); s++) {
+        const CBU_Solver solver = settings.solvers[s];
+        CBU_Options options;
+        options.multiple_results = settings.multiple_results;
+        options.max_coef = settings.max_coef;
+        options.log_status = false;
+        options.solver = solver;
+        options.sink = nullptr;
+        CBU_Balancer balancer(options);
+
+        out << (s == 0 ? "\n" : ",\n") << "    {\n      \"solver\": \"" << CBU_Balancer::solver_name(solver) << "\",\n      \"runs\": [";
+        double corpus_ns = 0; // the sum of the mean latencies of the measured equations
+        size_t measured = 0, balanced = 0, skipped = 0;
+        std::vector<Sample> samples;
+        for (size_t e = 0; e < corpus.size(); e++) {
+            const std::string& equation = corpus[e];
+            out << (e == 0 ? "\n" : ",\n");
+
+            std::pair<std::vector<std::string>, std::vector<std::string>> compounds_str;
+            CBU_Balancer::_get_compounds_str(equation, compounds_str);
+            const size_t compounds = compounds_str.first.size() + compounds_str.second.size();
+            if (solver == CBU_Solver::RECURSION && compounds > settings.recursion_limit) {
+                out << "        {\"equation\": \"" << CBU_Benchmark::_escape(equation) << "\", \"compounds\": " << compounds << ", \"skipped\": true}";
+                skipped++;
+                continue;
+            }
+
+            Sample warmup; // fills the caches and the reused buffers, and counts the search nodes (they are the same in every iteration)
+            balancer.reset_stats();
+            CBU_Error error = CBU_Benchmark::_balance_once(balancer, equation, warmup);
+            const CBU_Stats search = balancer.get_stats();
+            samples.clear();
+            const auto begin = std::chrono::steady_clock::now();
+            while (samples.size() < MAX_ITERATIONS) {
+                Sample sample;
+                error = CBU_Benchmark::_balance_once(balancer, equation, sample);
+                samples.push_back(sample);
+                const double elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+                if (samples.size() >= MIN_ITERATIONS && elapsed_ms >= settings.min_time_ms) { break; }
+            }
+
+            double total_ns = 0;
+            for (const auto& sample : samples) { total_ns += static_cast<double>(sample.total_ns); }
+            corpus_ns += total_ns / static_cast<double>(samples.size());
+            measured++;
+            if (error == CBU_Error::NONE) { balanced++; }
+            CBU_Benchmark::_write_run(out, equation, compounds, balancer._elements.size(), balancer._results_coefs.size(), error, search, samples);
+        }
+        out << "\n      ],\n      \"summary\": {\"measured\": " << measured << ", \"balanced\": " << balanced << ", \"skipped\": " << skipped
+            << ", \"corpus_ns\": " << static_cast<uint64_t>(corpus_ns)
+            << ", \"throughput_eq_per_s\": " << ((corpus_ns > 0) ? static_cast<double>(measured) * 1e9 / corpus_ns : 0.0) << "}\n    }";
+    }
+    out << "\n  ]\n}" << std::endl;
+    return 0;
+}
+
+// This method writes the statistics of the samples of one equation (the samples are sorted in place)
+void CBU_Benchmark::_write_run(std::ostream& out, const std::string& equation, size_t compounds, size_t elements, size_t results, CBU_Error error,
+                               const CBU_Stats& search, std::vector<Sample>& samples) {
+    static const char* const stage_names[STAGE_COUNT] = {"parse", "build", "presolve", "solve", "filter"};
+    const size_t n = samples.size();
+    auto percentile = [n](const std::vector<uint64_t>& sorted, double p) { return sorted[std::min(n - 1, static_cast<size_t>(p * static_cast<double>(n - 1) + 0.5))]; };
+    auto mean = [n](const std::vector<uint64_t>& values) { return std::accumulate(values.begin(), values.end(), 0.0) / static_cast<double>(n); };
+
+    std::vector<uint64_t> values(n);
+    for (size_t i = 0; i < n; i++) { values[i] = samples[i].total_ns; }
+    std::sort(values.begin(), values.end());
+    const double mean_ns = mean(values);
+
+    out << "        {\"equation\": \"" << CBU_Benchmark::_escape(equation) << "\", \"compounds\": " << compounds << ", \"elements\": " << elements
+        << ", \"results\": " << results << ", \"error\": \"" << CBU_Balancer::error_name(error) << "\", \"iterations\": " << n
+        << ",\n         \"throughput_eq_per_s\": " << ((mean_ns > 0) ? 1e9 / mean_ns : 0.0)
+        << ", \"latency_ns\": {\"mean\": " << static_cast<uint64_t>(mean_ns) << ", \"p50\": " << percentile(values, 0.50) << ", \"p90\": " << percentile(values, 0.90)
+        << ", \"p99\": " << percentile(values, 0.99) << ", \"max\": " << values.back() << "}";
+
+    for (size_t i = 0; i < n; i++) { values[i] = samples[i].allocations; }
+    const double allocations = mean(values);
+    for (size_t i = 0; i < n; i++) { values[i] = samples[i].bytes; }
+    out << ",\n         \"search\": {\"nodes\": " << search.nodes << ", \"leaves\": " << search.leaves << ", \"prunes\": " << search.prunes << "}";
+    out << ",\n         \"allocations\": " << allocations << ", \"allocated_bytes\": " << mean(values) << ",\n         \"stages\": {";
+
+    for (size_t stage = 0; stage < STAGE_COUNT; stage++) {
+        for (size_t i = 0; i < n; i++) { values[i] = samples[i].stage_allocations[stage]; }
+        const double stage_allocations = mean(values);
+        for (size_t i = 0; i < n; i++) { values[i] = samples[i].stage_ns[stage]; }
+        std::sort(values.begin(), values.end());
+        out << (stage == 0 ? "" : ", ") << "\"" << stage_names[stage] << "\": {\"mean_ns\": " << static_cast<uint64_t>(mean(values))
+            << ", \"p50_ns\": " << percentile(values, 0.50) << ", \"p99_ns\": " << percentile(values, 0.99) << ", \"allocations\": " << stage_allocations << "}";
+    }
+    out << "}}";
+}
+
+// This method reads the corpus (one equation per line, "#" starts a comment)
+std::vector<std::string> CBU_Benchmark::_read_corpus(const std::string& path) {
+    std::vector<std::string> corpus;
+    std::ifstream file(path);
+    std::string line;
+    while (std::getline(file, line)) {
+        line = line.substr(0, line.find('#'));
+        const size_t begin = line.find_first_not_of(" \t\r");
+        if (begin == std::string::npos) { continue; }
+        corpus.push_back(line.substr(begin, line.find_last_not_of(" \t\r") + 1 - begin));
+    }
+    return corpus;
+}
+
+std::string CBU_Benchmark::_escape(std::string_view str) {
+    std::string escaped;
+    for (const char c : str) {
+        if (c == '"' || c == '\\') { escaped += '\\'; }
+        escaped += c;
+    }
+    return escaped;
+}
+
+// This method reads the command line into the settings, false if it is invalid
+bool CBU_Benchmark::parse_arguments(int argc, char** argv, Settings& settings) {
+    for (int i = 1; i < argc; i++) {
+        const std::string_view argument = argv[i];
+        const bool has_value = (i + 1 < argc);
+        if (argument == "--single") { settings.multiple_results = false; }
+        else if (argument == "--corpus" && has_value) { settings.corpus = argv[++i]; }
+        else if (argument == "--output" && has_value) { settings.output = argv[++i]; }
+        else if (argument == "--max-coef" && has_value) { settings.max_coef = std::strtoul(argv[++i], nullptr, 10); }
+        else if (argument == "--min-time" && has_value) { settings.min_time_ms = std::strtod(argv[++i], nullptr); }
+        else if (argument == "--recursion-limit" && has_value) { settings.recursion_limit = std::strtoul(argv[++i], nullptr, 10); }
+        else if (argument == "--solver" && has_value) {
+            settings.solvers.clear();
+            std::stringstream names(argv[++i]);
+            std::string name;
+            while (std::getline(names, name, ',')) {
+                CBU_Solver solver;
+                if (!CBU_Balancer::solver_from_name(name, solver)) { return false; }
+                settings.solvers.push_back(solver);
+            }
+        } else { return false; }
+    }
+    return !settings.solvers.empty() && settings.max_coef > 0;
+}
+
+int main(int argc, char** argv) {
+    CBU_Benchmark::Settings settings;
+    if (!CBU_Benchmark::parse_arguments(argc, argv, settings)) {
+        std::cerr << "Usage: " << argv[0] << " [--corpus PATH] [--solver recursion,pruned,parallel,nullspace,modular,hilbert] [--single] [--max-coef N]"
+                  << " [--min-time MS] [--recursion-limit N] [--output PATH]" << std::endl;
+        return 2;
+    }
+    return CBU_Benchmark::run(settings);
+}
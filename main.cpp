@@ -0,0 +1,78 @@
+// Copyright (c) 2024 Frank Yang
+// All rights reserved.
+//
+// This code is proprietary and confidential.
+// Unauthorized copying of this file, via any medium is strictly prohibited.
+
+#include "CBU_Console.h"
+#include "CBU_Server.h"
+#include <csignal>
+
+#define SERVE_USAGE " --serve SOCKET [--solver recursion|pruned|parallel|nullspace|modular|hilbert] [--single] [--max-coef N] [--threads N] [--result-cache PATH]"
+#define BATCH_USAGE " --batch [--input PATH] [--output PATH] [--json] [--solver recursion|pruned|parallel|nullspace|modular|hilbert] [--single] [--max-coef N] [--threads N] [--result-cache PATH]"
+
+#ifdef CBU_SERVER
+static CBU_Server* running_server = nullptr;
+
+// Usage: cbu_console --serve SOCKET [--solver recursion|pruned|parallel|nullspace|modular|hilbert] [--single] [--max-coef N] [--threads N] [--result-cache PATH]
+// runs the balancing daemon (see CBU_Server) until SIGINT or SIGTERM, instead of the console
+static int serve(int argc, char** argv) {
+    std::string path;
+    CBU_Options options;
+    options.log_status = false;
+    options.sink = nullptr; // a failed equation is answered, not reported
+    options.cache = std::make_shared<CBU_Composition_cache>();
+    if (!CBU_Server::parse_arguments(argc, argv, path, options)) {
+        std::cerr << "Usage: " << argv[0] << SERVE_USAGE << std::endl;
+        return 2;
+    }
+    CBU_Server server(path, options);
+    running_server = &server;
+    std::signal(SIGINT, [](int) { running_server->stop(); });
+    std::signal(SIGTERM, [](int) { running_server->stop(); });
+    if (!server.run()) {
+        std::cerr << "Cannot listen on " << path << std::endl;
+        return 1;
+    }
+    return 0;
+}
+#endif
+
+// Usage: cbu_console --batch [--input PATH] [--output PATH] [--json] [--solver NAME] [--single] [--max-coef N] [--threads N] [--result-cache PATH]
+// balances every line of the input (see CBU_Console::batch), instead of the console
+static int batch(int argc, char** argv) {
+    CBU_Console::Batch_settings settings;
+    if (!CBU_Console::parse_arguments(argc, argv, settings)) {
+        std::cerr << "Usage: " << argv[0] << BATCH_USAGE << std::endl;
+        return 2;
+    }
+    return CBU_Console::batch(settings);
+}
+
+// This method tells if the command line has a flag, in any position
+static bool has_flag(int argc, char** argv, std::string_view flag) {
+    for (int i = 1; i < argc; i++) {
+        if (argv[i] == flag) { return true; }
+    }
+    return false;
+}
+
+// Usage: cbu_console (the interactive console), or one of the modes above, chosen by its flag (--serve or --batch, in any position)
+int main(int argc, char** argv) {
+    const bool serving = has_flag(argc, argv, "--serve"), batching = has_flag(argc, argv, "--batch");
+#ifdef CBU_SERVER
+    if (serving && !batching) { return serve(argc, argv); }
+#endif
+    if (batching && !serving) { return batch(argc, argv); }
+    if (argc > 1) {
+        std::cerr << "Usage: " << argv[0] << std::endl;
+#ifdef CBU_SERVER
+        std::cerr << "       " << argv[0] << SERVE_USAGE << std::endl;
+#endif
+        std::cerr << "       " << argv[0] << BATCH_USAGE << std::endl;
+        return 2;
+    }
+    CBU_Console console;
+    console.boot();
+    return 0;
+}
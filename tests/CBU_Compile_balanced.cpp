@@ -0,0 +1,41 @@
+//
+// Created and edited by Frank Yang on 7/14/24.
+//
+
+// Copyright (c) 2024 Frank Yang
+// All rights reserved.
+//
+// This code is proprietary and confidential.
+// Unauthorized copying of this file, via any medium is strictly prohibited.
+
+
+// CBU_balanced (C++20): the equations below are balanced while this file compiles.
+// Built with CBU_COMPILE_FAIL set to a case, it must not compile, and its message must tell why (see CMakeLists.txt).
+
+#include "CBU_Test.h"
+
+#if !defined(__cpp_consteval) || !defined(__cpp_nontype_template_args) || __cpp_nontype_template_args < 201911L
+#error "CBU_Compile_balanced needs C++20"
+#endif
+
+static_assert(CBU_balanced<"Zn+HCl->ZnCl2+H2">() == std::array<unsigned, 4>{1, 2, 1, 1});
+static_assert(CBU_balanced<"KMnO4+HCl->KCl+MnCl2+Cl2+H2O">() == std::array<unsigned, 6>{2, 16, 2, 2, 5, 8});
+static_assert(CBU_balanced<"Ca(OH)2 + H3PO4 -> Ca3(PO4)2 + H2O">() == std::array<unsigned, 4>{3, 2, 1, 6});
+static_assert(CBU_balanced<"CuSO4.5H2O->CuSO4+H2O">() == std::array<unsigned, 3>{1, 1, 5});
+
+#if CBU_COMPILE_FAIL == 1
+constexpr auto coefficients = CBU_balanced<"H2+O2->H2O2+NaCl">(); // "an element is on one side of the equation only"
+#elif CBU_COMPILE_FAIL == 2
+constexpr auto coefficients = CBU_balanced<"H2O->H2O2">(); // "the equation cannot be balanced"
+#elif CBU_COMPILE_FAIL == 3
+constexpr auto coefficients = CBU_balanced<"Fe2O3+C->Fe+CO+CO2">(); // "the equation is underdetermined"
+#elif CBU_COMPILE_FAIL == 4
+constexpr auto coefficients = CBU_balanced<"H2+O2=H2O">(); // "the equation needs exactly one"
+#elif CBU_COMPILE_FAIL == 5
+constexpr auto coefficients = CBU_balanced<"C++O2->CO2">(); // "an empty compound"
+#endif
+
+int main() {
+    CBU_CHECK(CBU_balanced<"H2+O2->H2O">() == (std::array<unsigned, 3>{2, 1, 2}));
+    return CBU_Test::finish("CBU_Compile_balanced");
+}
@@ -0,0 +1,27 @@
+//
+// Created and edited by Frank Yang on 7/14/24.
+//
+
+// Copyright (c) 2024 Frank Yang
+// All rights reserved.
+//
+// This code is proprietary and confidential.
+// Unauthorized copying of this file, via any medium is strictly prohibited.
+
+
+// The headers are used by more than one translation unit: this file and tests/CBU_Link_other.cpp include them all and are linked into CBU_Link.
+// A function defined in a header without inline makes the link fail (multiple definition).
+
+#include "CBU_Test.h"
+#include "CBU_Console.h"
+#include "CBU_Server.h"
+
+std::string balance_in_other_unit(const std::string& equation);
+
+int main() {
+    CBU_Balancer balancer;
+    balancer.balance("H2+O2->H2O");
+    CBU_CHECK_EQUAL(balancer.get_error(), CBU_Error::NONE);
+    CBU_CHECK_EQUAL(balance_in_other_unit("H2+O2->H2O"), balancer.get_result());
+    return CBU_Test::finish("CBU_Link");
+}
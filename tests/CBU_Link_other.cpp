@@ -0,0 +1,23 @@
+//
+// Created and edited by Frank Yang on 7/14/24.
+//
+
+// Copyright (c) 2024 Frank Yang
+// All rights reserved.
+//
+// This code is proprietary and confidential.
+// Unauthorized copying of this file, via any medium is strictly prohibited.
+
+
+// The second translation unit of CBU_Link (see tests/CBU_Link_main.cpp): it includes the same headers and balances with them too.
+
+#include "CBU_Balancer.h"
+#include "CBU_Console.h"
+#include "CBU_Server.h"
+
+// This method balances an equation in this translation unit
+std::string balance_in_other_unit(const std::string& equation) {
+    CBU_Balancer balancer;
+    balancer.balance(equation);
+    return balancer.get_result();
+}
@@ -0,0 +1,70 @@
+//
+// Created and edited by Frank Yang on 7/14/24.
+//
+
+// Copyright (c) 2024 Frank Yang
+// All rights reserved.
+//
+// This code is proprietary and confidential.
+// Unauthorized copying of this file, via any medium is strictly prohibited.
+
+
+// The checks shared by the tests under tests/ (one executable per file, run by ctest).
+// A failed CBU_CHECK prints its file, line and expression and the test goes on; main returns CBU_Test::finish(), which is non-zero if any check failed.
+
+#ifndef CBU_TEST_H
+#define CBU_TEST_H
+
+#include "CBU_Balancer.h"
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#define CBU_CHECK(condition) CBU_Test::check((condition), #condition, __FILE__, __LINE__)
+#define CBU_CHECK_EQUAL(actual, expected) CBU_Test::check((actual) == (expected), #actual " == " #expected, __FILE__, __LINE__)
+
+class CBU_Test {
+private:
+    static size_t& _failures() { static size_t failures = 0; return failures; }
+    static size_t& _checks() { static size_t checks = 0; return checks; }
+public:
+    static bool check(bool passed, const char* expression, const char* file, int line) {
+        CBU_Test::_checks()++;
+        if (!passed) {
+            CBU_Test::_failures()++;
+            std::cerr << file << ":" << line << ": check failed: " << expression << std::endl;
+        }
+        return passed;
+    }
+
+    // This method prints the summary of the test and gives its exit code
+    static int finish(const char* name) {
+        std::cout << name << ": " << CBU_Test::_checks() - CBU_Test::_failures() << "/" << CBU_Test::_checks() << " checks passed" << std::endl;
+        return CBU_Test::_failures() == 0 ? 0 : 1;
+    }
+
+    // This method gives quiet options (no diagnostics) for a solver
+    static CBU_Options options(CBU_Solver solver, bool multiple_results = true, unsigned max_coef = DEFAULT_MAX_COEF) {
+        CBU_Options options;
+        options.solver = solver;
+        options.multiple_results = multiple_results;
+        options.max_coef = max_coef;
+        options.log_status = false;
+        options.sink = nullptr;
+        return options;
+    }
+
+    // This method reads the equations of the benchmark corpus (CBU_TEST_CORPUS, "#" starts a comment)
+    static std::vector<std::string> corpus() {
+        std::vector<std::string> equations;
+        std::ifstream input(CBU_TEST_CORPUS);
+        std::string line;
+        while (std::getline(input, line)) {
+            if (!line.empty() && line[0] != '#') { equations.push_back(line); }
+        }
+        return equations;
+    }
+};
+
+#endif //CBU_TEST_H
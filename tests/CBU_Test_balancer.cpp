@@ -0,0 +1,315 @@
+//
+// Created and edited by Frank Yang on 7/14/24.
+//
+
+// Copyright (c) 2024 Frank Yang
+// All rights reserved.
+//
+// This code is proprietary and confidential.
+// Unauthorized copying of this file, via any medium is strictly prohibited.
+
+
+// The balancing itself: the results of each solver (against each other, over the benchmark corpus), the error codes, and the stored, reentrant, batch, set and lazy interfaces.
+
+#include "CBU_Test.h"
+
+using Results = std::vector<std::vector<unsigned>>;
+
+static Results solve(const std::string& equation, CBU_Solver solver, bool multiple_results = true, CBU_Error* error = nullptr) {
+    CBU_Result result = CBU_Balancer::solve(equation, CBU_Test::options(solver, multiple_results));
+    if (error) { *error = result.error; }
+    return result.coefficients;
+}
+
+static void test_known_results() {
+    for (CBU_Solver solver : {CBU_Solver::RECURSION, CBU_Solver::PRUNED_RECURSION, CBU_Solver::PARALLEL_RECURSION, CBU_Solver::NULLSPACE, CBU_Solver::MODULAR_NULLSPACE, CBU_Solver::HILBERT_BASIS}) {
+        CBU_CHECK(solve("H2+O2->H2O", solver) == (Results{{2, 1, 2}}));
+        CBU_CHECK(solve("Zn + HCl -> ZnCl2 + H2", solver) == (Results{{1, 2, 1, 1}}));
+        CBU_CHECK(solve("Ca(OH)2+H3PO4->Ca3(PO4)2+H2O", solver) == (Results{{3, 2, 1, 6}}));
+        CBU_CHECK(solve("CuSO4.5H2O->CuSO4+H2O", solver) == (Results{{1, 1, 5}}));
+    }
+    // The spaces are not part of any compound, even inside the arrow
+    CBU_CHECK(solve("H2 + O2 - > H2O", CBU_Solver::NULLSPACE) == (Results{{2, 1, 2}}));
+    CBU_CHECK(solve(" H2+ O2 -\t>H2O ", CBU_Solver::RECURSION) == (Results{{2, 1, 2}}));
+    // Beyond DEFAULT_MAX_COEF, only the nullspace solvers balance it
+    CBU_CHECK(solve("K4Fe(CN)6+KMnO4+H2SO4->KHSO4+Fe2(SO4)3+MnSO4+HNO3+CO2+H2O", CBU_Solver::NULLSPACE, false) == (Results{{10, 122, 299, 162, 5, 122, 60, 60, 188}}));
+}
+
+// The recursion solvers list the same results in the same order, and the nullspace solvers agree with each other
+static void test_solvers_agree_on_corpus() {
+    for (const std::string& equation : CBU_Test::corpus()) {
+        CBU_Error pruned_error, parallel_error, nullspace_error, modular_error;
+        const Results pruned = solve(equation, CBU_Solver::PRUNED_RECURSION, true, &pruned_error);
+        CBU_CHECK(solve(equation, CBU_Solver::PARALLEL_RECURSION, true, &parallel_error) == pruned);
+        CBU_CHECK_EQUAL(parallel_error, pruned_error);
+        const Results nullspace = solve(equation, CBU_Solver::NULLSPACE, true, &nullspace_error);
+        CBU_CHECK(solve(equation, CBU_Solver::MODULAR_NULLSPACE, true, &modular_error) == nullspace);
+        CBU_CHECK_EQUAL(modular_error, nullspace_error);
+
+        // A uniquely balanced equation within max_coef has the same result for both kinds of solvers
+        if (nullspace.size() == 1 && *std::max_element(nullspace[0].begin(), nullspace[0].end()) <= DEFAULT_MAX_COEF) {
+            CBU_CHECK(pruned == nullspace);
+            CBU_CHECK(solve(equation, CBU_Solver::PRUNED_RECURSION, false) == nullspace);
+        }
+    }
+    for (const char* equation : {"H2+O2->H2O", "Fe+O2->Fe2O3", "NaOH+H2SO4->Na2SO4+H2O", "H2+O2->H2O+H2O2", "C+O2->CO+CO2"}) {
+        CBU_CHECK(solve(equation, CBU_Solver::RECURSION) == solve(equation, CBU_Solver::PRUNED_RECURSION));
+    }
+}
+
+static void test_errors() {
+    const std::pair<const char*, CBU_Error> cases[] = {
+        {"H2+O2", CBU_Error::INVALID_EQUATION},
+        {"H2->H2->H2", CBU_Error::INVALID_EQUATION},
+        {"H2 - > H2 - > H2", CBU_Error::INVALID_EQUATION},
+        {"H2-->H2", CBU_Error::INVALID_CHAR},
+        {"H2 + O2 -> ", CBU_Error::INCOMPLETE_EQUATION},
+        {"C++O2->CO2", CBU_Error::INCOMPLETE_REACTANT},
+        {"Ca((OH)2->CaO+H2O", CBU_Error::UNMATCHED_PARENTHESES},
+        {"Ca()->Ca", CBU_Error::INVALID_COMPOUND},
+        {"CuSO4.5->CuSO4", CBU_Error::INVALID_COMPOUND},
+        {"c26->C", CBU_Error::INVALID_CHAR_OR_CHAR_POSITION},
+        {"H$->H", CBU_Error::INVALID_CHAR},
+        {"H4294967296->H", CBU_Error::COEFFICIENT_OVERFLOW},
+        {"H2147483648->H", CBU_Error::COEFFICIENT_OVERFLOW}, // a count must fit in a matrix entry
+        {"H4294967294+H4->H2", CBU_Error::COEFFICIENT_OVERFLOW},
+        {"(H2)1073741824->H", CBU_Error::COEFFICIENT_OVERFLOW},
+        {"H2147483647H->H", CBU_Error::COEFFICIENT_OVERFLOW}, // the merged count of an element
+        {"H2->O2", CBU_Error::ELEMENTS_MISMATCH_BETWEEN_REACTANTS_AND_PRODUCTS},
+        {"H2O->H2O2", CBU_Error::FAILED_TO_BALANCE},
+    };
+    for (const auto& [equation, expected] : cases) {
+        for (CBU_Solver solver : {CBU_Solver::RECURSION, CBU_Solver::NULLSPACE}) {
+            CBU_Error error;
+            const Results results = solve(equation, solver, true, &error);
+            CBU_CHECK_EQUAL(error, expected);
+            CBU_CHECK(results.empty());
+        }
+    }
+
+    std::vector<std::string> messages; // the error is reported to the sink, nothing is thrown
+    CBU_Options options = CBU_Test::options(CBU_Solver::RECURSION);
+    options.sink = [&messages](CBU_Severity severity, std::string_view message) { if (severity == CBU_Severity::ERROR) { messages.emplace_back(message); } };
+    CBU_Balancer balancer(options);
+    balancer.balance("H2->O2");
+    CBU_CHECK_EQUAL(balancer.get_error(), CBU_Error::ELEMENTS_MISMATCH_BETWEEN_REACTANTS_AND_PRODUCTS);
+    CBU_CHECK_EQUAL(messages.size(), size_t(1));
+}
+
+// A presolved equation (two blocks that share no element) gives the results of the whole matrix, and only those are logged
+static void test_presolve() {
+    const std::string equation = "H2+O2+Na+Cl2->H2O+NaCl";
+    const Results expected = solve(equation, CBU_Solver::RECURSION, true);
+    CBU_CHECK(expected.size() > 1);
+    for (CBU_Solver solver : {CBU_Solver::RECURSION, CBU_Solver::PRUNED_RECURSION, CBU_Solver::PARALLEL_RECURSION}) {
+        size_t logged = 0;
+        CBU_Options options = CBU_Test::options(solver);
+        options.log_status = true;
+        options.sink = [&logged](CBU_Severity severity, std::string_view message) { logged += (severity == CBU_Severity::LOG && message == "A possible result found. "); };
+        CBU_Balancer balancer(options);
+        balancer.balance(equation);
+        CBU_CHECK(balancer.get_coefficients() == expected);
+        CBU_CHECK_EQUAL(logged, expected.size());
+        CBU_CHECK(balancer.get_options().log_status);
+        CBU_CHECK(balancer.get_main_matrix().second.size() == 4); // H, Cl, Na, O: the main matrix is not a block
+    }
+}
+
+// A result too large for one 31-bit prime is rebuilt from several (reduced at once if the first one was slow)
+static void test_modular_primes() {
+    CBU_Error error;
+    CBU_CHECK(solve("C100000H2+O2->CO2+H2O", CBU_Solver::MODULAR_NULLSPACE, true, &error) == (Results{{2, 200001, 200000, 2}}));
+    CBU_CHECK_EQUAL(error, CBU_Error::NONE);
+}
+
+// The Hilbert basis solver gives up at once on an equation whose extreme rays or box are beyond HILBERT_MAX_CANDIDATES, instead of after enumerating them
+static void test_hilbert_budget() {
+    CBU_Error error;
+    CBU_CHECK(solve("H2+O2->H2O+H2O2", CBU_Solver::HILBERT_BASIS, true, &error) == (Results{{1, 1, 0, 1}, {2, 1, 2, 0}}));
+    CBU_CHECK_EQUAL(error, CBU_Error::NONE);
+
+    // Ten such equations on one line: C(40, 19) sets of zeros for the extreme rays
+    const char* const pairs[][2] = {{"H", "O"}, {"Li", "Be"}, {"B", "C"}, {"N", "F"}, {"Na", "Mg"}, {"Al", "Si"}, {"P", "S"}, {"Cl", "K"}, {"Ca", "Sc"}, {"Ti", "V"}};
+    std::string reactants, products;
+    for (const auto& pair : pairs) {
+        const std::string a = pair[0], b = pair[1];
+        reactants += (reactants.empty() ? "" : "+") + a + "2+" + b + "2";
+        products += (products.empty() ? "" : "+") + a + "2" + b + "+" + a + "2" + b + "2";
+    }
+    CBU_CHECK(solve(reactants + "->" + products, CBU_Solver::HILBERT_BASIS, true, &error).empty());
+    CBU_CHECK_EQUAL(error, CBU_Error::BASIS_TOO_LARGE);
+
+    // A box of about 20,000,000 lattice points
+    CBU_CHECK(solve("CH4+C2H6+C3H8+C4H10+C5H12+C6H14+C7H16+C8H18+O2->CO2+H2O+CO", CBU_Solver::HILBERT_BASIS, false, &error).empty());
+    CBU_CHECK_EQUAL(error, CBU_Error::BASIS_TOO_LARGE);
+}
+
+// balance stores what solve returns, and clear_data drops it
+static void test_stored_data() {
+    CBU_Balancer balancer(CBU_Test::options(CBU_Solver::PRUNED_RECURSION));
+    balancer.balance("Zn + HCl -> ZnCl2 + H2");
+    CBU_CHECK_EQUAL(balancer.get_error(), CBU_Error::NONE);
+    CBU_CHECK(balancer.get_reactants_and_products().first == (std::vector<std::string>{"Zn", "HCl"}));
+    CBU_CHECK(balancer.get_reactants_and_products().second == (std::vector<std::string>{"ZnCl2", "H2"}));
+    CBU_CHECK(balancer.get_coefficients() == (Results{{1, 2, 1, 1}}));
+    CBU_CHECK(balancer.get_main_matrix().first == (std::vector<std::string>{"Cl", "H", "Zn"}));
+#ifndef CBU_NO_STATS
+    CBU_CHECK_EQUAL(balancer.get_stats().equations, uint64_t(1));
+#endif
+    balancer.clear_data();
+    CBU_CHECK(balancer.get_coefficients().empty());
+    CBU_CHECK(balancer.get_reactants_and_products().first.empty());
+
+    balancer.balance_with_given_compounds({"C", "O2"}, {"CO2"});
+    CBU_CHECK(balancer.get_coefficients() == (Results{{1, 1, 1}}));
+}
+
+// The compounds given to balance_with_given_compounds may be the stored ones (through get_reactants_and_products), in any place, and a balance replaces the data of the previous one
+static void test_given_stored_compounds() {
+    CBU_Balancer balancer(CBU_Test::options(CBU_Solver::NULLSPACE));
+    balancer.balance("H2O->H2+O2");
+    const auto& stored = balancer.get_reactants_and_products();
+    balancer.balance_with_given_compounds(stored.second, stored.first); // swapped
+    CBU_CHECK_EQUAL(balancer.get_error(), CBU_Error::NONE);
+    CBU_CHECK(stored.first == (std::vector<std::string>{"H2", "O2"}));
+    CBU_CHECK(stored.second == (std::vector<std::string>{"H2O"}));
+    CBU_CHECK(balancer.get_coefficients() == (Results{{2, 1, 2}}));
+
+    balancer.balance_with_given_compounds(stored.second, {"H2O2"}); // one of them
+    CBU_CHECK(stored.first == (std::vector<std::string>{"H2O"}));
+    CBU_CHECK(stored.second == (std::vector<std::string>{"H2O2"}));
+    CBU_CHECK_EQUAL(balancer.get_error(), CBU_Error::FAILED_TO_BALANCE);
+    CBU_CHECK(balancer.get_coefficients().empty());
+
+    balancer.balance_with_given_compounds({"H2O2"}, stored.first);
+    CBU_CHECK(stored.first == (std::vector<std::string>{"H2O2"}));
+    CBU_CHECK(stored.second == (std::vector<std::string>{"H2O"}));
+    balancer.balance_with_given_compounds(stored.first, {"H2O", "O2"});
+    CBU_CHECK(stored.second == (std::vector<std::string>{"H2O", "O2"}));
+    CBU_CHECK(balancer.get_coefficients() == (Results{{2, 2, 1}}));
+    balancer.balance_with_given_compounds(stored.first, stored.second); // the stored ones, as they are
+    CBU_CHECK(balancer.get_coefficients() == (Results{{2, 2, 1}}));
+}
+
+// A session gives the results and the main matrix of balance after each edit, without building the main matrix for CBU_Solver::NULLSPACE
+static void test_session() {
+    for (CBU_Solver solver : {CBU_Solver::NULLSPACE, CBU_Solver::PRUNED_RECURSION}) {
+        CBU_Balancer balancer(CBU_Test::options(solver));
+        CBU_Session session = balancer.session("KMnO4+HCl->KCl+MnCl2+Cl2");
+        CBU_CHECK_EQUAL(session.balance(), CBU_Error::ELEMENTS_MISMATCH_BETWEEN_REACTANTS_AND_PRODUCTS);
+        CBU_CHECK(session.get_main_matrix().first.empty());
+
+        CBU_CHECK_EQUAL(session.add_product("H2O"), CBU_Error::NONE);
+        CBU_CHECK_EQUAL(session.balance(), CBU_Error::NONE);
+        balancer.balance("KMnO4+HCl->KCl+MnCl2+Cl2+H2O");
+        CBU_CHECK(session.get_coefficients() == balancer.get_coefficients());
+        CBU_CHECK(session.get_main_matrix() == balancer.get_main_matrix());
+
+        CBU_CHECK(session.remove_reactant(0));
+        CBU_CHECK_EQUAL(session.add_reactant("MnO2"), CBU_Error::NONE);
+        CBU_CHECK_EQUAL(session.balance(), CBU_Error::ELEMENTS_MISMATCH_BETWEEN_REACTANTS_AND_PRODUCTS); // KCl is left
+        CBU_CHECK(session.remove_product(0));
+        CBU_CHECK_EQUAL(session.balance(), CBU_Error::NONE);
+        balancer.clear_data();
+        balancer.balance("HCl+MnO2->MnCl2+Cl2+H2O");
+        CBU_CHECK(session.get_coefficients() == balancer.get_coefficients());
+        CBU_CHECK(session.get_main_matrix() == balancer.get_main_matrix());
+        const auto& compounds = session.get_reactants_and_products(); // views, like the balancer's
+        CBU_CHECK(compounds == balancer.get_reactants_and_products());
+        CBU_CHECK(&session.get_reactants_and_products() == &compounds);
+        CBU_CHECK(session.get_elements() == balancer.get_elements());
+        CBU_CHECK(session.get_matrix().to_vectors() == balancer.get_matrix().to_vectors());
+        CBU_CHECK(session.get_sparse_matrix().empty());
+    }
+}
+
+// balance_batch gives one result per equation, in the given order, each as solve gives it
+static void test_batch() {
+    const std::vector<std::string> equations = CBU_Test::corpus();
+    CBU_Options options = CBU_Test::options(CBU_Solver::PRUNED_RECURSION);
+    options.thread_count = 4;
+    const std::vector<CBU_Result> results = CBU_Balancer(options).balance_batch(equations);
+    CBU_CHECK_EQUAL(results.size(), equations.size());
+    for (size_t i = 0; i < equations.size() && i < results.size(); i++) {
+        const CBU_Result expected = CBU_Balancer::solve(equations[i], options);
+        CBU_CHECK(results[i].coefficients == expected.coefficients);
+        CBU_CHECK_EQUAL(results[i].error, expected.error);
+        CBU_CHECK(results[i].reactants == expected.reactants);
+    }
+}
+
+// Each reaction of a set is balanced as solve would, and coupled intermediates take one coefficient
+static void test_set() {
+    const std::vector<std::string> equations = {"N2+H2->NH3", "NH3+O2->NO+H2O", "NO+O2->NO2"};
+    CBU_Balancer balancer(CBU_Test::options(CBU_Solver::NULLSPACE));
+    const std::vector<CBU_Result> results = balancer.balance_set(equations);
+    CBU_CHECK_EQUAL(results.size(), equations.size());
+    for (size_t i = 0; i < equations.size() && i < results.size(); i++) {
+        CBU_CHECK(results[i].coefficients == balancer.solve(equations[i]).coefficients);
+    }
+
+    const std::vector<CBU_Result> coupled = balancer.balance_set(equations, true);
+    CBU_CHECK_EQUAL(coupled.size(), equations.size());
+    if (coupled.size() == 3 && !coupled[0].coefficients.empty() && !coupled[1].coefficients.empty() && !coupled[2].coefficients.empty()) {
+        CBU_CHECK_EQUAL(coupled[0].coefficients[0][2], coupled[1].coefficients[0][0]); // NH3
+        CBU_CHECK_EQUAL(coupled[1].coefficients[0][2], coupled[2].coefficients[0][0]); // NO
+    } else {
+        CBU_CHECK(false);
+    }
+}
+
+// The generator yields exactly the results of the recursion, in the same order, and stops at its limits
+static void test_generator() {
+    const std::string equation = "C+O2->CO+CO2";
+    const CBU_Options options = CBU_Test::options(CBU_Solver::RECURSION);
+    CBU_Generator generator = CBU_Balancer::generate(equation, options);
+    Results generated;
+    std::vector<unsigned> coefficients;
+    while (generator.next(coefficients)) { generated.push_back(coefficients); }
+    CBU_CHECK_EQUAL(generator.get_status(), CBU_Search_status::COMPLETE);
+    CBU_CHECK(generated == solve(equation, CBU_Solver::RECURSION));
+
+    std::atomic<bool> cancel{true};
+    CBU_Limits limits;
+    limits.cancel = &cancel;
+    CBU_Generator cancelled = CBU_Balancer::generate(equation, options, limits);
+    CBU_CHECK(!cancelled.next(coefficients));
+    CBU_CHECK_EQUAL(cancelled.get_status(), CBU_Search_status::CANCELLED);
+}
+
+// An equation with SPARSE_MIN_COMPOUNDS compounds or more is eliminated sparsely, with the results of the dense elimination.
+// The chain HHe, HeLi, LiBe, ... alternates sides, so each of its elements is balanced by the next compound and the equation has one result, every coefficient 1.
+static void test_sparse() {
+    const char* const symbols[] = {"H", "He", "Li", "Be", "B", "C", "N", "O", "F", "Ne", "Na", "Mg", "Al", "Si", "P", "S", "Cl", "Ar", "K", "Ca", "Sc", "Ti", "V", "Cr", "Mn",
+                                   "Fe", "Co", "Ni", "Cu", "Zn", "Ga", "Ge", "As", "Se", "Br", "Kr"};
+    const size_t links = SPARSE_MIN_COMPOUNDS; // an even number, so the last element is a reactant
+    std::string reactants = "H", products = symbols[links];
+    for (size_t i = 0; i < links; i++) {
+        std::string& side = (i % 2 == 0) ? products : reactants;
+        side += std::string("+") + symbols[i] + symbols[i + 1];
+    }
+    const std::string equation = reactants + "->" + products;
+    CBU_Error error, modular_error;
+    const Results nullspace = solve(equation, CBU_Solver::NULLSPACE, true, &error);
+    CBU_CHECK_EQUAL(error, CBU_Error::NONE);
+    CBU_CHECK(nullspace == (Results{std::vector<unsigned>(links + 2, 1)}));
+    CBU_CHECK(solve(equation, CBU_Solver::MODULAR_NULLSPACE, true, &modular_error) == nullspace);
+    CBU_CHECK_EQUAL(modular_error, error);
+}
+
+int main() {
+    test_known_results();
+    test_solvers_agree_on_corpus();
+    test_errors();
+    test_presolve();
+    test_modular_primes();
+    test_hilbert_budget();
+    test_stored_data();
+    test_given_stored_compounds();
+    test_batch();
+    test_session();
+    test_set();
+    test_generator();
+    test_sparse();
+    return CBU_Test::finish("CBU_Test_balancer");
+}
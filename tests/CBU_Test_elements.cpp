@@ -0,0 +1,78 @@
+//
+// Created and edited by Frank Yang on 7/14/24.
+//
+
+// Copyright (c) 2024 Frank Yang
+// All rights reserved.
+//
+// This code is proprietary and confidential.
+// Unauthorized copying of this file, via any medium is strictly prohibited.
+
+
+// The element ids: the periodic table, the special elements interned by the program and their limit (SPECIAL_ELEMENTS_MAX).
+// It is a separate test because it fills the special elements of its process.
+
+#include "CBU_Test.h"
+
+// This method gives the i-th special symbol: "Q" (no element starts with it) followed by three lowercase letters
+static std::string special_symbol(size_t i) {
+    std::string symbol = "Q";
+    for (size_t digit = 0; digit < 3; digit++, i /= 26) { symbol += static_cast<char>('a' + i % 26); }
+    return symbol;
+}
+
+static void test_known_elements() {
+    CBU_CHECK_EQUAL(CBU_Elements::id("H"), 1u);
+    CBU_CHECK_EQUAL(CBU_Elements::id("Og"), CBU_Elements::KNOWN_COUNT);
+    CBU_CHECK_EQUAL(CBU_Elements::symbol(8), "O");
+    CBU_CHECK(CBU_Elements::is_known(CBU_Elements::id("Fe")));
+}
+
+static void test_special_elements() {
+    const unsigned id = CBU_Elements::id("Uuo");
+    CBU_CHECK(id > CBU_Elements::KNOWN_COUNT);
+    CBU_CHECK_EQUAL(CBU_Elements::id("Uuo"), id);
+    CBU_CHECK_EQUAL(CBU_Elements::symbol(id), "Uuo");
+    CBU_CHECK(!CBU_Elements::is_known(id));
+
+    CBU_Result result = CBU_Balancer::solve("Uuo2+H2->Uuo+H2", CBU_Test::options(CBU_Solver::NULLSPACE, false));
+    CBU_CHECK_EQUAL(result.error, CBU_Error::NONE);
+    CBU_CHECK(result.coefficients == (std::vector<std::vector<unsigned>>{{1, 1, 2, 1}}));
+}
+
+// A chain of special elements as long as a sparse main matrix (see test_sparse of CBU_Test_balancer): Qaaa + QaaaQbaa -> QbaaQcaa + ...
+static void test_sparse_special_elements() {
+    const size_t links = SPARSE_MIN_COMPOUNDS; // an even number, so the last element is a reactant
+    std::string reactants = special_symbol(0), products = special_symbol(links);
+    for (size_t i = 0; i < links; i++) {
+        std::string& side = (i % 2 == 0) ? products : reactants;
+        side += "+" + special_symbol(i) + special_symbol(i + 1);
+    }
+    CBU_Result result = CBU_Balancer::solve(reactants + "->" + products, CBU_Test::options(CBU_Solver::NULLSPACE));
+    CBU_CHECK_EQUAL(result.error, CBU_Error::NONE);
+    CBU_CHECK(result.coefficients == (std::vector<std::vector<unsigned>>{std::vector<unsigned>(links + 2, 1)}));
+}
+
+static void test_special_elements_limit() {
+    CBU_CHECK_EQUAL(CBU_Elements::id("Q" + std::string(SPECIAL_ELEMENT_MAX_LENGTH, 'a')), 0u); // too long
+    size_t interned = 0;
+    while (CBU_Elements::id(special_symbol(interned)) != 0) { interned++; }
+    CBU_CHECK(interned < SPECIAL_ELEMENTS_MAX); // some were interned by the tests above
+    CBU_CHECK_EQUAL(CBU_Elements::id(special_symbol(interned + 1)), 0u);
+    CBU_CHECK(CBU_Elements::id("Uuo") > CBU_Elements::KNOWN_COUNT); // the interned ones stay
+
+    const std::string equation = special_symbol(interned) + "2->" + special_symbol(interned);
+    CBU_Result result = CBU_Balancer::solve(equation, CBU_Test::options(CBU_Solver::NULLSPACE));
+    CBU_CHECK_EQUAL(result.error, CBU_Error::TOO_MANY_SPECIAL_ELEMENTS);
+    CBU_CHECK_EQUAL(CBU_Balancer::error_name(result.error), "TOO_MANY_SPECIAL_ELEMENTS");
+    result = CBU_Balancer::solve("Uuo2->Uuo", CBU_Test::options(CBU_Solver::NULLSPACE));
+    CBU_CHECK_EQUAL(result.error, CBU_Error::NONE);
+}
+
+int main() {
+    test_known_elements();
+    test_special_elements();
+    test_sparse_special_elements();
+    test_special_elements_limit();
+    return CBU_Test::finish("CBU_Test_elements");
+}
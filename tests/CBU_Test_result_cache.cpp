@@ -0,0 +1,159 @@
+//
+// Created and edited by Frank Yang on 7/14/24.
+//
+
+// Copyright (c) 2024 Frank Yang
+// All rights reserved.
+//
+// This code is proprietary and confidential.
+// Unauthorized copying of this file, via any medium is strictly prohibited.
+
+
+// The result cache: its results are those of the solvers, a reordered equation with one result hits them, and a file with a torn or corrupt tail is read up to it and then appended to.
+// The files are written to the working directory (the build directory under ctest).
+
+#include "CBU_Test.h"
+#include <cstdio>
+
+static const char* const CACHE_PATH = "CBU_Test_result_cache.cbu";
+
+// This method balances an equation with a result cache (nullptr for none), as balance does
+static CBU_Result solve_cached(const std::string& equation, CBU_Options options, std::shared_ptr<CBU_Result_cache> result_cache) {
+    options.result_cache = std::move(result_cache);
+    return CBU_Balancer::solve(equation, options);
+}
+
+static std::string read_file() {
+    std::ifstream input(CACHE_PATH, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+}
+
+static void write_file(const std::string& content) {
+    std::ofstream output(CACHE_PATH, std::ios::binary | std::ios::trunc);
+    output << content;
+}
+
+// A miss and a hit give the results without the cache, also for equations with several independent results, whose results depend on the order of the compounds
+static void test_transparency() {
+    const CBU_Options options = CBU_Test::options(CBU_Solver::NULLSPACE, true, 4);
+    std::vector<std::string> equations = {"O2+C->CO2+CO", "C+O2->CO+CO2", "Fe2O3+C->Fe+CO+CO2", "C+Fe2O3->CO2+Fe+CO"};
+    for (const auto& equation : CBU_Test::corpus()) { equations.push_back(equation); }
+    auto result_cache = std::make_shared<CBU_Result_cache>();
+    for (const auto& equation : equations) {
+        const CBU_Result expected = solve_cached(equation, options, nullptr);
+        for (int pass = 0; pass < 2; pass++) { // a miss, then a hit
+            const CBU_Result result = solve_cached(equation, options, result_cache);
+            CBU_CHECK_EQUAL(result.error, expected.error);
+            CBU_CHECK(result.coefficients == expected.coefficients);
+            CBU_CHECK(result.main_matrix.to_vectors() == expected.main_matrix.to_vectors());
+        }
+    }
+    CBU_CHECK_EQUAL(result_cache->hits(), equations.size());
+}
+
+// An equation with one primitive result is cached under its sorted compounds, so a reordered one hits it (with its coefficients in its own order); one with several independent results is not
+static void test_reordered() {
+    const CBU_Options options = CBU_Test::options(CBU_Solver::NULLSPACE);
+    auto result_cache = std::make_shared<CBU_Result_cache>();
+    CBU_CHECK(solve_cached("H2+O2->H2O", options, result_cache).coefficients == (std::vector<std::vector<unsigned>>{{2, 1, 2}}));
+    const CBU_Result result = solve_cached("O2+H2->H2O", options, result_cache);
+    CBU_CHECK_EQUAL(result.error, CBU_Error::NONE);
+    CBU_CHECK(result.coefficients == (std::vector<std::vector<unsigned>>{{1, 2, 2}}));
+    CBU_CHECK(result.main_matrix.to_vectors() == solve_cached("O2+H2->H2O", options, nullptr).main_matrix.to_vectors());
+    CBU_CHECK_EQUAL(result_cache->size(), 1u);
+    CBU_CHECK_EQUAL(result_cache->hits(), 1u);
+    CBU_CHECK_EQUAL(result_cache->misses(), 1u);
+    CBU_CHECK_EQUAL(solve_cached("H2O2->H2O+O2", options, result_cache).error, CBU_Error::NONE);
+    CBU_CHECK(solve_cached("H2O2->O2+H2O", options, result_cache).coefficients == (std::vector<std::vector<unsigned>>{{2, 1, 2}}));
+    CBU_CHECK_EQUAL(result_cache->hits(), 2u);
+
+    solve_cached("C+O2->CO+CO2", options, result_cache);
+    solve_cached("O2+C->CO2+CO", options, result_cache);
+    CBU_CHECK_EQUAL(result_cache->size(), 4u);
+    CBU_CHECK_EQUAL(result_cache->hits(), 2u);
+}
+
+// The errors of a limit are not cached, a failure of the solver is
+static void test_cached_errors() {
+    auto result_cache = std::make_shared<CBU_Result_cache>();
+    CBU_Result result = solve_cached("CH4+C2H6+C3H8+C4H10+C5H12+C6H14+C7H16+C8H18+O2->CO2+H2O+CO", CBU_Test::options(CBU_Solver::HILBERT_BASIS, false), result_cache);
+    CBU_CHECK_EQUAL(result.error, CBU_Error::BASIS_TOO_LARGE);
+    CBU_CHECK_EQUAL(result_cache->size(), 0u);
+    result = solve_cached("H2O->H2O2", CBU_Test::options(CBU_Solver::NULLSPACE), result_cache);
+    CBU_CHECK_EQUAL(result.error, CBU_Error::FAILED_TO_BALANCE);
+    CBU_CHECK_EQUAL(result_cache->size(), 1u);
+    result = solve_cached("H2O->H2O2", CBU_Test::options(CBU_Solver::NULLSPACE), result_cache);
+    CBU_CHECK_EQUAL(result.error, CBU_Error::FAILED_TO_BALANCE);
+    CBU_CHECK_EQUAL(result_cache->hits(), 1u);
+}
+
+// A record is 5 uint32 (the key size, the results, the columns, the error and the checksum), the key padded to 4 bytes and the coefficients
+static std::string record(const std::string& key, int32_t error, const std::vector<uint32_t>& coefficients, uint32_t columns) {
+    const uint32_t header[5] = {static_cast<uint32_t>(key.size()), columns == 0 ? 0 : static_cast<uint32_t>(coefficients.size()) / columns, columns, static_cast<uint32_t>(error), 0};
+    std::string bytes(reinterpret_cast<const char*>(header), sizeof(header));
+    bytes += key + std::string((4 - key.size() % 4) % 4, '\0');
+    bytes.append(reinterpret_cast<const char*>(coefficients.data()), coefficients.size() * sizeof(uint32_t));
+    uint32_t checksum = 0x811c9dc5u; // FNV-1a, but for the checksum field
+    for (size_t i = 0; i < bytes.size(); i++) {
+        if (i < 16 || i >= 20) { checksum = (checksum ^ static_cast<unsigned char>(bytes[i])) * 0x01000193u; }
+    }
+    std::memcpy(&bytes[16], &checksum, sizeof(checksum));
+    return bytes;
+}
+
+static void test_file() {
+    const CBU_Options options = CBU_Test::options(CBU_Solver::NULLSPACE);
+    std::remove(CACHE_PATH);
+    {
+        auto result_cache = std::make_shared<CBU_Result_cache>(CACHE_PATH);
+        if (!result_cache->is_open()) { return; } // no mmap
+        solve_cached("H2+O2->H2O", options, result_cache);
+        solve_cached("C+O2->CO2", options, result_cache);
+        CBU_CHECK_EQUAL(result_cache->appends(), 2u);
+    }
+    const std::string whole = read_file();
+
+    // A torn tail is not read, and the next append truncates it
+    write_file(whole + whole.substr(8, 30));
+    {
+        auto result_cache = std::make_shared<CBU_Result_cache>(CACHE_PATH);
+        CBU_CHECK_EQUAL(result_cache->size(), 2u);
+        const CBU_Result result = solve_cached("N2+H2->NH3", options, result_cache);
+        CBU_CHECK(result.coefficients == (std::vector<std::vector<unsigned>>{{1, 3, 2}}));
+    }
+    {
+        auto result_cache = std::make_shared<CBU_Result_cache>(CACHE_PATH);
+        CBU_CHECK_EQUAL(result_cache->size(), 3u);
+        const CBU_Result result = solve_cached("N2+H2->NH3", options, result_cache);
+        CBU_CHECK(result.coefficients == (std::vector<std::vector<unsigned>>{{1, 3, 2}}));
+        CBU_CHECK_EQUAL(result_cache->hits(), 1u);
+    }
+
+    // A corrupt record (a wrong checksum, or an error that is not cached) is not read, nor is anything after it
+    std::string corrupt = whole;
+    corrupt[corrupt.size() - 1] ^= 1; // a coefficient of the last record
+    write_file(corrupt);
+    CBU_CHECK_EQUAL(CBU_Result_cache(CACHE_PATH).size(), 1u);
+    const std::string key = "N*" + std::to_string(DEFAULT_MAX_COEF) + ":H2+O2->H2O";
+    write_file(std::string(RESULT_CACHE_MAGIC, 8) + record(key, 99, {2, 1, 2}, 3) + whole.substr(8));
+    CBU_CHECK_EQUAL(CBU_Result_cache(CACHE_PATH).size(), 0u);
+    write_file(std::string(RESULT_CACHE_MAGIC, 8) + record(key, static_cast<int32_t>(CBU_Error::COEFFICIENT_OVERFLOW), {}, 3) + whole.substr(8));
+    CBU_CHECK_EQUAL(CBU_Result_cache(CACHE_PATH).size(), 0u);
+    const std::string other_key = "N*" + std::to_string(DEFAULT_MAX_COEF) + ":Cl2+H2->HCl"; // sorted
+    write_file(std::string(RESULT_CACHE_MAGIC, 8) + record(other_key, static_cast<int32_t>(CBU_Error::NONE), {1, 1, 2}, 3) + whole.substr(8));
+    {
+        auto result_cache = std::make_shared<CBU_Result_cache>(CACHE_PATH);
+        CBU_CHECK_EQUAL(result_cache->size(), 3u); // the same record, but right
+        CBU_CHECK(solve_cached("H2+Cl2->HCl", options, result_cache).coefficients == (std::vector<std::vector<unsigned>>{{1, 1, 2}}));
+        CBU_CHECK_EQUAL(result_cache->hits(), 1u);
+    }
+    std::remove(CACHE_PATH);
+}
+
+int main() {
+    test_transparency();
+    test_reordered();
+    test_cached_errors();
+    test_file();
+    return CBU_Test::finish("CBU_Test_result_cache");
+}
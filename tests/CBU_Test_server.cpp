@@ -0,0 +1,104 @@
+//
+// Created and edited by Frank Yang on 7/14/24.
+//
+
+// Copyright (c) 2024 Frank Yang
+// All rights reserved.
+//
+// This code is proprietary and confidential.
+// Unauthorized copying of this file, via any medium is strictly prohibited.
+
+
+// The balancing daemon: its socket (a stale one is replaced, a live one is not) and a client that pipelines more requests than SERVER_MAX_PENDING.
+// The socket is made in the working directory (the build directory under ctest).
+
+#include "CBU_Test.h"
+#include "CBU_Server.h"
+
+#ifdef CBU_SERVER
+static const char* const SOCKET_PATH = "CBU_Test_server.sock";
+
+static sockaddr_un socket_address() {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, SOCKET_PATH, sizeof(address.sun_path) - 1);
+    return address;
+}
+
+// This method connects to the daemon, waiting for it to listen (a blocking socket, -1 if it never does)
+static int connect_client() {
+    const sockaddr_un address = socket_address();
+    for (int attempt = 0; attempt < 500; attempt++) {
+        const int client = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (::connect(client, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0) { return client; }
+        ::close(client);
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return -1;
+}
+
+static void test_server() {
+    // A stale socket: bound, but nobody listens on it
+    ::unlink(SOCKET_PATH);
+    const sockaddr_un address = socket_address();
+    const int stale = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    CBU_CHECK_EQUAL(::bind(stale, reinterpret_cast<const sockaddr*>(&address), sizeof(address)), 0);
+    ::close(stale);
+
+    CBU_Options options = CBU_Test::options(CBU_Solver::NULLSPACE);
+    options.thread_count = 2;
+    CBU_Server server(SOCKET_PATH, options);
+    bool served = false;
+    std::thread loop([&]() { served = server.run(); });
+    const int client = connect_client();
+    CBU_CHECK(client >= 0);
+
+    struct stat status{};
+    CBU_CHECK_EQUAL(::lstat(SOCKET_PATH, &status), 0);
+    CBU_CHECK_EQUAL(status.st_mode & 077, 0u); // only for its user
+    CBU_CHECK(!CBU_Server(SOCKET_PATH, options).run()); // a live daemon is not replaced
+
+    // Twice as many requests as are taken at a time, sent at once (the daemon stops reading them meanwhile)
+    const size_t requests = 2 * SERVER_MAX_PENDING + 5;
+    std::thread sender([&]() {
+        std::string text;
+        for (size_t i = 0; i < requests; i++) { text += std::to_string(i) + " H2+O2->H2O\n"; }
+        for (size_t sent = 0; sent < text.size(); ) {
+            const ssize_t count = ::send(client, text.data() + sent, text.size() - sent, MSG_NOSIGNAL);
+            if (count <= 0) { break; }
+            sent += static_cast<size_t>(count);
+        }
+        ::shutdown(client, SHUT_WR);
+    });
+    std::string received;
+    char buffer[4096];
+    ssize_t count;
+    while ((count = ::read(client, buffer, sizeof(buffer))) > 0) { received.append(buffer, static_cast<size_t>(count)); } // until the daemon closes it
+    sender.join();
+    ::close(client);
+    std::vector<bool> answered(requests, false);
+    size_t begin = 0, end, lines = 0;
+    while ((end = received.find('\n', begin)) != std::string::npos) {
+        const std::string line = received.substr(begin, end - begin);
+        begin = end + 1;
+        lines++;
+        const size_t space = line.find(' ');
+        const size_t id = std::strtoul(line.c_str(), nullptr, 10);
+        if (id < requests && line.substr(space + 1) == "NONE 2H2 + O2 == 2H2O") { answered[id] = true; }
+    }
+    CBU_CHECK_EQUAL(lines, requests);
+    CBU_CHECK(std::find(answered.begin(), answered.end(), false) == answered.end());
+
+    server.stop();
+    loop.join();
+    CBU_CHECK(served);
+    CBU_CHECK(::lstat(SOCKET_PATH, &status) != 0); // removed on return
+}
+#endif
+
+int main() {
+#ifdef CBU_SERVER
+    test_server();
+#endif
+    return CBU_Test::finish("CBU_Test_server");
+}